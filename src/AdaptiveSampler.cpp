@@ -0,0 +1,191 @@
+#include "AdaptiveSampler.h"
+
+//--------------------------------------------------------------
+AdaptiveSampler::AdaptiveSampler() :
+	myMaxDepth(800), myMaxDepthStep(100), mySpacing(0) {
+}
+
+//--------------------------------------------------------------
+void AdaptiveSampler::setMaxDepth(float maxDepth) {
+	myMaxDepth = maxDepth;
+}
+
+//--------------------------------------------------------------
+void AdaptiveSampler::setMaxDepthStep(float maxDepthStep) {
+	myMaxDepthStep = maxDepthStep;
+}
+
+//--------------------------------------------------------------
+const vector<vec3> &AdaptiveSampler::getSamples() const {
+	return mySamples;
+}
+
+//--------------------------------------------------------------
+const vector<ofIndexType> &AdaptiveSampler::getIndices() const {
+	return myIndices;
+}
+
+//--------------------------------------------------------------
+const ofRectangle &AdaptiveSampler::getRegion() const {
+	return myRegion;
+}
+
+//--------------------------------------------------------------
+float AdaptiveSampler::getSpacing() const {
+	return mySpacing;
+}
+
+//--------------------------------------------------------------
+bool AdaptiveSampler::isForeground(uint16_t d) const {
+	return d > 0 && d < myMaxDepth;
+}
+
+//--------------------------------------------------------------
+void AdaptiveSampler::sample(const DepthPyramid &pyramid, int vertexBudget, ofPrimitiveMode mode) {
+	mySamples.clear();
+	myIndices.clear();
+	myRegion.set(0, 0, 0, 0);
+	mySpacing = 0;
+	if (pyramid.getNumLevels() == 0 || vertexBudget <= 0) {
+		return;
+	}
+
+	const ofShortPixels &depth = pyramid.getLevel(0);
+	const uint16_t *data = depth.getData();
+	int width = depth.getWidth();
+	int height = depth.getHeight();
+
+	// Find the foreground bounding box and area
+	int minX = width;
+	int minY = height;
+	int maxX = -1;
+	int maxY = -1;
+	int numForeground = 0;
+	for (int y = 0; y < height; y++) {
+		const uint16_t *row = data + y * width;
+		int rowMinX = width;
+		int rowMaxX = -1;
+		for (int x = 0; x < width; x++) {
+			if (isForeground(row[x])) {
+				rowMinX = min(rowMinX, x);
+				rowMaxX = x;
+				numForeground++;
+			}
+		}
+		if (rowMaxX >= 0) {
+			minX = min(minX, rowMinX);
+			maxX = max(maxX, rowMaxX);
+			minY = min(minY, y);
+			maxY = y;
+		}
+	}
+	if (numForeground == 0) {
+		return;
+	}
+	myRegion.set(minX, minY, maxX - minX + 1, maxY - minY + 1);
+
+	// Spacing that puts about vertexBudget grid points on the foreground,
+	// but no more than one per pixel. Rounded up to a quarter pixel so
+	// small changes in the foreground area don't move every sample.
+	mySpacing = max(1.0f, ceilf(sqrtf(float(numForeground) / vertexBudget) * 4) / 4);
+
+	// Grid points at multiples of the spacing inside the bounding box
+	int firstX = ceilf(minX / mySpacing);
+	int firstY = ceilf(minY / mySpacing);
+	int gridSizeX = int(maxX / mySpacing) - firstX + 1;
+	int gridSizeY = int(maxY / mySpacing) - firstY + 1;
+
+	// Room for the usual variation in sample count from frame to frame,
+	// so the arrays don't keep growing while the performer moves
+	if (mySamples.capacity() < size_t(2 * vertexBudget)) {
+		mySamples.reserve(2 * vertexBudget);
+		myIndices.reserve(12 * vertexBudget);
+		myGridVertex.reserve(4 * vertexBudget);
+	}
+	myGridVertex.assign(gridSizeX * gridSizeY, -1);
+
+	int level = pyramid.getLevelForSpacing(mySpacing);
+	const ofShortPixels &levelDepth = pyramid.getLevel(level);
+	const uint16_t *levelData = levelDepth.getData();
+	int levelWidth = levelDepth.getWidth();
+	int levelHeight = levelDepth.getHeight();
+
+	// Only grid points on the foreground become samples, numbered in the
+	// same column by column order as the uniform grid
+	for (int i = 0; i < gridSizeX; i++) {
+		float x = (firstX + i) * mySpacing;
+		int levelX = min(min(int(x + 0.5), width - 1) >> level, levelWidth - 1);
+		for (int j = 0; j < gridSizeY; j++) {
+			float y = (firstY + j) * mySpacing;
+			int levelY = min(min(int(y + 0.5), height - 1) >> level, levelHeight - 1);
+			uint16_t d = levelData[levelY * levelWidth + levelX];
+			if (isForeground(d)) {
+				myGridVertex[i * gridSizeY + j] = mySamples.size();
+				mySamples.push_back(vec3(x, y, d));
+			}
+		}
+	}
+
+	if (mode == OF_PRIMITIVE_LINES) {
+		// Lines to the next sample across and down
+		for (int i = 0; i < gridSizeX; i++) {
+			for (int j = 0; j < gridSizeY; j++) {
+				int v = myGridVertex[i * gridSizeY + j];
+				if (v < 0) {
+					continue;
+				}
+				if (i < gridSizeX - 1) {
+					addEdge(v, myGridVertex[(i + 1) * gridSizeY + j]);
+				}
+				if (j < gridSizeY - 1) {
+					addEdge(v, myGridVertex[i * gridSizeY + j + 1]);
+				}
+			}
+		}
+	}
+	else if (mode == OF_PRIMITIVE_TRIANGLES) {
+		// Two triangles per grid square with the same winding as the
+		// uniform grid, or one if a corner has no sample
+		for (int i = 0; i < gridSizeX - 1; i++) {
+			for (int j = 0; j < gridSizeY - 1; j++) {
+				int v00 = myGridVertex[i * gridSizeY + j];
+				int v10 = myGridVertex[(i + 1) * gridSizeY + j];
+				int v01 = myGridVertex[i * gridSizeY + j + 1];
+				int v11 = myGridVertex[(i + 1) * gridSizeY + j + 1];
+
+				if (v00 >= 0 && v11 >= 0) {
+					addTriangle(v00, v11, v10);
+					addTriangle(v00, v01, v11);
+				}
+				else if (v00 >= 0) {
+					addTriangle(v00, v01, v10);
+				}
+				else if (v11 >= 0) {
+					addTriangle(v10, v01, v11);
+				}
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------
+bool AdaptiveSampler::isConnected(int v0, int v1) const {
+	return v0 >= 0 && v1 >= 0 && fabsf(mySamples[v0].z - mySamples[v1].z) <= myMaxDepthStep;
+}
+
+//--------------------------------------------------------------
+void AdaptiveSampler::addEdge(int v0, int v1) {
+	if (isConnected(v0, v1)) {
+		myIndices.push_back(v0);
+		myIndices.push_back(v1);
+	}
+}
+
+//--------------------------------------------------------------
+void AdaptiveSampler::addTriangle(int v0, int v1, int v2) {
+	if (isConnected(v0, v1) && isConnected(v1, v2) && isConnected(v2, v0)) {
+		myIndices.push_back(v0);
+		myIndices.push_back(v1);
+		myIndices.push_back(v2);
+	}
+}
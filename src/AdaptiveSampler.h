@@ -0,0 +1,55 @@
+#pragma once
+
+#include "ofMain.h"
+#include "DepthPyramid.h"
+
+using namespace glm;
+
+// Samples a depth image where the performer is instead of uniformly.
+//
+// Each frame the bounding box of the foreground (depth between 0 and
+// the far limit) is found, and a square grid is laid over it with the
+// spacing chosen so about vertexBudget grid points land on foreground
+// pixels. Only those become samples, the background gets none. The
+// grid is aligned to multiples of its spacing so a performer standing
+// still is sampled at the same pixels every frame. Depth is read from
+// the pyramid level matching the spacing.
+//
+// The matching index buffer only joins neighbouring samples, and skips
+// edges that jump in depth more than maxDepthStep, so there are no
+// stretched triangles between the body and what's behind it.
+class AdaptiveSampler {
+public:
+	AdaptiveSampler();
+
+	void sample(const DepthPyramid &pyramid, int vertexBudget, ofPrimitiveMode mode);
+
+	// Foreground is depth above 0 and below this, in mm
+	void setMaxDepth(float maxDepth);
+	void setMaxDepthStep(float maxDepthStep);
+
+	// x and y in depth image pixels, z the depth in mm
+	const vector<vec3> &getSamples() const;
+	const vector<ofIndexType> &getIndices() const;
+
+	// Foreground bounding box and sample spacing, in depth pixels
+	const ofRectangle &getRegion() const;
+	float getSpacing() const;
+
+private:
+	bool isForeground(uint16_t d) const;
+	void addEdge(int v0, int v1);
+	void addTriangle(int v0, int v1, int v2);
+	bool isConnected(int v0, int v1) const;
+
+	float myMaxDepth;
+	float myMaxDepthStep;
+
+	vector<vec3> mySamples;
+	vector<ofIndexType> myIndices;
+	ofRectangle myRegion;
+	float mySpacing;
+
+	// Sample index for each grid point, -1 where there's no foreground
+	vector<int> myGridVertex;
+};
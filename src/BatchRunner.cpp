@@ -0,0 +1,731 @@
+#include "BatchRunner.h"
+#include "ParticleSystem.h"
+#include "DepthRecorder.h"
+#include "MeshSequence.h"
+#include "Clock.h"
+#include "helpers.h"
+#include "meshCache.h"
+#include "parallel.h"
+#include "FrameArena.h"
+#include "allocationCounter.h"
+#include "QualityGovernor.h"
+#include "MeshStreamPublisher.h"
+#include "StreamingMeshProcessor.h"
+
+//--------------------------------------------------------------
+BatchDepthSettings::BatchDepthSettings() :
+	filter(DEPTH_FILTER_NONE), learnBackgroundFrames(0), backgroundMargin(50), adaptiveSampling(false), interpolationDelay(-1) {
+}
+
+//--------------------------------------------------------------
+BatchOutlierSettings::BatchOutlierSettings() :
+	threshold(-1), numNeighbours(8) {
+}
+
+//--------------------------------------------------------------
+BatchOctreeSettings::BatchOctreeSettings() :
+	pointBudget(0) {
+}
+
+//--------------------------------------------------------------
+BatchPreprocessSettings::BatchPreprocessSettings() :
+	weldThreshold(0.0001), cellSize(0), memoryBudget(4096), asciiOutput(false) {
+}
+
+//--------------------------------------------------------------
+BatchSettings::BatchSettings() :
+	numFrames(-1), fps(60), amplitude(5.0), frequency(1.0), scale(1.0), effects(EFFECT_NOISE),
+	gridSizeX(200), gridSizeY(200), displayMode(OF_PRIMITIVE_TRIANGLES), numSyntheticPoints(5000000), numThreads(0),
+	compactStorage(false), reorderMesh(true), simulate(false), springIterations(8), useMeshCache(true), targetFps(0),
+	bakedNoise(false), analyticNormals(false), checkAllocations(false) {
+}
+
+//--------------------------------------------------------------
+static bool endsWith(const string &s, const string &suffix) {
+	return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+//--------------------------------------------------------------
+// Each of these parses the options of one feature. They return true
+// if argv[i] was one of them, having moved i past its values.
+static bool parseRunArgument(const string &arg, int argc, char *argv[], int &i, BatchSettings &settings) {
+	bool hasValue = i + 1 < argc;
+	if (arg == "--frames" && hasValue) {
+		settings.numFrames = ofToInt(argv[++i]);
+	}
+	else if (arg == "--fps" && hasValue) {
+		settings.fps = ofToFloat(argv[++i]);
+	}
+	else if (arg == "--amplitude" && hasValue) {
+		settings.amplitude = ofToFloat(argv[++i]);
+	}
+	else if (arg == "--frequency" && hasValue) {
+		settings.frequency = ofToFloat(argv[++i]);
+	}
+	else if (arg == "--scale" && hasValue) {
+		settings.scale = ofToFloat(argv[++i]);
+	}
+	else if (arg == "--effects" && hasValue) {
+		settings.effects = 0;
+		for (const string &name : ofSplitString(argv[++i], ",", true, true)) {
+			if (name == "noise") settings.effects |= EFFECT_NOISE;
+			else if (name == "ripple") settings.effects |= EFFECT_RIPPLE;
+			else if (name == "twist") settings.effects |= EFFECT_TWIST;
+			else if (name == "flow") settings.effects |= EFFECT_FLOW;
+			else if (name == "shape") settings.effects |= EFFECT_SHAPE;
+			else ofLogWarning("parseBatchArguments") << "ignoring unknown effect " << name;
+		}
+	}
+	else if (arg == "--grid" && i + 2 < argc) {
+		settings.gridSizeX = ofToInt(argv[++i]);
+		settings.gridSizeY = ofToInt(argv[++i]);
+	}
+	else if (arg == "--mode" && hasValue) {
+		string mode = argv[++i];
+		if (mode == "points") {
+			settings.displayMode = OF_PRIMITIVE_POINTS;
+		}
+		else if (mode == "lines") {
+			settings.displayMode = OF_PRIMITIVE_LINES;
+		}
+		else {
+			settings.displayMode = OF_PRIMITIVE_TRIANGLES;
+		}
+	}
+	else if (arg == "--points" && hasValue) {
+		settings.numSyntheticPoints = ofToInt(argv[++i]);
+	}
+	else if (arg == "--threads" && hasValue) {
+		settings.numThreads = ofToInt(argv[++i]);
+	}
+	else if (arg == "--compact") {
+		settings.compactStorage = true;
+	}
+	else if (arg == "--no-reorder") {
+		settings.reorderMesh = false;
+	}
+	else if (arg == "--simulate") {
+		settings.simulate = true;
+	}
+	else if (arg == "--iterations" && hasValue) {
+		settings.springIterations = ofToInt(argv[++i]);
+	}
+	else if (arg == "--target-fps" && hasValue) {
+		settings.targetFps = ofToFloat(argv[++i]);
+	}
+	else if (arg == "--no-cache") {
+		settings.useMeshCache = false;
+	}
+	else if (arg == "--baked-noise") {
+		settings.bakedNoise = true;
+	}
+	else if (arg == "--analytic-normals") {
+		settings.analyticNormals = true;
+	}
+	else if (arg == "--check-allocations") {
+		settings.checkAllocations = true;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+static bool parseDepthArgument(const string &arg, int argc, char *argv[], int &i, BatchDepthSettings &settings) {
+	bool hasValue = i + 1 < argc;
+	if (arg == "--filter" && hasValue) {
+		string filter = argv[++i];
+		if (filter == "median") {
+			settings.filter = DEPTH_FILTER_MEDIAN;
+		}
+		else if (filter == "bilateral") {
+			settings.filter = DEPTH_FILTER_BILATERAL;
+		}
+		else {
+			settings.filter = DEPTH_FILTER_NONE;
+		}
+	}
+	else if (arg == "--learn-background" && hasValue) {
+		settings.learnBackgroundFrames = ofToInt(argv[++i]);
+	}
+	else if (arg == "--margin" && hasValue) {
+		settings.backgroundMargin = ofToFloat(argv[++i]);
+	}
+	else if (arg == "--adaptive") {
+		settings.adaptiveSampling = true;
+	}
+	else if (arg == "--interpolate" && hasValue) {
+		settings.interpolationDelay = ofToFloat(argv[++i]);
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+static bool parseOutlierArgument(const string &arg, int argc, char *argv[], int &i, BatchOutlierSettings &settings) {
+	bool hasValue = i + 1 < argc;
+	if (arg == "--outliers" && hasValue) {
+		settings.threshold = ofToFloat(argv[++i]);
+	}
+	else if (arg == "--neighbours" && hasValue) {
+		settings.numNeighbours = ofToInt(argv[++i]);
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+static bool parseOctreeArgument(const string &arg, int argc, char *argv[], int &i, BatchOctreeSettings &settings) {
+	if (arg == "--point-budget" && i + 1 < argc) {
+		settings.pointBudget = ofToInt(argv[++i]);
+		return true;
+	}
+	return false;
+}
+
+//--------------------------------------------------------------
+static bool parsePreprocessArgument(const string &arg, int argc, char *argv[], int &i, BatchPreprocessSettings &settings) {
+	bool hasValue = i + 1 < argc;
+	if (arg == "--preprocess" && hasValue) {
+		settings.outputPath = argv[++i];
+	}
+	else if (arg == "--weld" && hasValue) {
+		settings.weldThreshold = ofToFloat(argv[++i]);
+	}
+	else if (arg == "--decimate" && hasValue) {
+		settings.cellSize = ofToFloat(argv[++i]);
+	}
+	else if (arg == "--memory" && hasValue) {
+		settings.memoryBudget = ofToFloat(argv[++i]);
+	}
+	else if (arg == "--ascii") {
+		settings.asciiOutput = true;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+static bool parseOutputArgument(const string &arg, int argc, char *argv[], int &i, BatchOutputSettings &settings) {
+	bool hasValue = i + 1 < argc;
+	if (arg == "--sequence" && hasValue) {
+		settings.sequencePath = argv[++i];
+	}
+	else if (arg == "--ply" && hasValue) {
+		settings.plyPrefix = argv[++i];
+	}
+	else if (arg == "--publish" && hasValue) {
+		settings.publishName = argv[++i];
+	}
+	else if (arg == "--checksums" && hasValue) {
+		settings.checksumPath = argv[++i];
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+bool parseBatchArguments(int argc, char *argv[], BatchSettings &settings) {
+	bool batch = false;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+
+		if (arg == "--batch" && i + 1 < argc) {
+			batch = true;
+			settings.inputPath = argv[++i];
+		}
+		else if (parseRunArgument(arg, argc, argv, i, settings) ||
+			parseDepthArgument(arg, argc, argv, i, settings.depth) ||
+			parseOutlierArgument(arg, argc, argv, i, settings.outliers) ||
+			parseOctreeArgument(arg, argc, argv, i, settings.octree) ||
+			parsePreprocessArgument(arg, argc, argv, i, settings.preprocess) ||
+			parseOutputArgument(arg, argc, argv, i, settings.output)) {
+			continue;
+		}
+		else if (arg.compare(0, 2, "--") == 0) {
+			ofLogWarning("parseBatchArguments") << "ignoring unknown argument " << arg;
+		}
+	}
+	return batch;
+}
+
+//--------------------------------------------------------------
+uint64_t calcMeshChecksum(const ofMesh &mesh) {
+	uint64_t hash = 14695981039346656037ULL;
+
+	const uint8_t *bytes = reinterpret_cast<const uint8_t *>(mesh.getVertices().data());
+	size_t numBytes = mesh.getNumVertices() * sizeof(vec3);
+	for (size_t i = 0; i < numBytes; i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	}
+
+	bytes = reinterpret_cast<const uint8_t *>(mesh.getNormals().data());
+	numBytes = mesh.getNumNormals() * sizeof(vec3);
+	for (size_t i = 0; i < numBytes; i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+//--------------------------------------------------------------
+// A stand-in for many accumulated scans: points on the surfaces of a
+// few ellipsoids roughly the size and shape of arm.ply's body, each
+// point from one of several slightly offset scans
+static void makeSyntheticCloud(int numPoints, ofMesh &mesh) {
+	struct Part {
+		vec3 center;
+		vec3 radius;
+	};
+	const Part parts[] = {
+		{ vec3(0, 440, 0), vec3(30, 36, 30) },
+		{ vec3(0, 320, 0), vec3(60, 90, 40) },
+		{ vec3(-90, 330, 0), vec3(20, 80, 20) },
+		{ vec3(90, 330, 0), vec3(20, 80, 20) },
+		{ vec3(-30, 120, 0), vec3(25, 130, 25) },
+		{ vec3(30, 120, 0), vec3(25, 130, 25) }
+	};
+	const int numParts = sizeof(parts) / sizeof(parts[0]);
+	const int numScans = 8;
+
+	mesh.clear();
+	mesh.setMode(OF_PRIMITIVE_POINTS);
+	mesh.getVertices().resize(numPoints);
+	mesh.getNormals().resize(numPoints);
+	vec3 *vertices = mesh.getVertices().data();
+	vec3 *normals = mesh.getNormals().data();
+	parallelFor(0, numPoints, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			// Hashed from the index, so the cloud doesn't depend on the
+			// number of threads
+			uint32_t h = uint32_t(i) * 2654435761u;
+			h ^= h >> 15;
+			h *= 2246822519u;
+			h ^= h >> 13;
+			float u = (h & 0xFFFF) / 65535.0;
+			float v = (h >> 16) / 65535.0;
+			const Part &part = parts[i % numParts];
+			int scan = (i / numParts) % numScans;
+
+			float theta = u * TWO_PI;
+			float z = v * 2 - 1;
+			float r = sqrtf(max(0.0f, 1 - z * z));
+			vec3 direction(r * cosf(theta), z, r * sinf(theta));
+			vec3 offset = vec3(scan % 2, (scan / 2) % 2, scan / 4) * 0.5f;
+			vertices[i] = part.center + direction * part.radius + offset;
+			normals[i] = normalize(direction / part.radius);
+		}
+	});
+}
+
+//--------------------------------------------------------------
+// Prepares a scan too large to load, see StreamingMeshProcessor
+static int runPreprocess(const string &inputPath, const BatchPreprocessSettings &settings) {
+	StreamingMeshProcessor processor;
+	processor.setWeldThreshold(settings.weldThreshold);
+	processor.setCellSize(settings.cellSize);
+	processor.setMemoryBudget(uint64_t(settings.memoryBudget * 1024 * 1024));
+	processor.setAsciiOutput(settings.asciiOutput);
+	return processor.process(inputPath, settings.outputPath) ? 0 : 1;
+}
+
+//--------------------------------------------------------------
+static void setupOutlierRemoval(const BatchOutlierSettings &settings, ParticleSystem &particleSystem) {
+	if (settings.threshold >= 0) {
+		particleSystem.getOutlierFilter().setThreshold(settings.threshold);
+		particleSystem.getOutlierFilter().setNumNeighbours(settings.numNeighbours);
+		particleSystem.setOutlierRemoval(true);
+	}
+}
+
+//--------------------------------------------------------------
+// Plays a depth recording back at the batch frame rate
+class BatchDepthInput {
+public:
+	BatchDepthInput() :
+		myFrame(-1), myTarget(0) {
+	}
+
+	bool setup(const string &path, const BatchDepthSettings &settings, ParticleSystem &particleSystem) {
+		if (!myPlayer.load(path) || myPlayer.getNumFrames() == 0) {
+			ofLogError("runBatch") << "could not load depth recording " << path;
+			return false;
+		}
+		DepthPreprocessor &preprocessor = particleSystem.getDepthPreprocessor();
+		preprocessor.setFilter(settings.filter);
+		preprocessor.setBackgroundMargin(settings.backgroundMargin);
+		if (settings.learnBackgroundFrames > 0) {
+			preprocessor.learnBackground(settings.learnBackgroundFrames);
+		}
+		particleSystem.setAdaptiveSampling(settings.adaptiveSampling);
+		if (settings.interpolationDelay >= 0) {
+			particleSystem.getDepthInterpolator().setDelay(settings.interpolationDelay);
+			particleSystem.setTemporalInterpolation(true);
+		}
+		return true;
+	}
+
+	// Enough frames to cover the whole recording
+	int getNumFrames(float timestep) const {
+		double duration = (myPlayer.getTimestamp(myPlayer.getNumFrames() - 1) - myPlayer.getTimestamp(0)) / 1e6;
+		return int(duration / timestep) + 1;
+	}
+
+	// Decodes the newest frame recorded before the clock's time, returns
+	// true if it's a different frame than last time
+	bool seek(const Clock &clock) {
+		myTarget = myPlayer.getTimestamp(0) + uint64_t(clock.getElapsedTimef() * 1e6);
+		int nextFrame = max(myFrame, 0);
+		while (nextFrame + 1 < myPlayer.getNumFrames() && myPlayer.getTimestamp(nextFrame + 1) <= myTarget) {
+			nextFrame++;
+		}
+		if (nextFrame == myFrame) {
+			return false;
+		}
+		myFrame = nextFrame;
+		myPlayer.getFrame(myFrame, myPixels);
+		return true;
+	}
+
+	// Each recorded frame is preprocessed once, like live frames
+	void setupParticles(ParticleSystem &particleSystem, bool newFrame, int gridSizeX, int gridSizeY, ofPrimitiveMode mode) {
+		DepthPreprocessor &preprocessor = particleSystem.getDepthPreprocessor();
+		if (newFrame) {
+			preprocessor.process(myPixels);
+		}
+		particleSystem.setDepthTime(myPlayer.getTimestamp(myFrame), myTarget);
+		particleSystem.setupUsingDepth(preprocessor.getProcessedDepth(), gridSizeX, gridSizeY, 640, 480, mode);
+	}
+
+private:
+	DepthPlayer myPlayer;
+	ofShortPixels myPixels;
+	int myFrame;
+	uint64_t myTarget;
+};
+
+//--------------------------------------------------------------
+// Tries the point budget on a camera orbiting the mesh, closing in and
+// backing off twice per orbit. Does nothing without an octree.
+class BatchOrbit {
+public:
+	BatchOrbit(const PointOctree &octree) :
+		myOctree(octree), myRadius(0), myTotalTime(0), myMaxTime(0), myTotalVisiblePoints(0) {
+		if (octree.isBuilt()) {
+			const PointOctree::Node &root = octree.getNodes()[0];
+			myCenter = root.center;
+			myRadius = root.halfSize;
+		}
+	}
+
+	void setView(ParticleSystem &particleSystem, int frame, int numFrames) {
+		if (myOctree.isBuilt()) {
+			float angle = TWO_PI * frame / numFrames;
+			float distance = myRadius * (1.6 + 1.3 * sinf(2 * angle));
+			vec3 eye = myCenter + vec3(sinf(angle), 0.3, cosf(angle)) * distance;
+			particleSystem.setView(makeOctreeView(eye, myCenter, 60, 1280, 720));
+		}
+	}
+
+	void addFrame(const ParticleSystem &particleSystem) {
+		if (myOctree.isBuilt()) {
+			myTotalTime += particleSystem.getCullingTime();
+			myMaxTime = max(myMaxTime, particleSystem.getCullingTime());
+			myTotalVisiblePoints += particleSystem.getNumVisiblePoints();
+		}
+	}
+
+	void log(int numFrames) const {
+		if (myOctree.isBuilt()) {
+			ofLogNotice("runBatch") << "octree selection " << myTotalTime / numFrames << "ms on average, at most "
+				<< myMaxTime << "ms, " << int(myTotalVisiblePoints / numFrames) << " of " << myOctree.getNumPoints()
+				<< " points per frame";
+		}
+	}
+
+private:
+	const PointOctree &myOctree;
+	vec3 myCenter;
+	float myRadius;
+	double myTotalTime;
+	float myMaxTime;
+	double myTotalVisiblePoints;
+};
+
+//--------------------------------------------------------------
+// Times outlier removal on new depth frames
+class BatchOutlierStats {
+public:
+	BatchOutlierStats() :
+		myNumFrames(0), myTotalTime(0), myMaxTime(0), myTotalOutliers(0) {
+	}
+
+	void addFrame(const OutlierFilter &filter) {
+		myNumFrames++;
+		myTotalTime += filter.getTime();
+		myMaxTime = max(myMaxTime, filter.getTime());
+		myTotalOutliers += filter.getNumOutliers();
+	}
+
+	void log() const {
+		if (myNumFrames > 0) {
+			ofLogNotice("runBatch") << "outlier removal " << myTotalTime / myNumFrames << "ms on average, at most "
+				<< myMaxTime << "ms, " << int(myTotalOutliers / myNumFrames) << " outliers per depth frame";
+		}
+	}
+
+private:
+	int myNumFrames;
+	double myTotalTime;
+	float myMaxTime;
+	double myTotalOutliers;
+};
+
+//--------------------------------------------------------------
+// Sends each frame to the checksum file, mesh sequence, shared memory
+// stream and PLY files that were asked for
+class BatchOutputs {
+public:
+	BatchOutputs(const BatchOutputSettings &settings) :
+		mySettings(settings) {
+	}
+
+	bool start(const ParticleSystem &particleSystem, int gridSizeX, int gridSizeY) {
+		if (!mySettings.checksumPath.empty()) {
+			myChecksumFile.open(ofToDataPath(mySettings.checksumPath));
+			if (!myChecksumFile.is_open()) {
+				ofLogError("runBatch") << "could not open " << mySettings.checksumPath;
+				return false;
+			}
+		}
+		if (!mySettings.publishName.empty()) {
+			// Room for the loaded mesh or a full point cloud grid
+			int gridVertices = gridSizeX * gridSizeY;
+			int maxVertices = max(int(particleSystem.getMesh().getNumVertices()), gridVertices);
+			int maxIndices = max(int(particleSystem.getMesh().getNumIndices()), 6 * gridVertices);
+			if (!myPublisher.start(mySettings.publishName, maxVertices, maxIndices)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool addFrame(int frame, const ofMesh &mesh, uint64_t checksum, const FixedStepClock &clock) {
+		if (myChecksumFile.is_open()) {
+			myChecksumFile << frame << " " << clock.getElapsedTimef() << " " << std::hex << checksum << std::dec << "\n";
+		}
+
+		uint64_t timestamp = uint64_t(double(frame) * clock.getTimestep() * 1e6);
+		if (!mySettings.sequencePath.empty()) {
+			if (frame == 0 && !myExporter.start(mySettings.sequencePath, mesh, true)) {
+				return false;
+			}
+			if (!myExporter.addFrame(mesh, timestamp, true)) {
+				ofLogError("runBatch") << "sequence export stopped at frame " << frame;
+				return false;
+			}
+		}
+
+		if (myPublisher.isPublishing()) {
+			myPublisher.publish(mesh, timestamp);
+		}
+
+		if (!mySettings.plyPrefix.empty()) {
+			char suffix[32];
+			snprintf(suffix, sizeof(suffix), "_%05d.ply", frame);
+			mesh.save(mySettings.plyPrefix + suffix);
+		}
+		return true;
+	}
+
+	// Returns false if the sequence couldn't be written in full
+	bool stop() {
+		myExporter.stop();
+		return !myExporter.hasFailed();
+	}
+
+private:
+	const BatchOutputSettings &mySettings;
+	ofstream myChecksumFile;
+	MeshSequenceExporter myExporter;
+	MeshStreamPublisher myPublisher;
+};
+
+//--------------------------------------------------------------
+int runBatch(const BatchSettings &settings) {
+	if (settings.numThreads > 0) {
+		setNumParallelThreads(settings.numThreads);
+	}
+
+	// Preparing a scan too large to load replaces the simulation
+	if (!settings.preprocess.outputPath.empty()) {
+		return runPreprocess(settings.inputPath, settings.preprocess);
+	}
+	FixedStepClock clock(1.0 / max(settings.fps, 1.0f));
+
+	// Effect parameters other than the noise ones keep their defaults
+	EffectSettings effects;
+	effects.effects = settings.effects;
+	effects.amplitude = settings.amplitude;
+	effects.frequency = settings.frequency;
+	effects.scale = settings.scale;
+
+	NoiseVolume noiseVolume;
+	NoiseVolume flowVolume;
+	if (settings.bakedNoise) {
+		setupEffectNoiseVolumes(noiseVolume, flowVolume);
+		effects.noiseVolume = &noiseVolume;
+		effects.flowVolume = &flowVolume;
+	}
+	ParticleSystem particleSystem;
+	particleSystem.setCompactStorage(settings.compactStorage);
+	particleSystem.setPointBudget(settings.octree.pointBudget);
+	particleSystem.setAnalyticNormals(settings.analyticNormals);
+	setupOutlierRemoval(settings.outliers, particleSystem);
+	particleSystem.getSpringSystem().setNumIterations(settings.springIterations);
+	particleSystem.setSimulation(settings.simulate);
+
+	// Load the input, either a mesh or a depth recording
+	bool useDepth = endsWith(settings.inputPath, ".bsdepth");
+	BatchDepthInput depthInput;
+	int numFrames = settings.numFrames;
+
+	if (useDepth) {
+		if (!depthInput.setup(settings.inputPath, settings.depth, particleSystem)) {
+			return 1;
+		}
+		if (numFrames < 0) {
+			numFrames = depthInput.getNumFrames(clock.getTimestep());
+		}
+	}
+	else {
+		ofMesh inputMesh;
+		vector<ofIndexType> edgeIndices;
+		if (settings.inputPath == "synthetic") {
+			makeSyntheticCloud(max(settings.numSyntheticPoints, 1), inputMesh);
+		}
+		else if (!loadPreparedMesh(settings.inputPath, 0.0001, settings.reorderMesh, inputMesh, edgeIndices, settings.useMeshCache)) {
+			return 1;
+		}
+		particleSystem.setupUsingMesh(inputMesh, edgeIndices, settings.displayMode);
+		if (numFrames < 0) {
+			numFrames = 600;
+		}
+	}
+
+	BatchOutputs outputs(settings.output);
+	if (!outputs.start(particleSystem, settings.gridSizeX, settings.gridSizeY)) {
+		return 1;
+	}
+
+	if (settings.checkAllocations && !isAllocationCountingEnabled()) {
+		ofLogWarning("runBatch") << "allocation counting is not compiled in, build with COUNT_ALLOCATIONS to check";
+	}
+
+	// The first frames may still grow buffers and the frame arena, and
+	// learning the background logs when it's done
+	const int allocationWarmupFrames = 3;
+	uint64_t steadyAllocations = 0;
+	int maxFrameAllocations = 0;
+
+	// Only adapts with --target-fps, the output then depends on the speed
+	// of the machine
+	QualityGovernor governor;
+	if (settings.targetFps > 0) {
+		governor.setTargetFrameRate(settings.targetFps);
+		governor.setEnabled(true);
+	}
+
+	BatchOrbit orbit(particleSystem.getOctree());
+
+	// Timed on new depth frames, adaptive samples aren't filtered
+	bool filterDepth = useDepth && particleSystem.isOutlierRemoval() && !settings.depth.adaptiveSampling;
+	BatchOutlierStats outlierStats;
+	double totalEffectsTime = 0;
+	double totalNormalsTime = 0;
+
+	uint64_t runChecksum = 14695981039346656037ULL;
+	uint64_t startMicros = ofGetElapsedTimeMicros();
+
+	for (int frame = 0; frame < numFrames; frame++) {
+		clock.setFrame(frame);
+		bool newDepthFrame = useDepth && depthInput.seek(clock);
+
+		// Only the simulation is counted, decoding and exporting are
+		// allowed to allocate
+		uint64_t allocationsBefore = getAllocationCount();
+		uint64_t frameStart = ofGetElapsedTimeMicros();
+		orbit.setView(particleSystem, frame, numFrames);
+		particleSystem.setUpdateStride(governor.getUpdateStride());
+		particleSystem.setNormalsInterval(governor.getNormalsInterval());
+		bool learningBackground = useDepth && particleSystem.getDepthPreprocessor().isLearningBackground();
+		if (useDepth) {
+			int gridSizeX = max(2, int(settings.gridSizeX * governor.getGridScale()));
+			int gridSizeY = max(2, int(settings.gridSizeY * governor.getGridScale()));
+			depthInput.setupParticles(particleSystem, newDepthFrame, gridSizeX, gridSizeY, settings.displayMode);
+			governor.addStageTime(QualityGovernor::STAGE_POINT_CLOUD, (ofGetElapsedTimeMicros() - frameStart) / 1000.0);
+			if (filterDepth && newDepthFrame) {
+				outlierStats.addFrame(particleSystem.getOutlierFilter());
+			}
+		}
+		particleSystem.update(effects, clock);
+		governor.addStageTime(QualityGovernor::STAGE_EFFECTS, particleSystem.getEffectsTime());
+		governor.addStageTime(QualityGovernor::STAGE_NORMALS, particleSystem.getNormalsTime());
+		totalEffectsTime += particleSystem.getEffectsTime();
+		totalNormalsTime += particleSystem.getNormalsTime();
+		float frameTime = (ofGetElapsedTimeMicros() - frameStart) / 1000.0;
+		orbit.addFrame(particleSystem);
+		const ofMesh &mesh = particleSystem.getMesh();
+
+		uint64_t checksum = calcMeshChecksum(mesh);
+		runChecksum = (runChecksum ^ checksum) * 1099511628211ULL;
+
+		int frameAllocations = int(getAllocationCount() - allocationsBefore);
+		if (frame >= allocationWarmupFrames && !learningBackground) {
+			steadyAllocations += frameAllocations;
+			maxFrameAllocations = max(maxFrameAllocations, frameAllocations);
+		}
+
+		// Logs its decisions, so only after the allocations are counted
+		governor.update(frameTime);
+		if (!outputs.addFrame(frame, mesh, checksum, clock)) {
+			return 1;
+		}
+
+		getFrameArena().reset();
+	}
+	if (!outputs.stop()) {
+		return 1;
+	}
+
+	double seconds = (ofGetElapsedTimeMicros() - startMicros) / 1e6;
+	ofLogNotice("runBatch") << numFrames << " frames in " << seconds << "s ("
+		<< (seconds > 0 ? numFrames / seconds : 0) << " fps) on " << getNumParallelThreads() << " threads";
+	ofLogNotice("runBatch") << "run checksum " << std::hex << runChecksum << std::dec;
+	ofLogNotice("runBatch") << "effects " << totalEffectsTime / numFrames << "ms, normals "
+		<< totalNormalsTime / numFrames << "ms per frame on average";
+	orbit.log(numFrames);
+	outlierStats.log();
+	if (governor.isEnabled()) {
+		ofLogNotice("runBatch") << "final quality " << governor.getSettingsDescription() << " (" << governor.getTimingDescription() << ")";
+	}
+
+	if (isAllocationCountingEnabled()) {
+		ofLogNotice("runBatch") << steadyAllocations << " heap allocations after warm-up, at most "
+			<< maxFrameAllocations << " in one frame";
+		if (settings.checkAllocations && steadyAllocations > 0) {
+			ofLogError("runBatch") << "the simulation loop allocates from the heap";
+			return 1;
+		}
+	}
+	return 0;
+}
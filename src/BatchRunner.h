@@ -0,0 +1,162 @@
+#pragma once
+
+#include "ofMain.h"
+#include "DepthPreprocessor.h"
+#include "effects.h"
+
+// Headless, deterministic processing. The particle system is stepped
+// with a fixed timestep as fast as the machine allows, and each frame
+// can be exported and/or checksummed so runs can be compared exactly.
+//
+// Usage:
+//   bodyScanner --batch <input.ply | input.bsdepth | synthetic> [options]
+//     --frames N            number of frames (default 600, or the
+//                           length of a depth recording)
+//     --fps F               fixed timestep is 1/F seconds (default 60)
+//     --amplitude A         displacement parameters, defaults match
+//     --frequency F         the GUI
+//     --scale S
+//     --effects noise,ripple,twist,flow,shape
+//                           effects to stack (default noise)
+//     --grid X Y            point cloud grid size (default 200 200)
+//     --mode points|lines|triangles
+//     --points N            size of the synthetic point cloud, a few
+//                           noisy body scans (default 5000000)
+//     --point-budget N      in points mode, only move the points an
+//                           octree selects for a camera orbiting the
+//                           mesh, at most N, and report the selection
+//                           times
+//     --threads N           worker threads (default one per core)
+//     --target-fps F        let the quality governor lower the quality
+//                           to keep each frame under 3/4 of 1/F
+//     --compact             use compact 16 bit particle storage
+//     --no-reorder          keep the mesh's triangle and vertex order
+//     --simulate            run the spring-mass simulation on the mesh
+//                           instead of the effects
+//     --iterations N        spring solver iterations per frame (default 8)
+//     --no-cache            prepare the mesh without reading or writing
+//                           its .bsmcache file
+//     --filter none|median|bilateral
+//                           depth filter for recordings (default none)
+//     --learn-background N  learn the background from the first N
+//                           depth frames and remove it from the rest
+//     --margin MM           background margin in mm (default 50)
+//     --adaptive            sample the foreground of depth recordings
+//                           instead of the whole frame
+//     --interpolate MS      move the grid between depth frames, MS is
+//                           the delay (0 extrapolates, about 33 blends
+//                           between the last two frames)
+//     --outliers SIGMA      remove points whose mean distance to their
+//                           neighbours is more than SIGMA deviations
+//                           above the mean, from meshes as they're
+//                           loaded and from every depth frame
+//     --neighbours K        neighbours per point for --outliers
+//                           (default 8)
+//     --baked-noise         look the effect noise up in baked volumes
+//                           (noise.bsnoise and flow.bsnoise in data)
+//     --analytic-normals    work the triangle normals out from the
+//                           effects' derivatives, needs --baked-noise
+//                           with noise or flow
+//     --preprocess out.ply  instead of running, weld the input PLY,
+//                           work out its normals and write it to
+//                           out.ply, out of core, see
+//                           StreamingMeshProcessor
+//     --weld T              weld threshold (default 0.0001)
+//     --decimate S          also decimate to cells of size S
+//     --memory MB           memory budget (default 4096)
+//     --ascii               write ASCII instead of binary PLY
+//     --sequence out.bsmesh export the animation as a mesh sequence
+//     --ply prefix          save every frame as prefix_00000.ply, ...
+//     --publish NAME        publish every frame to the shared memory
+//                           stream NAME (e.g. /bodyScanner-mesh)
+//     --checksums out.txt   write a checksum per frame
+//     --check-allocations   fail if the simulation allocates from the
+//                           heap once warmed up (needs a debug build
+//                           or COUNT_ALLOCATIONS)
+
+// Options for depth recording input
+struct BatchDepthSettings {
+	BatchDepthSettings();
+
+	DepthFilter filter;
+	int learnBackgroundFrames;
+	float backgroundMargin;
+	bool adaptiveSampling;
+	float interpolationDelay;
+};
+
+// Options for statistical outlier removal, off if threshold < 0
+struct BatchOutlierSettings {
+	BatchOutlierSettings();
+
+	float threshold;
+	int numNeighbours;
+};
+
+// Options for the octree point budget, off if pointBudget is 0
+struct BatchOctreeSettings {
+	BatchOctreeSettings();
+
+	int pointBudget;
+};
+
+// Options for preparing a scan out of core instead of running, off if
+// outputPath is empty
+struct BatchPreprocessSettings {
+	BatchPreprocessSettings();
+
+	string outputPath;
+	float weldThreshold;
+	float cellSize;
+	float memoryBudget;
+	bool asciiOutput;
+};
+
+// Where each frame goes, every output is off if its path is empty
+struct BatchOutputSettings {
+	string sequencePath;
+	string plyPrefix;
+	string publishName;
+	string checksumPath;
+};
+
+struct BatchSettings {
+	BatchSettings();
+
+	string inputPath;
+	int numFrames;
+	float fps;
+	float amplitude;
+	float frequency;
+	float scale;
+	unsigned effects;
+	int gridSizeX;
+	int gridSizeY;
+	ofPrimitiveMode displayMode;
+	int numSyntheticPoints;
+	int numThreads;
+	bool compactStorage;
+	bool reorderMesh;
+	bool simulate;
+	int springIterations;
+	bool useMeshCache;
+	float targetFps;
+	bool bakedNoise;
+	bool analyticNormals;
+	bool checkAllocations;
+
+	BatchDepthSettings depth;
+	BatchOutlierSettings outliers;
+	BatchOctreeSettings octree;
+	BatchPreprocessSettings preprocess;
+	BatchOutputSettings output;
+};
+
+// Returns true if the arguments ask for batch mode, filling settings
+bool parseBatchArguments(int argc, char *argv[], BatchSettings &settings);
+
+// Runs the batch job, returns the process exit code
+int runBatch(const BatchSettings &settings);
+
+// 64 bit FNV-1a hash of the mesh vertex and normal data
+uint64_t calcMeshChecksum(const ofMesh &mesh);
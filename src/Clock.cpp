@@ -0,0 +1,36 @@
+#include "Clock.h"
+
+//--------------------------------------------------------------
+float WallClock::getElapsedTimef() const {
+	return ofGetElapsedTimef();
+}
+
+//--------------------------------------------------------------
+FixedStepClock::FixedStepClock(float timestep, float startTime) :
+	myTimestep(timestep), myStartTime(startTime), myFrame(0) {
+}
+
+//--------------------------------------------------------------
+void FixedStepClock::step() {
+	myFrame++;
+}
+
+//--------------------------------------------------------------
+void FixedStepClock::setFrame(uint64_t frame) {
+	myFrame = frame;
+}
+
+//--------------------------------------------------------------
+uint64_t FixedStepClock::getFrame() const {
+	return myFrame;
+}
+
+//--------------------------------------------------------------
+float FixedStepClock::getTimestep() const {
+	return myTimestep;
+}
+
+//--------------------------------------------------------------
+float FixedStepClock::getElapsedTimef() const {
+	return float(myStartTime + double(myFrame) * myTimestep);
+}
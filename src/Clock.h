@@ -0,0 +1,38 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Time source for the animation. The app uses the wall clock, batch
+// runs use a fixed timestep so results don't depend on how fast frames
+// are produced.
+class Clock {
+public:
+	virtual ~Clock() {}
+	virtual float getElapsedTimef() const = 0;
+};
+
+//--------------------------------------------------------------
+class WallClock : public Clock {
+public:
+	float getElapsedTimef() const;
+};
+
+//--------------------------------------------------------------
+class FixedStepClock : public Clock {
+public:
+	FixedStepClock(float timestep = 1.0 / 60.0, float startTime = 0.0);
+
+	void step();
+	void setFrame(uint64_t frame);
+	uint64_t getFrame() const;
+	float getTimestep() const;
+
+	// Computed from the frame number rather than accumulated, so the
+	// time of a given frame is always exactly the same
+	float getElapsedTimef() const;
+
+private:
+	float myTimestep;
+	float myStartTime;
+	uint64_t myFrame;
+};
@@ -0,0 +1,155 @@
+#include "DepthInterpolator.h"
+#include "parallel.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DEPTH_INTERPOLATOR_SSE2 1
+#endif
+
+//--------------------------------------------------------------
+DepthInterpolator::DepthInterpolator() :
+	myPreviousTimestamp(0), myLatestTimestamp(0), myNumFrames(0),
+	myDelay(0), myMaxJump(60), myMaxExtrapolation(1.0), myMaxGap(200) {
+}
+
+//--------------------------------------------------------------
+void DepthInterpolator::setDelay(float delay) {
+	myDelay = max(delay, 0.0f);
+}
+
+//--------------------------------------------------------------
+float DepthInterpolator::getDelay() const {
+	return myDelay;
+}
+
+//--------------------------------------------------------------
+void DepthInterpolator::setMaxJump(float maxJump) {
+	myMaxJump = max(maxJump, 0.0f);
+}
+
+//--------------------------------------------------------------
+void DepthInterpolator::setMaxExtrapolation(float maxExtrapolation) {
+	myMaxExtrapolation = max(maxExtrapolation, 0.0f);
+}
+
+//--------------------------------------------------------------
+void DepthInterpolator::reset() {
+	myNumFrames = 0;
+}
+
+//--------------------------------------------------------------
+void DepthInterpolator::addFrame(const vec3 *positions, int numVertices, uint64_t timestamp) {
+	// A different grid can't be blended with the last one
+	if (int(myLatest.size()) != numVertices) {
+		myNumFrames = 0;
+	}
+	if (myNumFrames > 0 && timestamp <= myLatestTimestamp) {
+		myNumFrames = 0;
+	}
+
+	// The arrays are swapped, not reallocated
+	myPrevious.swap(myLatest);
+	myPreviousTimestamp = myLatestTimestamp;
+	myLatest.assign(positions, positions + numVertices);
+	myLatestTimestamp = timestamp;
+	myNumFrames = min(myNumFrames + 1, 2);
+}
+
+//--------------------------------------------------------------
+bool DepthInterpolator::isLatestFrame(uint64_t timestamp, int numVertices) const {
+	return myNumFrames > 0 && timestamp == myLatestTimestamp && int(myLatest.size()) == numVertices;
+}
+
+//--------------------------------------------------------------
+int DepthInterpolator::getNumFrames() const {
+	return myNumFrames;
+}
+
+//--------------------------------------------------------------
+float DepthInterpolator::getAlpha(uint64_t time) const {
+	if (myNumFrames < 2) {
+		return 0;
+	}
+	double interval = double(myLatestTimestamp - myPreviousTimestamp) / 1000.0;
+	if (interval <= 0 || interval > myMaxGap) {
+		return 0;
+	}
+	double elapsed = (double(time) - double(myLatestTimestamp)) / 1000.0 - myDelay;
+	return ofClamp(elapsed / interval, -1.0, myMaxExtrapolation);
+}
+
+//--------------------------------------------------------------
+static inline void extrapolatePosition(const vec3 &previous, const vec3 &latest, float alpha, float maxJump, vec3 &output) {
+	vec3 delta = latest - previous;
+	float weight = fabsf(delta.z) <= maxJump ? alpha : 0.0f;
+	output = latest + delta * weight;
+}
+
+#ifdef DEPTH_INTERPOLATOR_SSE2
+//--------------------------------------------------------------
+// Four vertices, twelve floats in three registers:
+//   x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+static inline void extrapolatePositionsSse2(const float *previous, const float *latest, __m128 alpha, __m128 maxJump, float *output) {
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 latest0 = _mm_loadu_ps(latest);
+	__m128 latest1 = _mm_loadu_ps(latest + 4);
+	__m128 latest2 = _mm_loadu_ps(latest + 8);
+	__m128 delta0 = _mm_sub_ps(latest0, _mm_loadu_ps(previous));
+	__m128 delta1 = _mm_sub_ps(latest1, _mm_loadu_ps(previous + 4));
+	__m128 delta2 = _mm_sub_ps(latest2, _mm_loadu_ps(previous + 8));
+
+	// Gather the z deltas, z0 z1 z2 z3, and pick each vertex's weight
+	__m128 z01 = _mm_shuffle_ps(delta0, delta1, _MM_SHUFFLE(1, 1, 2, 2));
+	__m128 z = _mm_shuffle_ps(z01, delta2, _MM_SHUFFLE(3, 0, 2, 0));
+	__m128 moving = _mm_cmple_ps(_mm_and_ps(z, absMask), maxJump);
+	__m128 weight = _mm_and_ps(moving, alpha);
+
+	// Spread the weights back over the components
+	__m128 weight0 = _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(1, 0, 0, 0));
+	__m128 weight1 = _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(2, 2, 1, 1));
+	__m128 weight2 = _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(3, 3, 3, 2));
+
+	_mm_storeu_ps(output, _mm_add_ps(latest0, _mm_mul_ps(delta0, weight0)));
+	_mm_storeu_ps(output + 4, _mm_add_ps(latest1, _mm_mul_ps(delta1, weight1)));
+	_mm_storeu_ps(output + 8, _mm_add_ps(latest2, _mm_mul_ps(delta2, weight2)));
+}
+#endif
+
+//--------------------------------------------------------------
+void extrapolatePositions(const vec3 *previous, const vec3 *latest, int numVertices, float alpha, float maxJump, vec3 *output, bool useSimd) {
+	int i = 0;
+
+#ifdef DEPTH_INTERPOLATOR_SSE2
+	if (useSimd) {
+		__m128 alpha4 = _mm_set1_ps(alpha);
+		__m128 maxJump4 = _mm_set1_ps(maxJump);
+		for (; i + 4 <= numVertices; i += 4) {
+			extrapolatePositionsSse2(&previous[i].x, &latest[i].x, alpha4, maxJump4, &output[i].x);
+		}
+	}
+#endif
+
+	for (; i < numVertices; i++) {
+		extrapolatePosition(previous[i], latest[i], alpha, maxJump, output[i]);
+	}
+}
+
+//--------------------------------------------------------------
+void DepthInterpolator::interpolate(uint64_t time, vec3 *positions) const {
+	int numVertices = myLatest.size();
+	if (myNumFrames == 0) {
+		return;
+	}
+	float alpha = getAlpha(time);
+	if (alpha == 0) {
+		std::copy(myLatest.begin(), myLatest.end(), positions);
+		return;
+	}
+
+	const vec3 *previous = myPrevious.data();
+	const vec3 *latest = myLatest.data();
+	float maxJump = myMaxJump;
+	parallelFor(0, numVertices, [=](int begin, int end) {
+		extrapolatePositions(previous + begin, latest + begin, end - begin, alpha, maxJump, positions + begin);
+	}, 4096);
+}
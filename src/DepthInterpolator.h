@@ -0,0 +1,74 @@
+#pragma once
+
+#include "ofMain.h"
+
+using namespace glm;
+
+// Fills in the render frames between depth frames.
+//
+// The Kinect delivers about 30 depth frames a second while the app
+// renders at 60, so without this the point cloud only moves every other
+// frame. Each depth frame's vertex positions are added with the time it
+// arrived, and every render frame gets positions for its own time,
+// moved along the line through the last two frames:
+//   alpha = (time - delay - latest) / (latest - previous)
+//   position = latest + (latest - previous) * alpha
+// With no delay that extrapolates up to maxExtrapolation frame
+// intervals past the latest frame, which keeps the latency of the raw
+// frames; a delay of one frame interval interpolates between the two
+// frames instead, smoother but a frame behind.
+//
+// Vertices whose depth changed by more than maxJump between the two
+// frames are left at their latest position: a jump that size is a depth
+// edge or dropout passing over the vertex, not motion to continue.
+// Positions of vertices without depth are at z = -1, so they count as
+// jumps too. The history starts over if the vertex count changes, and
+// frames more than maxGap apart aren't blended.
+//
+// The positions are blended with SSE2 where available, four vertices at
+// a time, and a scalar version for other CPUs and the last vertices.
+class DepthInterpolator {
+public:
+	DepthInterpolator();
+
+	// Milliseconds the output lags behind the render time
+	void setDelay(float delay);
+	float getDelay() const;
+
+	// Largest depth change, in mm, that still counts as motion
+	void setMaxJump(float maxJump);
+
+	// How far past the latest frame to extrapolate, in frame intervals
+	void setMaxExtrapolation(float maxExtrapolation);
+
+	void reset();
+
+	// Positions of a new depth frame, timestamp in microseconds
+	void addFrame(const vec3 *positions, int numVertices, uint64_t timestamp);
+
+	// True if the frame with this timestamp is the latest one added
+	bool isLatestFrame(uint64_t timestamp, int numVertices) const;
+	int getNumFrames() const;
+
+	// Writes the positions at the given time, in microseconds
+	void interpolate(uint64_t time, vec3 *positions) const;
+
+	// The blend factor for a time, 0 is the latest frame
+	float getAlpha(uint64_t time) const;
+
+private:
+	vector<vec3> myPrevious;
+	vector<vec3> myLatest;
+	uint64_t myPreviousTimestamp;
+	uint64_t myLatestTimestamp;
+	int myNumFrames;
+
+	float myDelay;
+	float myMaxJump;
+	float myMaxExtrapolation;
+	float myMaxGap;
+};
+
+// Blends one range of vertices, exposed to compare the SIMD and scalar
+// kernels
+void extrapolatePositions(const vec3 *previous, const vec3 *latest, int numVertices, float alpha, float maxJump, vec3 *output, bool useSimd = true);
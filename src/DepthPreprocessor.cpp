@@ -0,0 +1,225 @@
+#include "DepthPreprocessor.h"
+#include "FrameArena.h"
+#include "parallel.h"
+
+// Both filters look 2 pixels in each direction
+const int filterRadius = 2;
+const int medianSize = 2 * filterRadius + 1;
+const int bilateralSize = 2 * filterRadius + 1;
+
+// Depth differences well above this, in mm, aren't smoothed across
+const double bilateralSigmaDepth = 20.0;
+const double bilateralSigmaSpace = 2.0;
+
+//--------------------------------------------------------------
+DepthPreprocessor::DepthPreprocessor() :
+	myFilter(DEPTH_FILTER_NONE), myBackgroundMargin(50), myHasBackground(false), myLearnFramesLeft(0),
+	myTileHeight(32), myNumTiles(0), myNumForeground(0) {
+}
+
+//--------------------------------------------------------------
+void DepthPreprocessor::learnBackground(int numFrames) {
+	// Forget the old background so it doesn't mask the frames being learned
+	clearBackground();
+	myLearnFramesLeft = ofClamp(numFrames, 1, 65535);
+	std::fill(myBackgroundSum.begin(), myBackgroundSum.end(), 0);
+	std::fill(myBackgroundCount.begin(), myBackgroundCount.end(), 0);
+}
+
+//--------------------------------------------------------------
+void DepthPreprocessor::clearBackground() {
+	myHasBackground = false;
+	myLearnFramesLeft = 0;
+}
+
+//--------------------------------------------------------------
+bool DepthPreprocessor::isLearningBackground() const {
+	return myLearnFramesLeft > 0;
+}
+
+//--------------------------------------------------------------
+bool DepthPreprocessor::hasBackground() const {
+	return myHasBackground;
+}
+
+//--------------------------------------------------------------
+void DepthPreprocessor::setFilter(DepthFilter filter) {
+	myFilter = filter;
+}
+
+//--------------------------------------------------------------
+DepthFilter DepthPreprocessor::getFilter() const {
+	return myFilter;
+}
+
+//--------------------------------------------------------------
+void DepthPreprocessor::setBackgroundMargin(float margin) {
+	myBackgroundMargin = max(margin, 0.0f);
+}
+
+//--------------------------------------------------------------
+float DepthPreprocessor::getBackgroundMargin() const {
+	return myBackgroundMargin;
+}
+
+//--------------------------------------------------------------
+const ofShortPixels &DepthPreprocessor::getProcessedDepth() const {
+	return myOutput;
+}
+
+//--------------------------------------------------------------
+const ofPixels &DepthPreprocessor::getForegroundMask() const {
+	return myMask;
+}
+
+//--------------------------------------------------------------
+int DepthPreprocessor::getNumForegroundPixels() const {
+	return myNumForeground;
+}
+
+//--------------------------------------------------------------
+void DepthPreprocessor::allocate(int width, int height) {
+	if (myOutput.isAllocated() && int(myOutput.getWidth()) == width && int(myOutput.getHeight()) == height) {
+		return;
+	}
+
+	// A background learned at another resolution is no use
+	if (myHasBackground) {
+		ofLogWarning("DepthPreprocessor::allocate") << "depth size changed to " << width << "x" << height << ", background cleared";
+	}
+	myHasBackground = false;
+
+	myOutput.allocate(width, height, 1);
+	myMask.allocate(width, height, 1);
+	myBackground.allocate(width, height, 1);
+	myBackgroundSum.assign(width * height, 0);
+	myBackgroundCount.assign(width * height, 0);
+
+	myNumTiles = (height + myTileHeight - 1) / myTileHeight;
+	myTileForeground.assign(myNumTiles, 0);
+}
+
+//--------------------------------------------------------------
+const ofShortPixels &DepthPreprocessor::process(const ofShortPixels &depth) {
+	if (!depth.isAllocated() || depth.getNumChannels() != 1) {
+		return depth;
+	}
+	int width = depth.getWidth();
+	allocate(width, depth.getHeight());
+
+	// Scratch space for each tile's filtered rows, including the halo.
+	// The bilateral filter works on floats and needs two buffers.
+	size_t scratchSize = 0;
+	if (myFilter == DEPTH_FILTER_MEDIAN) {
+		scratchSize = (myTileHeight + 2 * filterRadius) * width * sizeof(uint16_t);
+	}
+	else if (myFilter == DEPTH_FILTER_BILATERAL) {
+		scratchSize = 2 * (myTileHeight + 2 * filterRadius) * width * sizeof(float);
+	}
+	uint8_t *scratch = getFrameArena().allocate<uint8_t>(myNumTiles * scratchSize);
+
+	parallelFor(0, myNumTiles, [&](int begin, int end) {
+		for (int tile = begin; tile < end; tile++) {
+			processTile(depth, tile, scratch + tile * scratchSize);
+		}
+	}, 1);
+
+	myNumForeground = 0;
+	for (int tile = 0; tile < myNumTiles; tile++) {
+		myNumForeground += myTileForeground[tile];
+	}
+
+	if (myLearnFramesLeft > 0 && --myLearnFramesLeft == 0) {
+		finishLearning();
+	}
+	return myOutput;
+}
+
+//--------------------------------------------------------------
+void DepthPreprocessor::processTile(const ofShortPixels &depth, int tile, uint8_t *scratch) {
+	int width = depth.getWidth();
+	int height = depth.getHeight();
+	int rowBegin = tile * myTileHeight;
+	int rowEnd = min(rowBegin + myTileHeight, height);
+
+	const uint16_t *input = depth.getData();
+	uint16_t *output = myOutput.getData();
+
+	// Filter the tile together with a few rows above and below, then
+	// keep just the tile's own rows
+	int haloBegin = max(rowBegin - filterRadius, 0);
+	int haloEnd = min(rowEnd + filterRadius, height);
+	int haloRows = haloEnd - haloBegin;
+	int skipRows = rowBegin - haloBegin;
+	cv::Mat source(haloRows, width, CV_16UC1, (void *)(input + haloBegin * width));
+
+	if (myFilter == DEPTH_FILTER_MEDIAN) {
+		cv::Mat filtered(haloRows, width, CV_16UC1, scratch);
+		cv::medianBlur(source, filtered, medianSize);
+		const uint16_t *filteredData = (const uint16_t *)scratch + skipRows * width;
+		std::copy(filteredData, filteredData + (rowEnd - rowBegin) * width, output + rowBegin * width);
+	}
+	else if (myFilter == DEPTH_FILTER_BILATERAL) {
+		float *sourceData = (float *)scratch;
+		float *filteredData = sourceData + haloRows * width;
+		cv::Mat sourceFloat(haloRows, width, CV_32FC1, sourceData);
+		cv::Mat filteredFloat(haloRows, width, CV_32FC1, filteredData);
+		source.convertTo(sourceFloat, CV_32F);
+		cv::bilateralFilter(sourceFloat, filteredFloat, bilateralSize, bilateralSigmaDepth, bilateralSigmaSpace);
+
+		// Pixels without depth stay without depth
+		filteredData += skipRows * width;
+		for (int i = rowBegin * width; i < rowEnd * width; i++) {
+			output[i] = input[i] > 0 ? uint16_t(*filteredData + 0.5f) : 0;
+			filteredData++;
+		}
+	}
+	else {
+		std::copy(input + rowBegin * width, input + rowEnd * width, output + rowBegin * width);
+	}
+
+	// Learn the background, or compare against it
+	bool learning = myLearnFramesLeft > 0;
+	const uint16_t *background = myBackground.getData();
+	uint8_t *mask = myMask.getData();
+	int numForeground = 0;
+
+	for (int i = rowBegin * width; i < rowEnd * width; i++) {
+		uint16_t d = output[i];
+		bool foreground = d > 0;
+		if (learning) {
+			if (foreground) {
+				myBackgroundSum[i] += d;
+				myBackgroundCount[i]++;
+			}
+		}
+		else if (foreground && myHasBackground) {
+			foreground = background[i] == 0 || d + myBackgroundMargin < background[i];
+		}
+
+		if (!foreground) {
+			output[i] = 0;
+		}
+		mask[i] = foreground ? 255 : 0;
+		numForeground += foreground;
+	}
+	myTileForeground[tile] = numForeground;
+}
+
+//--------------------------------------------------------------
+void DepthPreprocessor::finishLearning() {
+	uint16_t *background = myBackground.getData();
+	int numPixels = myBackgroundSum.size();
+	int numKnown = 0;
+	for (int i = 0; i < numPixels; i++) {
+		if (myBackgroundCount[i] > 0) {
+			background[i] = myBackgroundSum[i] / myBackgroundCount[i];
+			numKnown++;
+		}
+		else {
+			background[i] = 0;
+		}
+	}
+	myHasBackground = true;
+	ofLogNotice("DepthPreprocessor") << "background learned, " << numKnown << " of " << numPixels << " pixels have depth";
+}
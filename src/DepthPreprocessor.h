@@ -0,0 +1,76 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxOpenCv.h"
+
+// Cleans up raw Kinect depth before it's turned into a mesh.
+//
+// A background model is learned from a few frames of the empty scene,
+// the per-pixel mean depth. Afterwards anything at least the margin in
+// front of the background is foreground, everything else is set to 0,
+// which the mesh building already treats as no data. Pixels that never
+// had a valid depth while learning count as foreground when they do.
+//
+// The depth can also be filtered with OpenCV, a 5x5 median or a
+// bilateral filter, both smooth the sensor noise while keeping the
+// depth edges at the silhouette.
+//
+// The image is processed in row tiles with parallelFor. Each tile is
+// filtered with a halo of extra rows so the result is the same as
+// filtering the whole image at once.
+
+enum DepthFilter {
+	DEPTH_FILTER_NONE,
+	DEPTH_FILTER_MEDIAN,
+	DEPTH_FILTER_BILATERAL
+};
+
+class DepthPreprocessor {
+public:
+	DepthPreprocessor();
+
+	// Learns the background from the next numFrames frames
+	void learnBackground(int numFrames = 30);
+	void clearBackground();
+	bool isLearningBackground() const;
+	bool hasBackground() const;
+
+	void setFilter(DepthFilter filter);
+	DepthFilter getFilter() const;
+
+	// How far in front of the background, in mm, a pixel has to be to
+	// count as foreground
+	void setBackgroundMargin(float margin);
+	float getBackgroundMargin() const;
+
+	// Returns the cleaned up depth, valid until the next call
+	const ofShortPixels &process(const ofShortPixels &depth);
+	const ofShortPixels &getProcessedDepth() const;
+
+	// 255 for foreground pixels, from the last call to process()
+	const ofPixels &getForegroundMask() const;
+	int getNumForegroundPixels() const;
+
+private:
+	void allocate(int width, int height);
+	void processTile(const ofShortPixels &depth, int tile, uint8_t *scratch);
+	void finishLearning();
+
+	DepthFilter myFilter;
+	float myBackgroundMargin;
+
+	ofShortPixels myOutput;
+	ofPixels myMask;
+	ofShortPixels myBackground;
+	bool myHasBackground;
+
+	// Sums and counts of valid depth while learning
+	vector<uint32_t> myBackgroundSum;
+	vector<uint16_t> myBackgroundCount;
+	int myLearnFramesLeft;
+
+	int myTileHeight;
+	int myNumTiles;
+	vector<int> myTileForeground;
+	int myNumForeground;
+};
@@ -0,0 +1,189 @@
+#include "DepthPyramid.h"
+#include "parallel.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DEPTH_PYRAMID_SSE2 1
+#endif
+
+//--------------------------------------------------------------
+DepthPyramid::DepthPyramid() :
+	mySource(nullptr), myNumLevels(0), myMaxDepthStep(50) {
+}
+
+//--------------------------------------------------------------
+void DepthPyramid::setMaxDepthStep(float maxDepthStep) {
+	myMaxDepthStep = ofClamp(maxDepthStep, 0, 65535);
+}
+
+//--------------------------------------------------------------
+void DepthPyramid::build(const ofShortPixels &depth, int maxLevels) {
+	mySource = &depth;
+	myNumLevels = 0;
+	if (!depth.isAllocated() || depth.getNumChannels() != 1) {
+		return;
+	}
+	myNumLevels = 1;
+
+	// Levels are only reallocated when the depth size changes
+	if (int(myLevels.size()) < maxLevels - 1) {
+		myLevels.resize(maxLevels - 1);
+	}
+
+	const ofShortPixels *previous = &depth;
+	for (int level = 1; level < maxLevels; level++) {
+		int srcWidth = previous->getWidth();
+		int width = srcWidth / 2;
+		int height = previous->getHeight() / 2;
+		if (width < 1 || height < 1) {
+			break;
+		}
+
+		ofShortPixels &pixels = myLevels[level - 1];
+		if (int(pixels.getWidth()) != width || int(pixels.getHeight()) != height) {
+			pixels.allocate(width, height, 1);
+		}
+
+		const uint16_t *src = previous->getData();
+		uint16_t *dst = pixels.getData();
+		parallelFor(0, height, [&](int begin, int end) {
+			downsampleDepth(src + 2 * begin * srcWidth, srcWidth, dst + begin * width, width, end - begin, myMaxDepthStep);
+		}, 16);
+
+		previous = &pixels;
+		myNumLevels++;
+	}
+}
+
+//--------------------------------------------------------------
+int DepthPyramid::getNumLevels() const {
+	return myNumLevels;
+}
+
+//--------------------------------------------------------------
+const ofShortPixels &DepthPyramid::getLevel(int level) const {
+	if (level <= 0) {
+		return *mySource;
+	}
+	return myLevels[min(level, myNumLevels - 1) - 1];
+}
+
+//--------------------------------------------------------------
+int DepthPyramid::getLevelForSpacing(float spacing) const {
+	int level = 0;
+	while (level + 1 < myNumLevels && float(2 << level) <= spacing) {
+		level++;
+	}
+	return level;
+}
+
+//--------------------------------------------------------------
+uint16_t DepthPyramid::getDepth(int level, float x, float y) const {
+	const ofShortPixels &pixels = getLevel(level);
+	int levelX = ofClamp(int(x) >> level, 0, pixels.getWidth() - 1);
+	int levelY = ofClamp(int(y) >> level, 0, pixels.getHeight() - 1);
+	return pixels.getData()[levelY * pixels.getWidth() + levelX];
+}
+
+//--------------------------------------------------------------
+static inline uint16_t combineDepth(uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t maxDepthStep) {
+	// Nearest valid depth, 0xFFFF if there is none
+	uint32_t nearest = 0xFFFF;
+	if (a > 0) nearest = min(nearest, a);
+	if (b > 0) nearest = min(nearest, b);
+	if (c > 0) nearest = min(nearest, c);
+	if (d > 0) nearest = min(nearest, d);
+	uint32_t limit = nearest + maxDepthStep;
+
+	uint32_t sum = 0;
+	uint32_t count = 0;
+	if (a > 0 && a <= limit) { sum += a; count++; }
+	if (b > 0 && b <= limit) { sum += b; count++; }
+	if (c > 0 && c <= limit) { sum += c; count++; }
+	if (d > 0 && d <= limit) { sum += d; count++; }
+
+	// Rounded mean, written so the SIMD version gives the same result
+	return count > 0 ? (2 * sum + count) / (2 * count) : 0;
+}
+
+#ifdef DEPTH_PYRAMID_SSE2
+//--------------------------------------------------------------
+// Unsigned 16 bit minimum, SSE2 only has the signed one
+static inline __m128i minU16(__m128i a, __m128i b) {
+	return _mm_sub_epi16(a, _mm_subs_epu16(a, b));
+}
+
+//--------------------------------------------------------------
+// Four output pixels from 8 pixels on each of two rows. The 2x2 blocks
+// are split into 32 bit lanes, one lane per output pixel.
+static inline void combineDepthSse2(const uint16_t *row0, const uint16_t *row1, uint16_t *dst, __m128i maxDepthStep) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i lowMask = _mm_set1_epi32(0xFFFF);
+
+	__m128i top = _mm_loadu_si128((const __m128i *)row0);
+	__m128i bottom = _mm_loadu_si128((const __m128i *)row1);
+	__m128i a = _mm_and_si128(top, lowMask);
+	__m128i b = _mm_srli_epi32(top, 16);
+	__m128i c = _mm_and_si128(bottom, lowMask);
+	__m128i d = _mm_srli_epi32(bottom, 16);
+
+	__m128i invalidA = _mm_cmpeq_epi32(a, zero);
+	__m128i invalidB = _mm_cmpeq_epi32(b, zero);
+	__m128i invalidC = _mm_cmpeq_epi32(c, zero);
+	__m128i invalidD = _mm_cmpeq_epi32(d, zero);
+
+	// Nearest valid depth, with missing depth counted as 0xFFFF
+	__m128i nearest = minU16(
+		minU16(_mm_or_si128(a, _mm_and_si128(invalidA, lowMask)), _mm_or_si128(b, _mm_and_si128(invalidB, lowMask))),
+		minU16(_mm_or_si128(c, _mm_and_si128(invalidC, lowMask)), _mm_or_si128(d, _mm_and_si128(invalidD, lowMask))));
+	__m128i limit = _mm_add_epi32(nearest, maxDepthStep);
+
+	__m128i rejectA = _mm_or_si128(invalidA, _mm_cmpgt_epi32(a, limit));
+	__m128i rejectB = _mm_or_si128(invalidB, _mm_cmpgt_epi32(b, limit));
+	__m128i rejectC = _mm_or_si128(invalidC, _mm_cmpgt_epi32(c, limit));
+	__m128i rejectD = _mm_or_si128(invalidD, _mm_cmpgt_epi32(d, limit));
+
+	__m128i sum = _mm_add_epi32(
+		_mm_add_epi32(_mm_andnot_si128(rejectA, a), _mm_andnot_si128(rejectB, b)),
+		_mm_add_epi32(_mm_andnot_si128(rejectC, c), _mm_andnot_si128(rejectD, d)));
+	__m128i count = _mm_add_epi32(
+		_mm_add_epi32(_mm_andnot_si128(rejectA, one), _mm_andnot_si128(rejectB, one)),
+		_mm_add_epi32(_mm_andnot_si128(rejectC, one), _mm_andnot_si128(rejectD, one)));
+
+	// (2 * sum + count) / (2 * count), exact in floats for these ranges.
+	// Lanes without any valid depth divide 0 by 0 and are masked out.
+	__m128 numerator = _mm_cvtepi32_ps(_mm_add_epi32(_mm_slli_epi32(sum, 1), count));
+	__m128 denominator = _mm_cvtepi32_ps(_mm_slli_epi32(count, 1));
+	__m128i mean = _mm_cvttps_epi32(_mm_div_ps(numerator, denominator));
+	mean = _mm_and_si128(mean, _mm_cmpgt_epi32(count, zero));
+
+	// Pack to 16 bits, SSE2 only has a signed saturating pack
+	__m128i packed = _mm_packs_epi32(_mm_sub_epi32(mean, _mm_set1_epi32(32768)), zero);
+	packed = _mm_add_epi16(packed, _mm_set1_epi16(-32768));
+	_mm_storel_epi64((__m128i *)dst, packed);
+}
+#endif
+
+//--------------------------------------------------------------
+void downsampleDepth(const uint16_t *src, int srcWidth, uint16_t *dst, int dstWidth, int dstHeight, uint16_t maxDepthStep, bool useSimd) {
+	for (int y = 0; y < dstHeight; y++) {
+		const uint16_t *row0 = src + 2 * y * srcWidth;
+		const uint16_t *row1 = row0 + srcWidth;
+		uint16_t *out = dst + y * dstWidth;
+		int x = 0;
+
+#ifdef DEPTH_PYRAMID_SSE2
+		if (useSimd) {
+			__m128i step = _mm_set1_epi32(maxDepthStep);
+			for (; x + 4 <= dstWidth; x += 4) {
+				combineDepthSse2(row0 + 2 * x, row1 + 2 * x, out + x, step);
+			}
+		}
+#endif
+
+		for (; x < dstWidth; x++) {
+			out[x] = combineDepth(row0[2 * x], row0[2 * x + 1], row1[2 * x], row1[2 * x + 1], maxDepthStep);
+		}
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Mip levels of a depth image, each half the size of the one before.
+//
+// Every output pixel combines its 2x2 source pixels, ignoring the ones
+// without depth (0) and the ones more than maxDepthStep behind the
+// nearest of them, so the edge of the body isn't averaged with the
+// wall behind it. A pixel is 0 only if all four sources are.
+//
+// Sampling a grid from the level whose pixel size matches the grid
+// spacing averages the depth under each vertex instead of picking one
+// noisy pixel, and reads from a much smaller image. The levels are
+// built with SSE2 where available, with a scalar version for other
+// CPUs and the image edges.
+class DepthPyramid {
+public:
+	DepthPyramid();
+
+	// Level 0 is the source image itself, so it has to stay valid for
+	// as long as the pyramid is used
+	void build(const ofShortPixels &depth, int maxLevels = 6);
+
+	void setMaxDepthStep(float maxDepthStep);
+
+	int getNumLevels() const;
+	const ofShortPixels &getLevel(int level) const;
+
+	// Coarsest level with pixels no larger than the spacing, in level 0
+	// pixels
+	int getLevelForSpacing(float spacing) const;
+
+	// Depth at level 0 pixel coordinates x, y, read from the given level
+	uint16_t getDepth(int level, float x, float y) const;
+
+private:
+	const ofShortPixels *mySource;
+	vector<ofShortPixels> myLevels;
+	int myNumLevels;
+	uint16_t myMaxDepthStep;
+};
+
+// Builds one level from the one before, exposed to compare the SIMD and
+// scalar kernels
+void downsampleDepth(const uint16_t *src, int srcWidth, uint16_t *dst, int dstWidth, int dstHeight, uint16_t maxDepthStep, bool useSimd = true);
@@ -0,0 +1,425 @@
+#include "DepthRecorder.h"
+#include "encoding.h"
+
+const char depthFileMagic[8] = { 'B', 'S', 'D', 'E', 'P', 'T', 'H', '1' };
+const char depthIndexMagic[8] = { 'B', 'S', 'D', 'I', 'N', 'D', 'E', 'X' };
+const uint32_t depthFileVersion = 1;
+
+// Size in bytes of the fixed file header and of each frame header
+const int depthHeaderSize = 8 + 5 * 4;
+const int depthFrameHeaderSize = 4 + 4 + 8;
+
+//--------------------------------------------------------------
+template<typename T>
+static void writeValue(ostream &stream, const T &value) {
+	stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+//--------------------------------------------------------------
+template<typename T>
+static bool readValue(istream &stream, T &value) {
+	stream.read(reinterpret_cast<char *>(&value), sizeof(T));
+	return bool(stream);
+}
+
+//--------------------------------------------------------------
+static void predictFromNeighbours(const uint16_t *depth, int width, int height, int32_t *residuals) {
+	// Each pixel is predicted from the one to its left, the first pixel
+	// of each row from the pixel above it
+	for (int y = 0; y < height; y++) {
+		const uint16_t *row = depth + y * width;
+		int32_t *out = residuals + y * width;
+		out[0] = int32_t(row[0]) - (y > 0 ? int32_t(row[-width]) : 0);
+		for (int x = 1; x < width; x++) {
+			out[x] = int32_t(row[x]) - int32_t(row[x - 1]);
+		}
+	}
+}
+
+//--------------------------------------------------------------
+static void reconstructFromNeighbours(const int32_t *residuals, int width, int height, uint16_t *depth) {
+	for (int y = 0; y < height; y++) {
+		uint16_t *row = depth + y * width;
+		const int32_t *in = residuals + y * width;
+		row[0] = uint16_t(in[0] + (y > 0 ? int32_t(row[-width]) : 0));
+		for (int x = 1; x < width; x++) {
+			row[x] = uint16_t(in[x] + int32_t(row[x - 1]));
+		}
+	}
+}
+
+//--------------------------------------------------------------
+DepthRecorder::DepthRecorder() :
+	FrameWriter("DepthRecorder"), myWidth(0), myHeight(0), myKeyframeInterval(30) {
+}
+
+//--------------------------------------------------------------
+DepthRecorder::~DepthRecorder() {
+	stop();
+}
+
+//--------------------------------------------------------------
+bool DepthRecorder::start(const string &fileName, int width, int height, int keyframeInterval, int queueCapacity) {
+	stop();
+	int numSlots = max(1, queueCapacity);
+	if (!openFile(fileName, numSlots)) {
+		return false;
+	}
+
+	myWidth = width;
+	myHeight = height;
+	myKeyframeInterval = max(1, keyframeInterval);
+
+	// Allocate every buffer now so recording doesn't touch the heap
+	int numPixels = myWidth * myHeight;
+	myFramePool.resize(numSlots);
+	for (size_t i = 0; i < myFramePool.size(); i++) {
+		myFramePool[i].depth.resize(numPixels);
+	}
+	myPreviousDepth.assign(numPixels, 0);
+	myResiduals.resize(numPixels);
+	myPayload.clear();
+	myPayload.reserve(numPixels * 2);
+	myIndex.clear();
+
+	myFile.write(depthFileMagic, sizeof(depthFileMagic));
+	writeValue(myFile, depthFileVersion);
+	writeValue(myFile, uint32_t(myWidth));
+	writeValue(myFile, uint32_t(myHeight));
+	writeValue(myFile, uint32_t(myKeyframeInterval));
+	writeValue(myFile, uint32_t(0));
+	if (!checkFile("the header")) {
+		myFile.close();
+		return false;
+	}
+
+	startWriting();
+	return true;
+}
+
+//--------------------------------------------------------------
+void DepthRecorder::stop() {
+	// Let the writer drain the queue, then close off the file
+	if (!stopWriting()) {
+		return;
+	}
+	if (hasFailed()) {
+		// DepthPlayer recovers the frames written before the failure
+		myFile.close();
+		return;
+	}
+
+	// Write the seekable index
+	uint64_t indexOffset = uint64_t(myFile.tellp());
+	for (size_t i = 0; i < myIndex.size(); i++) {
+		writeValue(myFile, myIndex[i].offset);
+		writeValue(myFile, myIndex[i].timestamp);
+		writeValue(myFile, myIndex[i].size);
+		writeValue(myFile, myIndex[i].flags);
+	}
+	writeValue(myFile, indexOffset);
+	writeValue(myFile, uint64_t(myIndex.size()));
+	myFile.write(depthIndexMagic, sizeof(depthIndexMagic));
+	myFile.close();
+	checkFile("the frame index");
+
+	ofLogNotice("DepthRecorder::stop") << getNumFramesWritten() << " frames written, "
+		<< getNumFramesDropped() << " dropped, compression " << getCompressionRatio() << ":1";
+}
+
+//--------------------------------------------------------------
+bool DepthRecorder::addFrame(const ofShortPixels &pixels, uint64_t timestampMicros) {
+	if (!isRecording()) {
+		return false;
+	}
+	if (int(pixels.getWidth()) != myWidth || int(pixels.getHeight()) != myHeight || pixels.getNumChannels() != 1) {
+		ofLogError("DepthRecorder::addFrame") << "frame size doesn't match the recording";
+		return false;
+	}
+
+	int slot = acquireSlot(false);
+	if (slot < 0) {
+		return false;
+	}
+
+	// Copy outside the lock, the writer never touches a free slot
+	QueuedFrame &frame = myFramePool[slot];
+	memcpy(frame.depth.data(), pixels.getData(), frame.depth.size() * sizeof(uint16_t));
+	frame.timestamp = timestampMicros;
+	queueSlot(slot);
+	return true;
+}
+
+//--------------------------------------------------------------
+float DepthRecorder::getCompressionRatio() const {
+	uint64_t bytes = myBytesWritten;
+	if (bytes == 0) {
+		return 0;
+	}
+	double rawBytes = double(getNumFramesWritten()) * myWidth * myHeight * sizeof(uint16_t);
+	return rawBytes / bytes;
+}
+
+//--------------------------------------------------------------
+bool DepthRecorder::writeFrame(int slot) {
+	const QueuedFrame &frame = myFramePool[slot];
+	int numPixels = myWidth * myHeight;
+	bool keyframe = (myIndex.size() % myKeyframeInterval) == 0;
+
+	if (keyframe) {
+		predictFromNeighbours(frame.depth.data(), myWidth, myHeight, myResiduals.data());
+	}
+	else {
+		for (int i = 0; i < numPixels; i++) {
+			myResiduals[i] = int32_t(frame.depth[i]) - int32_t(myPreviousDepth[i]);
+		}
+	}
+
+	myPayload.clear();
+	encodeResiduals(myResiduals.data(), numPixels, myPayload);
+
+	DepthFrameIndexEntry entry;
+	entry.offset = uint64_t(myFile.tellp());
+	entry.timestamp = frame.timestamp;
+	entry.size = uint32_t(myPayload.size());
+	entry.flags = keyframe ? depthFrameKeyframe : 0;
+
+	writeValue(myFile, entry.size);
+	writeValue(myFile, entry.flags);
+	writeValue(myFile, entry.timestamp);
+	myFile.write(reinterpret_cast<const char *>(myPayload.data()), myPayload.size());
+	if (!checkFile("a frame")) {
+		return false;
+	}
+
+	myIndex.push_back(entry);
+	memcpy(myPreviousDepth.data(), frame.depth.data(), numPixels * sizeof(uint16_t));
+
+	myBytesWritten += depthFrameHeaderSize + myPayload.size();
+	return true;
+}
+
+//--------------------------------------------------------------
+DepthPlayer::DepthPlayer() : myWidth(0), myHeight(0), myCurrentFrame(-1) {
+}
+
+//--------------------------------------------------------------
+bool DepthPlayer::load(const string &fileName) {
+	close();
+
+	myFile.open(ofToDataPath(fileName), ios::binary);
+	if (!myFile.is_open()) {
+		ofLogError("DepthPlayer::load") << "could not open " << fileName;
+		return false;
+	}
+
+	char magic[8];
+	uint32_t version, width, height, keyframeInterval, reserved;
+	myFile.read(magic, sizeof(magic));
+	if (!myFile || memcmp(magic, depthFileMagic, sizeof(magic)) != 0) {
+		ofLogError("DepthPlayer::load") << fileName << " is not a depth recording";
+		close();
+		return false;
+	}
+	readValue(myFile, version);
+	readValue(myFile, width);
+	readValue(myFile, height);
+	readValue(myFile, keyframeInterval);
+	readValue(myFile, reserved);
+	if (!myFile || version != depthFileVersion) {
+		ofLogError("DepthPlayer::load") << "unsupported depth recording version";
+		close();
+		return false;
+	}
+
+	myWidth = width;
+	myHeight = height;
+	myCurrentDepth.assign(myWidth * myHeight, 0);
+	myResiduals.resize(myWidth * myHeight);
+
+	if (!readIndexFromFooter()) {
+		ofLogWarning("DepthPlayer::load") << fileName << " has no index, recovering frames";
+		if (!rebuildIndex()) {
+			close();
+			return false;
+		}
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+void DepthPlayer::close() {
+	if (myFile.is_open()) {
+		myFile.close();
+	}
+	myFile.clear();
+	myIndex.clear();
+	myCurrentFrame = -1;
+	myWidth = 0;
+	myHeight = 0;
+}
+
+//--------------------------------------------------------------
+bool DepthPlayer::isLoaded() const {
+	return myFile.is_open();
+}
+
+//--------------------------------------------------------------
+int DepthPlayer::getNumFrames() const {
+	return myIndex.size();
+}
+
+//--------------------------------------------------------------
+int DepthPlayer::getWidth() const {
+	return myWidth;
+}
+
+//--------------------------------------------------------------
+int DepthPlayer::getHeight() const {
+	return myHeight;
+}
+
+//--------------------------------------------------------------
+uint64_t DepthPlayer::getTimestamp(int frame) const {
+	if (frame < 0 || frame >= int(myIndex.size())) {
+		return 0;
+	}
+	return myIndex[frame].timestamp;
+}
+
+//--------------------------------------------------------------
+bool DepthPlayer::getFrame(int frame, ofShortPixels &pixels) {
+	if (frame < 0 || frame >= int(myIndex.size())) {
+		return false;
+	}
+
+	if (frame != myCurrentFrame) {
+		// Find the keyframe this frame depends on
+		int keyframe = frame;
+		while (keyframe > 0 && (myIndex[keyframe].flags & depthFrameKeyframe) == 0) {
+			keyframe--;
+		}
+
+		// Continue from the current frame if it's on the way
+		int first = keyframe;
+		if (myCurrentFrame >= keyframe && myCurrentFrame < frame) {
+			first = myCurrentFrame + 1;
+		}
+
+		for (int i = first; i <= frame; i++) {
+			if (!decodeFrame(i)) {
+				myCurrentFrame = -1;
+				return false;
+			}
+			myCurrentFrame = i;
+		}
+	}
+
+	if (int(pixels.getWidth()) != myWidth || int(pixels.getHeight()) != myHeight || pixels.getNumChannels() != 1) {
+		pixels.allocate(myWidth, myHeight, 1);
+	}
+	memcpy(pixels.getData(), myCurrentDepth.data(), myCurrentDepth.size() * sizeof(uint16_t));
+	return true;
+}
+
+//--------------------------------------------------------------
+bool DepthPlayer::readIndexFromFooter() {
+	const int footerSize = 8 + 8 + sizeof(depthIndexMagic);
+	const int entrySize = 8 + 8 + 4 + 4;
+
+	myFile.seekg(0, ios::end);
+	uint64_t fileSize = uint64_t(myFile.tellg());
+	if (fileSize < depthHeaderSize + footerSize) {
+		return false;
+	}
+
+	uint64_t indexOffset, numFrames;
+	char magic[8];
+	myFile.seekg(fileSize - footerSize);
+	readValue(myFile, indexOffset);
+	readValue(myFile, numFrames);
+	myFile.read(magic, sizeof(magic));
+	if (!myFile || memcmp(magic, depthIndexMagic, sizeof(magic)) != 0) {
+		myFile.clear();
+		return false;
+	}
+	if (indexOffset + numFrames * entrySize + footerSize != fileSize) {
+		return false;
+	}
+
+	myFile.seekg(indexOffset);
+	myIndex.resize(numFrames);
+	for (size_t i = 0; i < myIndex.size(); i++) {
+		readValue(myFile, myIndex[i].offset);
+		readValue(myFile, myIndex[i].timestamp);
+		readValue(myFile, myIndex[i].size);
+		readValue(myFile, myIndex[i].flags);
+	}
+	if (!myFile) {
+		myFile.clear();
+		myIndex.clear();
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+bool DepthPlayer::rebuildIndex() {
+	myIndex.clear();
+	myFile.clear();
+
+	myFile.seekg(0, ios::end);
+	uint64_t fileSize = uint64_t(myFile.tellg());
+	uint64_t offset = depthHeaderSize;
+
+	// Walk the frame headers until we run out of complete frames
+	while (offset + depthFrameHeaderSize <= fileSize) {
+		DepthFrameIndexEntry entry;
+		entry.offset = offset;
+		myFile.seekg(offset);
+		readValue(myFile, entry.size);
+		readValue(myFile, entry.flags);
+		readValue(myFile, entry.timestamp);
+		if (!myFile || offset + depthFrameHeaderSize + entry.size > fileSize) {
+			break;
+		}
+		if (myIndex.empty() && (entry.flags & depthFrameKeyframe) == 0) {
+			break;
+		}
+		myIndex.push_back(entry);
+		offset += depthFrameHeaderSize + entry.size;
+	}
+	myFile.clear();
+
+	return !myIndex.empty();
+}
+
+//--------------------------------------------------------------
+bool DepthPlayer::decodeFrame(int frame) {
+	const DepthFrameIndexEntry &entry = myIndex[frame];
+
+	myPayload.resize(entry.size);
+	myFile.seekg(entry.offset + depthFrameHeaderSize);
+	myFile.read(reinterpret_cast<char *>(myPayload.data()), entry.size);
+	if (!myFile) {
+		myFile.clear();
+		ofLogError("DepthPlayer::decodeFrame") << "could not read frame " << frame;
+		return false;
+	}
+
+	int numPixels = myWidth * myHeight;
+	if (!decodeResiduals(myPayload.data(), myPayload.size(), myResiduals.data(), numPixels)) {
+		ofLogError("DepthPlayer::decodeFrame") << "frame " << frame << " is corrupt";
+		return false;
+	}
+
+	if (entry.flags & depthFrameKeyframe) {
+		reconstructFromNeighbours(myResiduals.data(), myWidth, myHeight, myCurrentDepth.data());
+	}
+	else {
+		for (int i = 0; i < numPixels; i++) {
+			myCurrentDepth[i] = uint16_t(int32_t(myCurrentDepth[i]) + myResiduals[i]);
+		}
+	}
+	return true;
+}
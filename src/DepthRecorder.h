@@ -0,0 +1,98 @@
+#pragma once
+
+#include "ofMain.h"
+#include "FrameWriter.h"
+
+// Recording of raw 16 bit depth frames to a compressed container.
+//
+// File layout (all values little endian):
+//   header   magic "BSDEPTH1", version, width, height, keyframe interval
+//   frames   per frame: payload size, flags, timestamp, coded residuals
+//   footer   one index entry per frame, index offset, frame count,
+//            magic "BSDINDEX"
+//
+// Keyframes predict each pixel from its left neighbour, all other
+// frames predict from the same pixel in the previous frame. Residuals
+// are coded losslessly with encodeResiduals(). If a recording was cut
+// short the footer is missing, DepthPlayer then rebuilds the index by
+// walking the frame headers.
+
+struct DepthFrameIndexEntry {
+	uint64_t offset;
+	uint64_t timestamp;
+	uint32_t size;
+	uint32_t flags;
+};
+
+const uint32_t depthFrameKeyframe = 1;
+
+//--------------------------------------------------------------
+class DepthRecorder : public FrameWriter {
+public:
+	DepthRecorder();
+	~DepthRecorder();
+
+	bool start(const string &fileName, int width, int height, int keyframeInterval = 30, int queueCapacity = 16);
+	void stop();
+
+	// Queues a copy of the frame for the writer thread. Returns false
+	// if the queue is full and the frame had to be dropped.
+	bool addFrame(const ofShortPixels &pixels, uint64_t timestampMicros);
+
+	float getCompressionRatio() const;
+
+private:
+	struct QueuedFrame {
+		vector<uint16_t> depth;
+		uint64_t timestamp;
+	};
+
+	bool writeFrame(int slot);
+
+	int myWidth;
+	int myHeight;
+	int myKeyframeInterval;
+
+	// One buffer per queue slot, all allocated up front
+	vector<QueuedFrame> myFramePool;
+
+	// Only touched by the writer thread while recording
+	vector<uint16_t> myPreviousDepth;
+	vector<int32_t> myResiduals;
+	vector<uint8_t> myPayload;
+	vector<DepthFrameIndexEntry> myIndex;
+};
+
+//--------------------------------------------------------------
+class DepthPlayer {
+public:
+	DepthPlayer();
+
+	bool load(const string &fileName);
+	void close();
+	bool isLoaded() const;
+
+	int getNumFrames() const;
+	int getWidth() const;
+	int getHeight() const;
+	uint64_t getTimestamp(int frame) const;
+
+	// Decodes any frame. Sequential reads only decode one frame, random
+	// access decodes forward from the closest preceding keyframe.
+	bool getFrame(int frame, ofShortPixels &pixels);
+
+private:
+	bool readIndexFromFooter();
+	bool rebuildIndex();
+	bool decodeFrame(int frame);
+
+	ifstream myFile;
+	int myWidth;
+	int myHeight;
+	vector<DepthFrameIndexEntry> myIndex;
+
+	int myCurrentFrame;
+	vector<uint16_t> myCurrentDepth;
+	vector<int32_t> myResiduals;
+	vector<uint8_t> myPayload;
+};
@@ -0,0 +1,64 @@
+#include "FrameArena.h"
+
+//--------------------------------------------------------------
+FrameArena::FrameArena(size_t initialCapacity, size_t maxCapacity) :
+	myMaxCapacity(max(initialCapacity, maxCapacity)), myOffset(0), myOverflowBytes(0), myPeakBytes(0) {
+	myBlock.size = initialCapacity;
+	myBlock.data.reset(new uint8_t[initialCapacity]);
+}
+
+//--------------------------------------------------------------
+void *FrameArena::allocateBytes(size_t numBytes, size_t alignment) {
+	// Blocks come from new[], which is aligned for any fundamental type
+	size_t start = (myOffset + alignment - 1) & ~(alignment - 1);
+	if (start + numBytes <= myBlock.size) {
+		myOffset = start + numBytes;
+		myPeakBytes = max(myPeakBytes, myOffset + myOverflowBytes);
+		return myBlock.data.get() + start;
+	}
+
+	// Out of room, give this request its own block until the next reset
+	Block overflow;
+	overflow.size = max<size_t>(numBytes, 1);
+	overflow.data.reset(new uint8_t[overflow.size]);
+	myOverflowBlocks.push_back(std::move(overflow));
+	myOverflowBytes += numBytes + alignment;
+	myPeakBytes = max(myPeakBytes, myOffset + myOverflowBytes);
+	return myOverflowBlocks.back().data.get();
+}
+
+//--------------------------------------------------------------
+void FrameArena::reset() {
+	// Grow so the whole of a frame like this one fits in one block, up
+	// to the limit. Frames above it keep using overflow blocks.
+	size_t newSize = min(max(myPeakBytes + myPeakBytes / 4, myBlock.size * 2), myMaxCapacity);
+	if (!myOverflowBlocks.empty() && newSize > myBlock.size) {
+		ofLogVerbose("FrameArena::reset") << "growing from " << myBlock.size << " to " << newSize << " bytes";
+		myBlock.data.reset(new uint8_t[newSize]);
+		myBlock.size = newSize;
+	}
+	myOverflowBlocks.clear();
+	myOffset = 0;
+	myOverflowBytes = 0;
+}
+
+//--------------------------------------------------------------
+size_t FrameArena::getBytesUsed() const {
+	return myOffset + myOverflowBytes;
+}
+
+//--------------------------------------------------------------
+size_t FrameArena::getPeakBytes() const {
+	return myPeakBytes;
+}
+
+//--------------------------------------------------------------
+size_t FrameArena::getCapacity() const {
+	return myBlock.size;
+}
+
+//--------------------------------------------------------------
+FrameArena &getFrameArena() {
+	static FrameArena arena;
+	return arena;
+}
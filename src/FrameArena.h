@@ -0,0 +1,56 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Scratch memory for temporaries that only live for one frame.
+//
+// Allocations just bump a pointer inside a preallocated block and are
+// all released together by reset() at the end of the frame. If a frame
+// needs more than the block holds, extra blocks are taken from the heap
+// and on the next reset() the arena is regrown to the peak size, so a
+// steady-state loop stops touching the heap after its first frames. It
+// never grows past maxCapacity, a one-off peak above that is given back
+// on the next reset() instead of being kept for the session.
+//
+// Only for trivially destructible types, nothing is destructed. Not
+// thread safe, allocate on the main thread and hand the memory to
+// parallelFor bodies if needed.
+class FrameArena {
+public:
+	FrameArena(size_t initialCapacity = 1 << 20, size_t maxCapacity = 64 << 20);
+
+	template<typename T>
+	T *allocate(size_t count);
+
+	// Releases everything allocated since the last reset
+	void reset();
+
+	size_t getBytesUsed() const;
+	size_t getPeakBytes() const;
+	size_t getCapacity() const;
+
+private:
+	void *allocateBytes(size_t numBytes, size_t alignment);
+
+	struct Block {
+		unique_ptr<uint8_t[]> data;
+		size_t size;
+	};
+
+	Block myBlock;
+	size_t myMaxCapacity;
+	vector<Block> myOverflowBlocks;
+	size_t myOffset;
+	size_t myOverflowBytes;
+	size_t myPeakBytes;
+};
+
+// Arena shared by the render loop, reset once per frame
+FrameArena &getFrameArena();
+
+//--------------------------------------------------------------
+template<typename T>
+T *FrameArena::allocate(size_t count) {
+	static_assert(std::is_trivially_destructible<T>::value, "FrameArena never runs destructors");
+	return static_cast<T *>(allocateBytes(count * sizeof(T), alignof(T)));
+}
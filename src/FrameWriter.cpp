@@ -0,0 +1,138 @@
+#include "FrameWriter.h"
+
+//--------------------------------------------------------------
+FrameWriter::FrameWriter(const string &name) :
+	myBytesWritten(0), myName(name), myRecording(false), myFailed(false), myFramesWritten(0), myFramesDropped(0) {
+}
+
+//--------------------------------------------------------------
+bool FrameWriter::isRecording() const {
+	return myRecording;
+}
+
+//--------------------------------------------------------------
+bool FrameWriter::hasFailed() const {
+	return myFailed;
+}
+
+//--------------------------------------------------------------
+int FrameWriter::getNumFramesWritten() const {
+	return myFramesWritten;
+}
+
+//--------------------------------------------------------------
+int FrameWriter::getNumFramesDropped() const {
+	return myFramesDropped;
+}
+
+//--------------------------------------------------------------
+bool FrameWriter::openFile(const string &fileName, int numSlots) {
+	myFile.open(ofToDataPath(fileName), ios::binary | ios::trunc);
+	if (!myFile.is_open()) {
+		ofLogError(myName) << "could not open " << fileName;
+		return false;
+	}
+	myFileName = fileName;
+
+	myFreeSlots.clear();
+	myPendingSlots.clear();
+	for (int i = 0; i < numSlots; i++) {
+		myFreeSlots.push_back(i);
+	}
+	myFailed = false;
+	myFramesWritten = 0;
+	myFramesDropped = 0;
+	myBytesWritten = 0;
+	return true;
+}
+
+//--------------------------------------------------------------
+void FrameWriter::startWriting() {
+	myRecording = true;
+	startThread();
+}
+
+//--------------------------------------------------------------
+bool FrameWriter::stopWriting() {
+	if (!myFile.is_open()) {
+		return false;
+	}
+	{
+		lock_guard<std::mutex> lock(mutex);
+		myRecording = false;
+	}
+	myCondition.notify_all();
+	waitForThread(false);
+	return true;
+}
+
+//--------------------------------------------------------------
+int FrameWriter::acquireSlot(bool waitForSpace) {
+	unique_lock<std::mutex> lock(mutex);
+	if (waitForSpace) {
+		myCondition.wait(lock, [this] { return !myFreeSlots.empty() || !myRecording; });
+	}
+	if (!myRecording) {
+		return -1;
+	}
+	if (myFreeSlots.empty()) {
+		myFramesDropped++;
+		return -1;
+	}
+	int slot = myFreeSlots.front();
+	myFreeSlots.pop_front();
+	return slot;
+}
+
+//--------------------------------------------------------------
+void FrameWriter::queueSlot(int slot) {
+	{
+		lock_guard<std::mutex> lock(mutex);
+		myPendingSlots.push_back(slot);
+	}
+	myCondition.notify_all();
+}
+
+//--------------------------------------------------------------
+bool FrameWriter::checkFile(const char *what) {
+	if (myFile.fail()) {
+		ofLogError(myName) << "could not write " << what << " to " << myFileName << ", the disk may be full";
+		myFailed = true;
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+void FrameWriter::threadedFunction() {
+	while (true) {
+		int slot;
+		{
+			unique_lock<std::mutex> lock(mutex);
+			myCondition.wait(lock, [this] { return !myPendingSlots.empty() || !myRecording; });
+			if (myPendingSlots.empty()) {
+				// Stopped and nothing left to write
+				break;
+			}
+			slot = myPendingSlots.front();
+			myPendingSlots.pop_front();
+		}
+
+		// After a failed write the rest of the queue is only dropped
+		bool written = !myFailed && writeFrame(slot);
+
+		{
+			lock_guard<std::mutex> lock(mutex);
+			myFreeSlots.push_back(slot);
+			if (written) {
+				myFramesWritten++;
+			}
+			else {
+				myFramesDropped++;
+				myFailed = true;
+				myRecording = false;
+			}
+		}
+		myCondition.notify_all();
+	}
+}
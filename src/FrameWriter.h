@@ -0,0 +1,57 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Writer thread shared by the depth recorder and the mesh sequence
+// exporter. Frames go through a bounded queue of slots that the derived
+// class allocates up front, and are written in order on the thread. If
+// a write fails the recording stops and the rest of the queue is
+// dropped.
+class FrameWriter : public ofThread {
+public:
+	FrameWriter(const string &name);
+
+	bool isRecording() const;
+	bool hasFailed() const;
+	int getNumFramesWritten() const;
+	int getNumFramesDropped() const;
+
+protected:
+	// Opens the file and frees numSlots queue slots
+	bool openFile(const string &fileName, int numSlots);
+	void startWriting();
+
+	// Lets the thread drain the queue and waits for it. Returns false if
+	// nothing was being recorded.
+	bool stopWriting();
+
+	// Takes a free slot to fill, or -1 if the frame has to be dropped.
+	// Offline callers can wait for a slot instead.
+	int acquireSlot(bool waitForSpace);
+	void queueSlot(int slot);
+
+	// Called on the thread for each queued slot, returns false if the
+	// frame couldn't be written
+	virtual bool writeFrame(int slot) = 0;
+
+	// Logs an error and marks the recording failed if the last writes
+	// to the file didn't succeed
+	bool checkFile(const char *what);
+
+	ofstream myFile;
+	atomic<uint64_t> myBytesWritten;
+
+private:
+	void threadedFunction();
+
+	string myName;
+	string myFileName;
+	atomic<bool> myRecording;
+	atomic<bool> myFailed;
+	deque<int> myFreeSlots;
+	deque<int> myPendingSlots;
+	condition_variable myCondition;
+
+	atomic<int> myFramesWritten;
+	atomic<int> myFramesDropped;
+};
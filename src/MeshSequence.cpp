@@ -0,0 +1,555 @@
+#include "MeshSequence.h"
+#include "encoding.h"
+#include "quantization.h"
+
+const char meshFileMagic[8] = { 'B', 'S', 'M', 'E', 'S', 'H', 'S', '1' };
+const char meshIndexMagic[8] = { 'B', 'S', 'M', 'I', 'N', 'D', 'E', 'X' };
+const uint32_t meshFileVersion = 1;
+
+// Size in bytes of each frame header: payload size, flags, timestamp
+// and the quantization box
+const int meshFrameHeaderSize = 4 + 4 + 8 + 6 * 4;
+
+// Fraction of the mesh extent added around it when a new quantization
+// box is set, so moving meshes don't force a keyframe every frame
+const float meshBoxMargin = 0.1;
+
+//--------------------------------------------------------------
+template<typename T>
+static void writeValue(ostream &stream, const T &value) {
+	stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+//--------------------------------------------------------------
+template<typename T>
+static bool readValue(istream &stream, T &value) {
+	stream.read(reinterpret_cast<char *>(&value), sizeof(T));
+	return bool(stream);
+}
+
+//--------------------------------------------------------------
+static void predictFromPrevious(const uint16_t *values, size_t count, int32_t *residuals) {
+	// Within a keyframe each value is predicted from the previous one
+	int32_t previous = 0;
+	for (size_t i = 0; i < count; i++) {
+		residuals[i] = int32_t(values[i]) - previous;
+		previous = values[i];
+	}
+}
+
+//--------------------------------------------------------------
+static void reconstructFromPrevious(const int32_t *residuals, size_t count, uint16_t *values) {
+	int32_t previous = 0;
+	for (size_t i = 0; i < count; i++) {
+		previous += residuals[i];
+		values[i] = uint16_t(previous);
+	}
+}
+
+//--------------------------------------------------------------
+MeshSequenceExporter::MeshSequenceExporter() :
+	FrameWriter("MeshSequenceExporter"), myNumVertices(0), myNumIndices(0), myExportNormals(false), myKeyframeInterval(60),
+	myFramesSinceKeyframe(0) {
+}
+
+//--------------------------------------------------------------
+MeshSequenceExporter::~MeshSequenceExporter() {
+	stop();
+}
+
+//--------------------------------------------------------------
+bool MeshSequenceExporter::start(const string &fileName, const ofMesh &mesh, bool exportNormals, int keyframeInterval, int queueCapacity) {
+	stop();
+	int numSlots = max(1, queueCapacity);
+	if (!openFile(fileName, numSlots)) {
+		return false;
+	}
+
+	myNumVertices = mesh.getNumVertices();
+	myNumIndices = mesh.getNumIndices();
+	myExportNormals = exportNormals && mesh.getNumNormals() == mesh.getNumVertices();
+	myKeyframeInterval = max(1, keyframeInterval);
+
+	// Allocate every buffer now so recording doesn't touch the heap
+	myFramePool.resize(numSlots);
+	for (size_t i = 0; i < myFramePool.size(); i++) {
+		myFramePool[i].positions.resize(myNumVertices);
+		myFramePool[i].normals.resize(myExportNormals ? myNumVertices : 0);
+	}
+	int numValues = myNumVertices * (myExportNormals ? 5 : 3);
+	myQuantized.assign(numValues, 0);
+	myPreviousQuantized.assign(numValues, 0);
+	myResiduals.resize(max(numValues, myNumIndices));
+	myPayload.clear();
+	myPayload.reserve(numValues * 2);
+	myIndex.clear();
+	myFramesSinceKeyframe = 0;
+
+	// Topology is written once, indices are delta coded
+	const vector<ofIndexType> &indices = mesh.getIndices();
+	int32_t previous = 0;
+	for (int i = 0; i < myNumIndices; i++) {
+		myResiduals[i] = int32_t(indices[i]) - previous;
+		previous = indices[i];
+	}
+	encodeResiduals(myResiduals.data(), myNumIndices, myPayload);
+
+	myFile.write(meshFileMagic, sizeof(meshFileMagic));
+	writeValue(myFile, meshFileVersion);
+	writeValue(myFile, uint32_t(myNumVertices));
+	writeValue(myFile, uint32_t(myNumIndices));
+	writeValue(myFile, uint32_t(mesh.getMode()));
+	writeValue(myFile, uint32_t(myExportNormals ? meshSequenceHasNormals : 0));
+	writeValue(myFile, uint32_t(myKeyframeInterval));
+	writeValue(myFile, uint32_t(myPayload.size()));
+	myFile.write(reinterpret_cast<const char *>(myPayload.data()), myPayload.size());
+	if (!checkFile("the header")) {
+		myFile.close();
+		return false;
+	}
+
+	startWriting();
+	return true;
+}
+
+//--------------------------------------------------------------
+void MeshSequenceExporter::stop() {
+	// Let the encoder drain the queue, then close off the file
+	if (!stopWriting()) {
+		return;
+	}
+	if (hasFailed()) {
+		// MeshSequenceReader recovers the frames written before the failure
+		myFile.close();
+		return;
+	}
+
+	uint64_t indexOffset = uint64_t(myFile.tellp());
+	for (size_t i = 0; i < myIndex.size(); i++) {
+		writeValue(myFile, myIndex[i].offset);
+		writeValue(myFile, myIndex[i].timestamp);
+		writeValue(myFile, myIndex[i].size);
+		writeValue(myFile, myIndex[i].flags);
+	}
+	writeValue(myFile, indexOffset);
+	writeValue(myFile, uint64_t(myIndex.size()));
+	myFile.write(meshIndexMagic, sizeof(meshIndexMagic));
+	myFile.close();
+	checkFile("the frame index");
+
+	ofLogNotice("MeshSequenceExporter::stop") << getNumFramesWritten() << " frames written, "
+		<< getNumFramesDropped() << " dropped, compression " << getCompressionRatio() << ":1";
+}
+
+//--------------------------------------------------------------
+bool MeshSequenceExporter::addFrame(const ofMesh &mesh, uint64_t timestampMicros, bool waitForSpace) {
+	if (!isRecording()) {
+		return false;
+	}
+	if (int(mesh.getNumVertices()) != myNumVertices || int(mesh.getNumIndices()) != myNumIndices) {
+		ofLogError("MeshSequenceExporter::addFrame") << "mesh topology changed, stopping export";
+		stop();
+		return false;
+	}
+	if (myExportNormals && int(mesh.getNumNormals()) != myNumVertices) {
+		ofLogError("MeshSequenceExporter::addFrame") << "mesh has lost its normals, stopping export";
+		stop();
+		return false;
+	}
+
+	int slot = acquireSlot(waitForSpace);
+	if (slot < 0) {
+		return false;
+	}
+
+	QueuedFrame &frame = myFramePool[slot];
+	memcpy(frame.positions.data(), mesh.getVertices().data(), myNumVertices * sizeof(vec3));
+	if (myExportNormals) {
+		memcpy(frame.normals.data(), mesh.getNormals().data(), myNumVertices * sizeof(vec3));
+	}
+	frame.timestamp = timestampMicros;
+	queueSlot(slot);
+	return true;
+}
+
+//--------------------------------------------------------------
+float MeshSequenceExporter::getCompressionRatio() const {
+	uint64_t bytes = myBytesWritten;
+	if (bytes == 0) {
+		return 0;
+	}
+	double rawBytes = double(getNumFramesWritten()) * myNumVertices * sizeof(vec3) * (myExportNormals ? 2 : 1);
+	return rawBytes / bytes;
+}
+
+//--------------------------------------------------------------
+bool MeshSequenceExporter::writeFrame(int slot) {
+	const QueuedFrame &frame = myFramePool[slot];
+	int n = myNumVertices;
+
+	// Find the bounds of this frame
+	vec3 minPos(FLT_MAX);
+	vec3 maxPos(-FLT_MAX);
+	for (int i = 0; i < n; i++) {
+		minPos = min(minPos, frame.positions[i]);
+		maxPos = max(maxPos, frame.positions[i]);
+	}
+
+	// Start a new keyframe at the fixed interval, or whenever the mesh
+	// has moved outside the current quantization box
+	bool keyframe = myIndex.empty() || myFramesSinceKeyframe >= myKeyframeInterval;
+	for (int axis = 0; axis < 3; axis++) {
+		if (minPos[axis] < myBoxMin[axis] || maxPos[axis] > myBoxMax[axis]) {
+			keyframe = true;
+		}
+	}
+	if (keyframe) {
+		vec3 margin = max((maxPos - minPos) * meshBoxMargin, vec3(1e-4));
+		myBoxMin = minPos - margin;
+		myBoxMax = maxPos + margin;
+		myFramesSinceKeyframe = 0;
+	}
+	myFramesSinceKeyframe++;
+
+	// Quantize into separate planes for x, y, z and the normals
+	vec3 scale = 65535.0f / (myBoxMax - myBoxMin);
+	uint16_t *qx = myQuantized.data();
+	uint16_t *qy = qx + n;
+	uint16_t *qz = qy + n;
+	for (int i = 0; i < n; i++) {
+		vec3 q = (frame.positions[i] - myBoxMin) * scale + 0.5f;
+		qx[i] = uint16_t(ofClamp(q.x, 0, 65535));
+		qy[i] = uint16_t(ofClamp(q.y, 0, 65535));
+		qz[i] = uint16_t(ofClamp(q.z, 0, 65535));
+	}
+	if (myExportNormals) {
+		uint16_t *qu = qz + n;
+		uint16_t *qv = qu + n;
+		for (int i = 0; i < n; i++) {
+			octEncode(frame.normals[i], qu[i], qv[i]);
+		}
+	}
+
+	int numValues = myQuantized.size();
+	if (keyframe) {
+		for (int plane = 0; n > 0 && plane < numValues / n; plane++) {
+			predictFromPrevious(myQuantized.data() + plane * n, n, myResiduals.data() + plane * n);
+		}
+	}
+	else {
+		for (int i = 0; i < numValues; i++) {
+			myResiduals[i] = int32_t(myQuantized[i]) - int32_t(myPreviousQuantized[i]);
+		}
+	}
+
+	myPayload.clear();
+	encodeResiduals(myResiduals.data(), numValues, myPayload);
+
+	MeshFrameIndexEntry entry;
+	entry.offset = uint64_t(myFile.tellp());
+	entry.timestamp = frame.timestamp;
+	entry.size = uint32_t(myPayload.size());
+	entry.flags = keyframe ? meshFrameKeyframe : 0;
+
+	writeValue(myFile, entry.size);
+	writeValue(myFile, entry.flags);
+	writeValue(myFile, entry.timestamp);
+	for (int axis = 0; axis < 3; axis++) {
+		writeValue(myFile, myBoxMin[axis]);
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		writeValue(myFile, myBoxMax[axis]);
+	}
+	myFile.write(reinterpret_cast<const char *>(myPayload.data()), myPayload.size());
+	if (!checkFile("a frame")) {
+		return false;
+	}
+
+	myIndex.push_back(entry);
+	myQuantized.swap(myPreviousQuantized);
+
+	myBytesWritten += meshFrameHeaderSize + myPayload.size();
+	return true;
+}
+
+//--------------------------------------------------------------
+MeshSequenceReader::MeshSequenceReader() :
+	myNumVertices(0), myMode(OF_PRIMITIVE_TRIANGLES), myHasNormals(false), myCurrentFrame(-1) {
+}
+
+//--------------------------------------------------------------
+bool MeshSequenceReader::load(const string &fileName) {
+	close();
+
+	myFile.open(ofToDataPath(fileName), ios::binary);
+	if (!myFile.is_open()) {
+		ofLogError("MeshSequenceReader::load") << "could not open " << fileName;
+		return false;
+	}
+
+	char magic[8];
+	uint32_t version, numVertices, numIndices, mode, flags, keyframeInterval, topologySize;
+	myFile.read(magic, sizeof(magic));
+	if (!myFile || memcmp(magic, meshFileMagic, sizeof(magic)) != 0) {
+		ofLogError("MeshSequenceReader::load") << fileName << " is not a mesh sequence";
+		close();
+		return false;
+	}
+	readValue(myFile, version);
+	readValue(myFile, numVertices);
+	readValue(myFile, numIndices);
+	readValue(myFile, mode);
+	readValue(myFile, flags);
+	readValue(myFile, keyframeInterval);
+	readValue(myFile, topologySize);
+	if (!myFile || version != meshFileVersion) {
+		ofLogError("MeshSequenceReader::load") << "unsupported mesh sequence version";
+		close();
+		return false;
+	}
+
+	myNumVertices = numVertices;
+	myMode = ofPrimitiveMode(mode);
+	myHasNormals = (flags & meshSequenceHasNormals) != 0;
+
+	int numValues = myNumVertices * (myHasNormals ? 5 : 3);
+	myQuantized.assign(numValues, 0);
+	myResiduals.resize(max(numValues, int(numIndices)));
+
+	// Topology
+	myPayload.resize(topologySize);
+	myFile.read(reinterpret_cast<char *>(myPayload.data()), topologySize);
+	if (!myFile || !decodeResiduals(myPayload.data(), topologySize, myResiduals.data(), numIndices)) {
+		ofLogError("MeshSequenceReader::load") << "could not read the topology of " << fileName;
+		close();
+		return false;
+	}
+	myIndices.resize(numIndices);
+	int32_t previous = 0;
+	for (uint32_t i = 0; i < numIndices; i++) {
+		previous += myResiduals[i];
+		myIndices[i] = ofIndexType(previous);
+	}
+
+	uint64_t firstFrameOffset = uint64_t(myFile.tellg());
+	if (!readIndexFromFooter()) {
+		ofLogWarning("MeshSequenceReader::load") << fileName << " has no frame index, recovering frames";
+		if (!rebuildIndex(firstFrameOffset)) {
+			ofLogError("MeshSequenceReader::load") << fileName << " has no complete frames";
+			close();
+			return false;
+		}
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+void MeshSequenceReader::close() {
+	if (myFile.is_open()) {
+		myFile.close();
+	}
+	myFile.clear();
+	myIndices.clear();
+	myIndex.clear();
+	myCurrentFrame = -1;
+	myNumVertices = 0;
+}
+
+//--------------------------------------------------------------
+bool MeshSequenceReader::isLoaded() const {
+	return myFile.is_open();
+}
+
+//--------------------------------------------------------------
+int MeshSequenceReader::getNumFrames() const {
+	return myIndex.size();
+}
+
+//--------------------------------------------------------------
+int MeshSequenceReader::getNumVertices() const {
+	return myNumVertices;
+}
+
+//--------------------------------------------------------------
+bool MeshSequenceReader::hasNormals() const {
+	return myHasNormals;
+}
+
+//--------------------------------------------------------------
+uint64_t MeshSequenceReader::getTimestamp(int frame) const {
+	if (frame < 0 || frame >= int(myIndex.size())) {
+		return 0;
+	}
+	return myIndex[frame].timestamp;
+}
+
+//--------------------------------------------------------------
+bool MeshSequenceReader::getFrame(int frame, ofMesh &mesh) {
+	if (frame < 0 || frame >= int(myIndex.size())) {
+		return false;
+	}
+
+	if (frame != myCurrentFrame) {
+		int keyframe = frame;
+		while (keyframe > 0 && (myIndex[keyframe].flags & meshFrameKeyframe) == 0) {
+			keyframe--;
+		}
+
+		int first = keyframe;
+		if (myCurrentFrame >= keyframe && myCurrentFrame < frame) {
+			first = myCurrentFrame + 1;
+		}
+
+		for (int i = first; i <= frame; i++) {
+			if (!decodeFrame(i)) {
+				myCurrentFrame = -1;
+				return false;
+			}
+			myCurrentFrame = i;
+		}
+	}
+
+	// The caller's mesh may hold another topology with the same index
+	// count, so it's always replaced. Once the capacity is there this is
+	// a copy, cheaper than decoding the vertices.
+	int n = myNumVertices;
+	mesh.setMode(myMode);
+	mesh.getIndices().assign(myIndices.begin(), myIndices.end());
+
+	vector<vec3> &vertices = mesh.getVertices();
+	vertices.resize(n);
+	vec3 step = (myBoxMax - myBoxMin) / 65535.0f;
+	const uint16_t *qx = myQuantized.data();
+	const uint16_t *qy = qx + n;
+	const uint16_t *qz = qy + n;
+	for (int i = 0; i < n; i++) {
+		vertices[i] = myBoxMin + vec3(qx[i], qy[i], qz[i]) * step;
+	}
+
+	if (myHasNormals) {
+		vector<vec3> &normals = mesh.getNormals();
+		normals.resize(n);
+		const uint16_t *qu = qz + n;
+		const uint16_t *qv = qu + n;
+		for (int i = 0; i < n; i++) {
+			normals[i] = octDecode(qu[i], qv[i]);
+		}
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+bool MeshSequenceReader::readIndexFromFooter() {
+	const int footerSize = 8 + 8 + sizeof(meshIndexMagic);
+	const int entrySize = 8 + 8 + 4 + 4;
+
+	myFile.seekg(0, ios::end);
+	uint64_t fileSize = uint64_t(myFile.tellg());
+	if (fileSize < footerSize) {
+		return false;
+	}
+
+	uint64_t indexOffset, numFrames;
+	char magic[8];
+	myFile.seekg(fileSize - footerSize);
+	readValue(myFile, indexOffset);
+	readValue(myFile, numFrames);
+	myFile.read(magic, sizeof(magic));
+	if (!myFile || memcmp(magic, meshIndexMagic, sizeof(magic)) != 0) {
+		myFile.clear();
+		return false;
+	}
+	if (indexOffset + numFrames * entrySize + footerSize != fileSize) {
+		return false;
+	}
+
+	myFile.seekg(indexOffset);
+	myIndex.resize(numFrames);
+	for (size_t i = 0; i < myIndex.size(); i++) {
+		readValue(myFile, myIndex[i].offset);
+		readValue(myFile, myIndex[i].timestamp);
+		readValue(myFile, myIndex[i].size);
+		readValue(myFile, myIndex[i].flags);
+	}
+	if (!myFile) {
+		myFile.clear();
+		myIndex.clear();
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+bool MeshSequenceReader::rebuildIndex(uint64_t firstFrameOffset) {
+	myIndex.clear();
+	myFile.clear();
+
+	myFile.seekg(0, ios::end);
+	uint64_t fileSize = uint64_t(myFile.tellg());
+	uint64_t offset = firstFrameOffset;
+
+	// Walk the frame headers until we run out of complete frames
+	while (offset + meshFrameHeaderSize <= fileSize) {
+		MeshFrameIndexEntry entry;
+		entry.offset = offset;
+		myFile.seekg(offset);
+		readValue(myFile, entry.size);
+		readValue(myFile, entry.flags);
+		readValue(myFile, entry.timestamp);
+		if (!myFile || offset + meshFrameHeaderSize + entry.size > fileSize) {
+			break;
+		}
+		if (myIndex.empty() && (entry.flags & meshFrameKeyframe) == 0) {
+			break;
+		}
+		myIndex.push_back(entry);
+		offset += meshFrameHeaderSize + entry.size;
+	}
+	myFile.clear();
+
+	return !myIndex.empty();
+}
+
+//--------------------------------------------------------------
+bool MeshSequenceReader::decodeFrame(int frame) {
+	const MeshFrameIndexEntry &entry = myIndex[frame];
+
+	uint32_t size, flags;
+	uint64_t timestamp;
+	myFile.seekg(entry.offset);
+	readValue(myFile, size);
+	readValue(myFile, flags);
+	readValue(myFile, timestamp);
+	for (int axis = 0; axis < 3; axis++) {
+		readValue(myFile, myBoxMin[axis]);
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		readValue(myFile, myBoxMax[axis]);
+	}
+	myPayload.resize(entry.size);
+	myFile.read(reinterpret_cast<char *>(myPayload.data()), entry.size);
+	if (!myFile) {
+		myFile.clear();
+		ofLogError("MeshSequenceReader::decodeFrame") << "could not read frame " << frame;
+		return false;
+	}
+
+	int n = myNumVertices;
+	int numValues = myQuantized.size();
+	if (!decodeResiduals(myPayload.data(), myPayload.size(), myResiduals.data(), numValues)) {
+		ofLogError("MeshSequenceReader::decodeFrame") << "frame " << frame << " is corrupt";
+		return false;
+	}
+
+	if (entry.flags & meshFrameKeyframe) {
+		for (int plane = 0; n > 0 && plane < numValues / n; plane++) {
+			reconstructFromPrevious(myResiduals.data() + plane * n, n, myQuantized.data() + plane * n);
+		}
+	}
+	else {
+		for (int i = 0; i < numValues; i++) {
+			myQuantized[i] = uint16_t(int32_t(myQuantized[i]) + myResiduals[i]);
+		}
+	}
+	return true;
+}
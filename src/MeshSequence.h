@@ -0,0 +1,118 @@
+#pragma once
+
+#include "ofMain.h"
+#include "FrameWriter.h"
+
+using namespace glm;
+
+// Export of animated meshes whose topology doesn't change.
+//
+// File layout (all values little endian):
+//   header   magic "BSMESHS1", version, vertex count, index count,
+//            primitive mode, flags, keyframe interval, coded indices
+//   frames   per frame: payload size, flags, timestamp, quantization
+//            box, coded position (and optionally normal) residuals
+//   footer   one index entry per frame, index offset, frame count,
+//            magic "BSMINDEX"
+//
+// If an export was cut short the footer is missing, MeshSequenceReader
+// then rebuilds the index by walking the frame headers.
+//
+// Positions are quantized to 16 bits per axis inside a box that is set
+// on each keyframe with some margin around the mesh, so the grid stays
+// fixed between keyframes and the per-frame deltas stay small. If the
+// mesh leaves the box a new keyframe is started. Normals are stored
+// octahedrally encoded in 2x16 bits.
+
+struct MeshFrameIndexEntry {
+	uint64_t offset;
+	uint64_t timestamp;
+	uint32_t size;
+	uint32_t flags;
+};
+
+const uint32_t meshFrameKeyframe = 1;
+const uint32_t meshSequenceHasNormals = 1;
+
+//--------------------------------------------------------------
+class MeshSequenceExporter : public FrameWriter {
+public:
+	MeshSequenceExporter();
+	~MeshSequenceExporter();
+
+	// Writes the topology of mesh, frames added later must match it
+	bool start(const string &fileName, const ofMesh &mesh, bool exportNormals, int keyframeInterval = 60, int queueCapacity = 8);
+	void stop();
+
+	// Queues a copy of the vertex data for the encoder thread. Returns
+	// false if the frame was dropped or the topology has changed. Offline
+	// callers can wait for the encoder instead of dropping frames.
+	bool addFrame(const ofMesh &mesh, uint64_t timestampMicros, bool waitForSpace = false);
+
+	float getCompressionRatio() const;
+
+private:
+	struct QueuedFrame {
+		vector<vec3> positions;
+		vector<vec3> normals;
+		uint64_t timestamp;
+	};
+
+	bool writeFrame(int slot);
+
+	int myNumVertices;
+	int myNumIndices;
+	bool myExportNormals;
+	int myKeyframeInterval;
+
+	// One buffer per queue slot, all allocated up front
+	vector<QueuedFrame> myFramePool;
+
+	// Only touched by the encoder thread while recording
+	vector<uint16_t> myQuantized;
+	vector<uint16_t> myPreviousQuantized;
+	vector<int32_t> myResiduals;
+	vector<uint8_t> myPayload;
+	vec3 myBoxMin;
+	vec3 myBoxMax;
+	int myFramesSinceKeyframe;
+	vector<MeshFrameIndexEntry> myIndex;
+};
+
+//--------------------------------------------------------------
+class MeshSequenceReader {
+public:
+	MeshSequenceReader();
+
+	bool load(const string &fileName);
+	void close();
+	bool isLoaded() const;
+
+	int getNumFrames() const;
+	int getNumVertices() const;
+	bool hasNormals() const;
+	uint64_t getTimestamp(int frame) const;
+
+	// Fills mesh with the topology and the vertex data of any frame,
+	// decoding forward from the closest preceding keyframe
+	bool getFrame(int frame, ofMesh &mesh);
+
+private:
+	bool readIndexFromFooter();
+	bool rebuildIndex(uint64_t firstFrameOffset);
+	bool decodeFrame(int frame);
+
+	ifstream myFile;
+	int myNumVertices;
+	ofPrimitiveMode myMode;
+	bool myHasNormals;
+	vector<ofIndexType> myIndices;
+	vector<MeshFrameIndexEntry> myIndex;
+
+	int myCurrentFrame;
+	vec3 myBoxMin;
+	vec3 myBoxMax;
+	vector<uint16_t> myQuantized;
+	vector<int32_t> myResiduals;
+	vector<uint8_t> myPayload;
+};
@@ -0,0 +1,257 @@
+#include "MeshStreamPublisher.h"
+
+#ifndef TARGET_WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(vec3) == 3 * sizeof(float), "vertices are copied as packed floats");
+static_assert(sizeof(ofIndexType) == sizeof(uint32_t), "indices are copied as 32 bit values");
+
+// Frame layout inside a slot, the slot header gets a page to itself
+static uint64_t getVerticesOffset() {
+	return meshStreamPageSize;
+}
+
+static uint64_t getNormalsOffset(uint32_t maxVertices) {
+	return getVerticesOffset() + alignToMeshStreamPage(uint64_t(maxVertices) * sizeof(vec3));
+}
+
+static uint64_t getIndicesOffset(uint32_t maxVertices) {
+	return getNormalsOffset(maxVertices) + alignToMeshStreamPage(uint64_t(maxVertices) * sizeof(vec3));
+}
+
+#ifndef TARGET_WIN32
+//--------------------------------------------------------------
+// Whether an existing stream was left behind: never finished setting
+// up, from another version, or its publisher is no longer running.
+// ownerPid is set to the live publisher otherwise.
+static bool isStaleStream(const string &name, int &ownerPid) {
+	ownerPid = 0;
+
+	// A publisher starting at the same time may not have sized the
+	// memory or written the magic yet, it gets a second to finish
+	const int maxAttempts = 100;
+	for (int attempt = 0; attempt < maxAttempts; attempt++) {
+		if (attempt > 0) {
+			usleep(10000);
+		}
+		int fd = shm_open(name.c_str(), O_RDONLY, 0);
+		if (fd < 0) {
+			return errno == ENOENT;
+		}
+		struct stat info;
+		void *memory = MAP_FAILED;
+		if (fstat(fd, &info) == 0 && size_t(info.st_size) >= sizeof(MeshStreamHeader)) {
+			memory = mmap(nullptr, sizeof(MeshStreamHeader), PROT_READ, MAP_SHARED, fd, 0);
+		}
+		close(fd);
+		if (memory == MAP_FAILED) {
+			continue;
+		}
+
+		const MeshStreamHeader *header = static_cast<const MeshStreamHeader *>(memory);
+		bool finished = memcmp(header->magic, meshStreamMagic, sizeof(meshStreamMagic)) == 0;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		bool stale = true;
+		if (finished && header->version == meshStreamVersion) {
+			ownerPid = header->ownerPid;
+			stale = ownerPid <= 0 || (kill(ownerPid, 0) != 0 && errno == ESRCH);
+		}
+		munmap(memory, sizeof(MeshStreamHeader));
+		if (finished) {
+			return stale;
+		}
+	}
+	return true;
+}
+#endif
+
+//--------------------------------------------------------------
+MeshStreamPublisher::MeshStreamPublisher() :
+	myMemory(nullptr), mySize(0), myHeader(nullptr), myNextFrame(0), myTopologyVersion(0),
+	myWarnedCapacity(false) {
+}
+
+//--------------------------------------------------------------
+MeshStreamPublisher::~MeshStreamPublisher() {
+	stop();
+}
+
+//--------------------------------------------------------------
+bool MeshStreamPublisher::start(const string &name, int maxVertices, int maxIndices, int numSlots) {
+	stop();
+#ifdef TARGET_WIN32
+	ofLogError("MeshStreamPublisher::start") << "shared memory streams need POSIX shared memory";
+	return false;
+#else
+	numSlots = ofClamp(numSlots, 2, 16);
+	uint64_t slotSize = getIndicesOffset(maxVertices) + alignToMeshStreamPage(uint64_t(maxIndices) * sizeof(uint32_t));
+	uint64_t slotOffset = alignToMeshStreamPage(sizeof(MeshStreamHeader));
+	size_t size = slotOffset + numSlots * slotSize;
+
+	// A stream left behind by a crashed run is replaced, readers still
+	// mapping it keep their copy until they reopen. A live stream is
+	// never taken over.
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0 && errno == EEXIST) {
+		int ownerPid;
+		if (!isStaleStream(name, ownerPid)) {
+			ofLogError("MeshStreamPublisher::start") << name << " is already published by process " << ownerPid;
+			return false;
+		}
+		ofLogWarning("MeshStreamPublisher::start") << "replacing the stale stream " << name;
+		shm_unlink(name.c_str());
+		fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	}
+	if (fd < 0) {
+		ofLogError("MeshStreamPublisher::start") << "could not create shared memory " << name << ": " << strerror(errno);
+		return false;
+	}
+	void *memory = MAP_FAILED;
+	if (ftruncate(fd, size) == 0) {
+		memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (memory == MAP_FAILED) {
+		ofLogError("MeshStreamPublisher::start") << "could not map " << size << " bytes of shared memory: " << strerror(errno);
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	myName = name;
+	myMemory = static_cast<uint8_t *>(memory);
+	mySize = size;
+
+	// The new memory is zeroed, the atomics still have to be constructed
+	myHeader = new (myMemory) MeshStreamHeader();
+	myHeader->version = meshStreamVersion;
+	myHeader->numSlots = numSlots;
+	myHeader->slotOffset = slotOffset;
+	myHeader->slotSize = slotSize;
+	myHeader->maxVertices = maxVertices;
+	myHeader->maxIndices = maxIndices;
+	myHeader->ownerPid = getpid();
+	myHeader->latestFrame.store(0);
+	for (int i = 0; i < numSlots; i++) {
+		MeshStreamSlotHeader *slot = new (getSlot(i)) MeshStreamSlotHeader();
+		slot->sequence.store(0);
+		slot->verticesOffset = getVerticesOffset();
+		slot->normalsOffset = getNormalsOffset(maxVertices);
+		slot->indicesOffset = getIndicesOffset(maxVertices);
+	}
+
+	// Readers check the magic, so it goes in last
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(myHeader->magic, meshStreamMagic, sizeof(meshStreamMagic));
+
+	myNextFrame = 0;
+	myTopologyVersion = 0;
+	mySlotTopology.assign(numSlots, UINT32_MAX);
+	myWarnedCapacity = false;
+	ofLogNotice("MeshStreamPublisher::start") << "publishing to " << name << ", " << numSlots << " slots of "
+		<< slotSize / (1024 * 1024) << "MB";
+	return true;
+#endif
+}
+
+//--------------------------------------------------------------
+void MeshStreamPublisher::stop() {
+	if (!myMemory) {
+		return;
+	}
+#ifndef TARGET_WIN32
+	munmap(myMemory, mySize);
+	shm_unlink(myName.c_str());
+#endif
+	myMemory = nullptr;
+	myHeader = nullptr;
+	mySize = 0;
+}
+
+//--------------------------------------------------------------
+bool MeshStreamPublisher::isPublishing() const {
+	return myHeader != nullptr;
+}
+
+//--------------------------------------------------------------
+int MeshStreamPublisher::getNumFramesPublished() const {
+	return myNextFrame;
+}
+
+//--------------------------------------------------------------
+uint8_t *MeshStreamPublisher::getSlot(int slot) const {
+	return myMemory + myHeader->slotOffset + slot * myHeader->slotSize;
+}
+
+//--------------------------------------------------------------
+bool MeshStreamPublisher::hasTopologyChanged(const ofMesh &mesh) {
+	if (myNextFrame == 0) {
+		return true;
+	}
+
+	// The previous frame's slot always holds the current topology, so
+	// the indices are compared there instead of keeping another copy
+	uint8_t *slot = getSlot((myNextFrame - 1) % myHeader->numSlots);
+	const MeshStreamSlotHeader *previous = reinterpret_cast<const MeshStreamSlotHeader *>(slot);
+	return previous->numIndices != mesh.getNumIndices() || previous->primitiveMode != uint32_t(mesh.getMode()) ||
+		memcmp(slot + previous->indicesOffset, mesh.getIndices().data(), mesh.getNumIndices() * sizeof(uint32_t)) != 0;
+}
+
+//--------------------------------------------------------------
+bool MeshStreamPublisher::publish(const ofMesh &mesh, uint64_t timestampMicros) {
+	if (!myHeader) {
+		return false;
+	}
+
+	size_t numVertices = mesh.getNumVertices();
+	size_t numIndices = mesh.getNumIndices();
+	if (numVertices > myHeader->maxVertices || numIndices > myHeader->maxIndices) {
+		if (!myWarnedCapacity) {
+			ofLogWarning("MeshStreamPublisher::publish") << "mesh with " << numVertices << " vertices and " << numIndices
+				<< " indices doesn't fit the stream, skipping frames until it does";
+			myWarnedCapacity = true;
+		}
+		return false;
+	}
+	bool hasNormals = mesh.getNumNormals() == numVertices;
+
+	if (hasTopologyChanged(mesh)) {
+		myTopologyVersion++;
+	}
+
+	uint64_t frame = myNextFrame;
+	int slotIndex = frame % myHeader->numSlots;
+	uint8_t *slot = getSlot(slotIndex);
+	MeshStreamSlotHeader *slotHeader = reinterpret_cast<MeshStreamSlotHeader *>(slot);
+
+	// Odd while writing, readers that started on the old frame see the
+	// change when they check the sequence again
+	slotHeader->sequence.store(2 * frame + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slotHeader->frameNumber = frame;
+	slotHeader->timestamp = timestampMicros;
+	slotHeader->topologyVersion = myTopologyVersion;
+	slotHeader->numVertices = numVertices;
+	slotHeader->numIndices = numIndices;
+	slotHeader->primitiveMode = mesh.getMode();
+	slotHeader->flags = hasNormals ? meshStreamHasNormals : 0;
+
+	memcpy(slot + slotHeader->verticesOffset, mesh.getVertices().data(), numVertices * sizeof(vec3));
+	if (hasNormals) {
+		memcpy(slot + slotHeader->normalsOffset, mesh.getNormals().data(), numVertices * sizeof(vec3));
+	}
+	if (mySlotTopology[slotIndex] != myTopologyVersion) {
+		memcpy(slot + slotHeader->indicesOffset, mesh.getIndices().data(), numIndices * sizeof(uint32_t));
+		mySlotTopology[slotIndex] = myTopologyVersion;
+	}
+
+	slotHeader->sequence.store(2 * frame + 2, std::memory_order_release);
+	myHeader->latestFrame.store(frame + 1, std::memory_order_release);
+	myNextFrame++;
+	return true;
+}
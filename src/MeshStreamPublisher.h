@@ -0,0 +1,43 @@
+#pragma once
+
+#include "ofMain.h"
+#include "meshStreamFormat.h"
+
+using namespace glm;
+
+// Publishes each frame's mesh to POSIX shared memory so other processes
+// on the machine (renderers, recorders) can use it without files. See
+// meshStreamFormat.h for the ring layout and MeshStreamReader for the
+// reading side.
+//
+// The capacity is fixed when the stream starts, frames with more
+// vertices or indices are skipped with a warning.
+class MeshStreamPublisher {
+public:
+	MeshStreamPublisher();
+	~MeshStreamPublisher();
+
+	bool start(const string &name, int maxVertices, int maxIndices, int numSlots = 3);
+	void stop();
+	bool isPublishing() const;
+
+	// Copies the mesh into the next slot, returns false if it was skipped
+	bool publish(const ofMesh &mesh, uint64_t timestampMicros);
+
+	int getNumFramesPublished() const;
+
+private:
+	uint8_t *getSlot(int slot) const;
+	bool hasTopologyChanged(const ofMesh &mesh);
+
+	string myName;
+	uint8_t *myMemory;
+	size_t mySize;
+	MeshStreamHeader *myHeader;
+	uint64_t myNextFrame;
+
+	// Topology version of the newest frame, and the one each slot holds
+	uint32_t myTopologyVersion;
+	vector<uint32_t> mySlotTopology;
+	bool myWarnedCapacity;
+};
@@ -0,0 +1,120 @@
+#include "MeshStreamReader.h"
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//--------------------------------------------------------------
+MeshStreamReader::MeshStreamReader() :
+	myMemory(nullptr), mySize(0), myHeader(nullptr) {
+}
+
+//--------------------------------------------------------------
+MeshStreamReader::~MeshStreamReader() {
+	close();
+}
+
+//--------------------------------------------------------------
+bool MeshStreamReader::open(const std::string &name) {
+	close();
+#ifdef _WIN32
+	return false;
+#else
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat info;
+	void *memory = MAP_FAILED;
+	if (fstat(fd, &info) == 0 && size_t(info.st_size) >= sizeof(MeshStreamHeader)) {
+		memory = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	::close(fd);
+	if (memory == MAP_FAILED) {
+		return false;
+	}
+	myMemory = static_cast<const uint8_t *>(memory);
+	mySize = info.st_size;
+	myHeader = reinterpret_cast<const MeshStreamHeader *>(myMemory);
+
+	// The magic is written last by the publisher
+	bool valid = memcmp(myHeader->magic, meshStreamMagic, sizeof(meshStreamMagic)) == 0;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	valid = valid && myHeader->version == meshStreamVersion && myHeader->numSlots > 0 &&
+		myHeader->slotOffset + myHeader->numSlots * myHeader->slotSize <= mySize;
+	if (!valid) {
+		close();
+		return false;
+	}
+	return true;
+#endif
+}
+
+//--------------------------------------------------------------
+void MeshStreamReader::close() {
+#ifndef _WIN32
+	if (myMemory) {
+		munmap((void *)myMemory, mySize);
+	}
+#endif
+	myMemory = nullptr;
+	myHeader = nullptr;
+	mySize = 0;
+}
+
+//--------------------------------------------------------------
+bool MeshStreamReader::isOpen() const {
+	return myHeader != nullptr;
+}
+
+//--------------------------------------------------------------
+bool MeshStreamReader::getLatestFrame(MeshStreamFrame &frame) const {
+	if (!myHeader) {
+		return false;
+	}
+
+	// If the producer laps the slot between reading latestFrame and the
+	// sequence, start again from the new latest frame
+	for (int attempt = 0; attempt < 4; attempt++) {
+		uint64_t latest = myHeader->latestFrame.load(std::memory_order_acquire);
+		if (latest == 0) {
+			return false;
+		}
+		uint64_t frameNumber = latest - 1;
+		const uint8_t *slot = myMemory + myHeader->slotOffset + (frameNumber % myHeader->numSlots) * myHeader->slotSize;
+		const MeshStreamSlotHeader *slotHeader = reinterpret_cast<const MeshStreamSlotHeader *>(slot);
+
+		uint64_t sequence = slotHeader->sequence.load(std::memory_order_acquire);
+		if (sequence != 2 * frameNumber + 2) {
+			continue;
+		}
+
+		frame.frameNumber = slotHeader->frameNumber;
+		frame.timestamp = slotHeader->timestamp;
+		frame.topologyVersion = slotHeader->topologyVersion;
+		frame.numVertices = slotHeader->numVertices;
+		frame.numIndices = slotHeader->numIndices;
+		frame.primitiveMode = slotHeader->primitiveMode;
+		frame.vertices = reinterpret_cast<const float *>(slot + slotHeader->verticesOffset);
+		frame.normals = (slotHeader->flags & meshStreamHasNormals) ? reinterpret_cast<const float *>(slot + slotHeader->normalsOffset) : nullptr;
+		frame.indices = reinterpret_cast<const uint32_t *>(slot + slotHeader->indicesOffset);
+		frame.slot = slotHeader;
+		frame.sequence = sequence;
+
+		// The header fields have to belong to the same frame too
+		if (isFrameValid(frame) && frame.numVertices <= myHeader->maxVertices && frame.numIndices <= myHeader->maxIndices) {
+			return true;
+		}
+	}
+	return false;
+}
+
+//--------------------------------------------------------------
+bool MeshStreamReader::isFrameValid(const MeshStreamFrame &frame) const {
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return frame.slot && frame.slot->sequence.load(std::memory_order_relaxed) == frame.sequence;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// Reading side of the shared memory mesh stream, for other processes.
+// Only needs meshStreamFormat.h and this class, no openFrameworks.
+//
+//   MeshStreamReader reader;
+//   reader.open();
+//   MeshStreamFrame frame;
+//   if (reader.getLatestFrame(frame) && frame.frameNumber != lastFrame) {
+//       upload(frame.vertices, frame.normals, frame.numVertices);
+//       if (frame.topologyVersion != lastTopology) {
+//           uploadIndices(frame.indices, frame.numIndices);
+//       }
+//       if (reader.isFrameValid(frame)) {
+//           // nothing was overwritten while copying, use it
+//       }
+//   }
+//
+// Frames are read in place, the pointers stay valid until the reader is
+// closed but the data behind them is only guaranteed to be the frame's
+// while isFrameValid() returns true. The producer never waits for
+// readers.
+
+#include "meshStreamFormat.h"
+#include <string>
+
+struct MeshStreamFrame {
+	uint64_t frameNumber;
+	uint64_t timestamp;
+	uint32_t topologyVersion;
+	uint32_t numVertices;
+	uint32_t numIndices;
+	uint32_t primitiveMode;
+
+	// x, y, z per vertex; normals is null if the mesh has none
+	const float *vertices;
+	const float *normals;
+	const uint32_t *indices;
+
+	// Where and which version of the slot the frame was read from
+	const MeshStreamSlotHeader *slot;
+	uint64_t sequence;
+};
+
+class MeshStreamReader {
+public:
+	MeshStreamReader();
+	~MeshStreamReader();
+
+	bool open(const std::string &name = MESH_STREAM_DEFAULT_NAME);
+	void close();
+	bool isOpen() const;
+
+	// Newest complete frame, false if there is none yet
+	bool getLatestFrame(MeshStreamFrame &frame) const;
+
+	// False if the producer has started overwriting the frame's slot
+	bool isFrameValid(const MeshStreamFrame &frame) const;
+
+private:
+	const uint8_t *myMemory;
+	size_t mySize;
+	const MeshStreamHeader *myHeader;
+};
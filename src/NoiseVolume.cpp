@@ -0,0 +1,279 @@
+#include "NoiseVolume.h"
+#include "helpers.h"
+#include "parallel.h"
+
+static const char noiseVolumeMagic[8] = { 'B', 'S', 'N', 'O', 'I', 'S', 'E', '1' };
+static const uint32_t noiseVolumeVersion = 1;
+
+//--------------------------------------------------------------
+template<typename T>
+static void writeValue(ostream &stream, const T &value) {
+	stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+//--------------------------------------------------------------
+template<typename T>
+static bool readValue(istream &stream, T &value) {
+	stream.read(reinterpret_cast<char *>(&value), sizeof(T));
+	return bool(stream);
+}
+
+//--------------------------------------------------------------
+NoiseVolume::NoiseVolume() :
+	myResolution(0), myMask(0), myPeriod(0), myVoxelsPerUnit(0), myNumChannels(0), myNumOctaves(0),
+	myMaxError(0), myRmsError(0) {
+}
+
+//--------------------------------------------------------------
+bool NoiseVolume::setup(const string &cachePath, int resolution, float period, int numChannels, int numOctaves) {
+	if (load(cachePath) && myResolution == int(ofNextPow2(resolution)) && myPeriod == period &&
+		myNumChannels == numChannels && myNumOctaves == numOctaves) {
+		return true;
+	}
+
+	build(resolution, period, numChannels, numOctaves);
+	return save(cachePath);
+}
+
+//--------------------------------------------------------------
+void NoiseVolume::build(int resolution, float period, int numChannels, int numOctaves) {
+	uint64_t startTime = ofGetElapsedTimeMicros();
+
+	myResolution = ofNextPow2(max(resolution, 2));
+	myMask = myResolution - 1;
+	myPeriod = period;
+	myVoxelsPerUnit = myResolution / myPeriod;
+	myNumChannels = ofClamp(numChannels, 1, 4);
+	myNumOctaves = max(numOctaves, 1);
+	myData.resize(size_t(myResolution) * myResolution * myResolution * myNumChannels);
+
+	// One z slice per task, each voxel only writes its own values
+	float voxelSize = 1 / myVoxelsPerUnit;
+	parallelFor(0, myResolution, [&](int begin, int end) {
+		for (int z = begin; z < end; z++) {
+			for (int y = 0; y < myResolution; y++) {
+				for (int x = 0; x < myResolution; x++) {
+					float *voxel = myData.data() + ((size_t(z) * myResolution + y) * myResolution + x) * myNumChannels;
+					evaluate(vec3(x, y, z) * voxelSize, voxel);
+				}
+			}
+		}
+	}, 1);
+
+	measureError();
+	ofLogNotice("NoiseVolume::build") << myResolution << "^3 x " << myNumChannels << " channels, " << myNumOctaves
+		<< " octaves in " << (ofGetElapsedTimeMicros() - startTime) / 1000 << "ms, max error " << myMaxError
+		<< ", rms error " << myRmsError;
+}
+
+//--------------------------------------------------------------
+void NoiseVolume::evaluateNoise(const vec3 &p, float *values) const {
+	switch (myNumChannels) {
+	case 1: {
+		values[0] = fbm(p, myNumOctaves);
+		break;
+	}
+	case 2: {
+		vec2 v = fbm_vec2(p, myNumOctaves);
+		values[0] = v.x;
+		values[1] = v.y;
+		break;
+	}
+	case 3: {
+		vec3 v = fbm_vec3(p, myNumOctaves);
+		values[0] = v.x;
+		values[1] = v.y;
+		values[2] = v.z;
+		break;
+	}
+	default: {
+		vec4 v = fbm_vec4(p, myNumOctaves);
+		values[0] = v.x;
+		values[1] = v.y;
+		values[2] = v.z;
+		values[3] = v.w;
+		break;
+	}
+	}
+}
+
+//--------------------------------------------------------------
+void NoiseVolume::evaluate(const vec3 &p, float *values) const {
+	// Position within the period
+	vec3 q = p - myPeriod * floor(p / myPeriod);
+	vec3 t = q / myPeriod;
+
+	for (int c = 0; c < myNumChannels; c++) {
+		values[c] = 0;
+	}
+
+	// Blend the 8 copies of the noise one period apart. At q = 0 only
+	// the noise at q counts and at q = period only the noise at
+	// q - period, which is the same point, so the result is periodic.
+	float sumSquaredWeights = 0;
+	for (int corner = 0; corner < 8; corner++) {
+		vec3 shift((corner & 1) ? myPeriod : 0, (corner & 2) ? myPeriod : 0, (corner & 4) ? myPeriod : 0);
+		float weight =
+			((corner & 1) ? t.x : 1 - t.x) *
+			((corner & 2) ? t.y : 1 - t.y) *
+			((corner & 4) ? t.z : 1 - t.z);
+		if (weight == 0) {
+			continue;
+		}
+
+		float noise[4];
+		evaluateNoise(q - shift, noise);
+		for (int c = 0; c < myNumChannels; c++) {
+			values[c] += weight * noise[c];
+		}
+		sumSquaredWeights += weight * weight;
+	}
+
+	// Blending independent noise values lowers the contrast, most of all
+	// in the middle of the period, scale it back up
+	float normalize = 1 / sqrtf(sumSquaredWeights);
+	for (int c = 0; c < myNumChannels; c++) {
+		values[c] *= normalize;
+	}
+}
+
+//--------------------------------------------------------------
+void NoiseVolume::measureError() {
+	// Deterministic points so the logged error is the same every run
+	const int numSamples = 4096;
+	uint32_t state = 12345;
+	auto random = [&state]() {
+		state = state * 1664525 + 1013904223;
+		return (state >> 8) / float(1 << 24);
+	};
+
+	double sumSquared = 0;
+	myMaxError = 0;
+	for (int i = 0; i < numSamples; i++) {
+		vec3 p = vec3(random(), random(), random()) * myPeriod;
+		float exact[4];
+		evaluate(p, exact);
+		for (int c = 0; c < myNumChannels; c++) {
+			float error = fabsf(lookup(p, c) - exact[c]);
+			myMaxError = max(myMaxError, error);
+			sumSquared += error * error;
+		}
+	}
+	myRmsError = sqrt(sumSquared / (numSamples * myNumChannels));
+}
+
+//--------------------------------------------------------------
+void NoiseVolume::lookup(const vec3 *points, size_t count, float *values, int channel) const {
+	parallelFor(0, count, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			values[i] = lookup(points[i], channel);
+		}
+	});
+}
+
+//--------------------------------------------------------------
+void NoiseVolume::lookup3(const vec3 *points, size_t count, vec3 *values) const {
+	parallelFor(0, count, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			values[i] = lookup3(points[i]);
+		}
+	});
+}
+
+//--------------------------------------------------------------
+bool NoiseVolume::save(const string &fileName) const {
+	ofstream file(ofToDataPath(fileName), ios::binary | ios::trunc);
+	if (!file) {
+		ofLogError("NoiseVolume::save") << "could not open " << fileName;
+		return false;
+	}
+
+	file.write(noiseVolumeMagic, sizeof(noiseVolumeMagic));
+	writeValue(file, noiseVolumeVersion);
+	writeValue(file, uint32_t(myResolution));
+	writeValue(file, uint32_t(myNumChannels));
+	writeValue(file, uint32_t(myNumOctaves));
+	writeValue(file, myPeriod);
+	writeValue(file, myMaxError);
+	writeValue(file, myRmsError);
+	file.write(reinterpret_cast<const char *>(myData.data()), myData.size() * sizeof(float));
+	return bool(file);
+}
+
+//--------------------------------------------------------------
+bool NoiseVolume::load(const string &fileName) {
+	ifstream file(ofToDataPath(fileName), ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	char magic[8];
+	uint32_t version, resolution, numChannels, numOctaves;
+	float period, maxError, rmsError;
+	file.read(magic, sizeof(magic));
+	if (!file || memcmp(magic, noiseVolumeMagic, sizeof(magic)) != 0 ||
+		!readValue(file, version) || version != noiseVolumeVersion ||
+		!readValue(file, resolution) || !readValue(file, numChannels) || !readValue(file, numOctaves) ||
+		!readValue(file, period) || !readValue(file, maxError) || !readValue(file, rmsError)) {
+		ofLogError("NoiseVolume::load") << fileName << " is not a noise volume";
+		return false;
+	}
+	if (resolution < 2 || (resolution & (resolution - 1)) != 0 || resolution > 1024 ||
+		numChannels < 1 || numChannels > 4 || !(period > 0)) {
+		ofLogError("NoiseVolume::load") << fileName << " has an invalid header";
+		return false;
+	}
+
+	vector<float> data(size_t(resolution) * resolution * resolution * numChannels);
+	file.read(reinterpret_cast<char *>(data.data()), data.size() * sizeof(float));
+	if (!file) {
+		ofLogError("NoiseVolume::load") << fileName << " is truncated";
+		return false;
+	}
+
+	myResolution = resolution;
+	myMask = myResolution - 1;
+	myPeriod = period;
+	myVoxelsPerUnit = myResolution / myPeriod;
+	myNumChannels = numChannels;
+	myNumOctaves = numOctaves;
+	myMaxError = maxError;
+	myRmsError = rmsError;
+	myData.swap(data);
+	return true;
+}
+
+//--------------------------------------------------------------
+bool NoiseVolume::isBuilt() const {
+	return !myData.empty();
+}
+
+//--------------------------------------------------------------
+int NoiseVolume::getResolution() const {
+	return myResolution;
+}
+
+//--------------------------------------------------------------
+float NoiseVolume::getPeriod() const {
+	return myPeriod;
+}
+
+//--------------------------------------------------------------
+int NoiseVolume::getNumChannels() const {
+	return myNumChannels;
+}
+
+//--------------------------------------------------------------
+int NoiseVolume::getNumOctaves() const {
+	return myNumOctaves;
+}
+
+//--------------------------------------------------------------
+float NoiseVolume::getMaxError() const {
+	return myMaxError;
+}
+
+//--------------------------------------------------------------
+float NoiseVolume::getRmsError() const {
+	return myRmsError;
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "ofMain.h"
+
+using namespace glm;
+
+// fbm noise from helpers.h baked into a tileable grid, one period of
+// noise space with lookups wrapping around it
+class NoiseVolume {
+public:
+	NoiseVolume();
+
+	// Loads the volume from cachePath if it was baked with the same
+	// parameters, otherwise bakes it and saves it there
+	bool setup(const string &cachePath, int resolution, float period, int numChannels, int numOctaves);
+
+	// Resolution is rounded up to a power of two, channels are 1 to 4.
+	// Voxels are baked in parallel.
+	void build(int resolution, float period, int numChannels, int numOctaves);
+	bool load(const string &fileName);
+	bool save(const string &fileName) const;
+
+	bool isBuilt() const;
+	int getResolution() const;
+	float getPeriod() const;
+	int getNumChannels() const;
+	int getNumOctaves() const;
+
+	// Measured by build(), against the exact tileable noise
+	float getMaxError() const;
+	float getRmsError() const;
+
+	// Trilinear lookups, p in noise space. lookup3 returns channels 0-2
+	// and needs at least 3 channels.
+	inline float lookup(const vec3 &p, int channel = 0) const;
+	inline vec3 lookup3(const vec3 &p) const;
+
+	// The same with the exact derivatives of the interpolation, the
+	// gradient and the Jacobian with one column per axis
+	inline float lookup(const vec3 &p, vec3 &gradient, int channel = 0) const;
+	inline vec3 lookup3(const vec3 &p, mat3 &jacobian) const;
+
+	// Lookups for a whole array of points, split across all cores
+	void lookup(const vec3 *points, size_t count, float *values, int channel = 0) const;
+	void lookup3(const vec3 *points, size_t count, vec3 *values) const;
+
+	// The exact value that voxels and lookups approximate
+	void evaluate(const vec3 &p, float *values) const;
+
+private:
+	struct Cell {
+		int offsets[8];
+		float tx, ty, tz;
+	};
+	inline void getCell(const vec3 &p, Cell &cell) const;
+	void evaluateNoise(const vec3 &p, float *values) const;
+	void measureError();
+
+	int myResolution;
+	int myMask;
+	float myPeriod;
+	float myVoxelsPerUnit;
+	int myNumChannels;
+	int myNumOctaves;
+	vector<float> myData;
+	float myMaxError;
+	float myRmsError;
+};
+
+//--------------------------------------------------------------
+inline void NoiseVolume::getCell(const vec3 &p, Cell &cell) const {
+	float u = p.x * myVoxelsPerUnit;
+	float v = p.y * myVoxelsPerUnit;
+	float w = p.z * myVoxelsPerUnit;
+
+	// Floor without a library call, truncating rounds negative values up
+	int iu = int(u) - (u < 0 && u != int(u));
+	int iv = int(v) - (v < 0 && v != int(v));
+	int iw = int(w) - (w < 0 && w != int(w));
+	cell.tx = u - iu;
+	cell.ty = v - iv;
+	cell.tz = w - iw;
+
+	// The resolution is a power of two, so masking wraps negative
+	// coordinates too
+	int x0 = iu & myMask;
+	int y0 = iv & myMask;
+	int z0 = iw & myMask;
+	int x1 = (x0 + 1) & myMask;
+	int y1 = (y0 + 1) & myMask;
+	int z1 = (z0 + 1) & myMask;
+
+	int row = myResolution;
+	int slice = myResolution * myResolution;
+	int c = myNumChannels;
+	cell.offsets[0] = (z0 * slice + y0 * row + x0) * c;
+	cell.offsets[1] = (z0 * slice + y0 * row + x1) * c;
+	cell.offsets[2] = (z0 * slice + y1 * row + x0) * c;
+	cell.offsets[3] = (z0 * slice + y1 * row + x1) * c;
+	cell.offsets[4] = (z1 * slice + y0 * row + x0) * c;
+	cell.offsets[5] = (z1 * slice + y0 * row + x1) * c;
+	cell.offsets[6] = (z1 * slice + y1 * row + x0) * c;
+	cell.offsets[7] = (z1 * slice + y1 * row + x1) * c;
+}
+
+//--------------------------------------------------------------
+inline float NoiseVolume::lookup(const vec3 &p, int channel) const {
+	Cell cell;
+	getCell(p, cell);
+	const float *d = myData.data() + channel;
+	const int *o = cell.offsets;
+	float y0 = mix(mix(d[o[0]], d[o[1]], cell.tx), mix(d[o[2]], d[o[3]], cell.tx), cell.ty);
+	float y1 = mix(mix(d[o[4]], d[o[5]], cell.tx), mix(d[o[6]], d[o[7]], cell.tx), cell.ty);
+	return mix(y0, y1, cell.tz);
+}
+
+//--------------------------------------------------------------
+inline vec3 NoiseVolume::lookup3(const vec3 &p) const {
+	Cell cell;
+	getCell(p, cell);
+	const float *d = myData.data();
+	vec3 corners[8];
+	for (int i = 0; i < 8; i++) {
+		const float *voxel = d + cell.offsets[i];
+		corners[i] = vec3(voxel[0], voxel[1], voxel[2]);
+	}
+	vec3 y0 = mix(mix(corners[0], corners[1], cell.tx), mix(corners[2], corners[3], cell.tx), cell.ty);
+	vec3 y1 = mix(mix(corners[4], corners[5], cell.tx), mix(corners[6], corners[7], cell.tx), cell.ty);
+	return mix(y0, y1, cell.tz);
+}
+
+//--------------------------------------------------------------
+inline float NoiseVolume::lookup(const vec3 &p, vec3 &gradient, int channel) const {
+	Cell cell;
+	getCell(p, cell);
+	const float *d = myData.data() + channel;
+	const int *o = cell.offsets;
+	float x00 = mix(d[o[0]], d[o[1]], cell.tx);
+	float x10 = mix(d[o[2]], d[o[3]], cell.tx);
+	float x01 = mix(d[o[4]], d[o[5]], cell.tx);
+	float x11 = mix(d[o[6]], d[o[7]], cell.tx);
+	float y0 = mix(x00, x10, cell.ty);
+	float y1 = mix(x01, x11, cell.ty);
+
+	// Each derivative is the difference across the cell along its axis,
+	// interpolated along the other two
+	float dx0 = mix(d[o[1]] - d[o[0]], d[o[3]] - d[o[2]], cell.ty);
+	float dx1 = mix(d[o[5]] - d[o[4]], d[o[7]] - d[o[6]], cell.ty);
+	gradient.x = mix(dx0, dx1, cell.tz) * myVoxelsPerUnit;
+	gradient.y = mix(x10 - x00, x11 - x01, cell.tz) * myVoxelsPerUnit;
+	gradient.z = (y1 - y0) * myVoxelsPerUnit;
+	return mix(y0, y1, cell.tz);
+}
+
+//--------------------------------------------------------------
+inline vec3 NoiseVolume::lookup3(const vec3 &p, mat3 &jacobian) const {
+	Cell cell;
+	getCell(p, cell);
+	const float *d = myData.data();
+	vec3 corners[8];
+	for (int i = 0; i < 8; i++) {
+		const float *voxel = d + cell.offsets[i];
+		corners[i] = vec3(voxel[0], voxel[1], voxel[2]);
+	}
+	vec3 x00 = mix(corners[0], corners[1], cell.tx);
+	vec3 x10 = mix(corners[2], corners[3], cell.tx);
+	vec3 x01 = mix(corners[4], corners[5], cell.tx);
+	vec3 x11 = mix(corners[6], corners[7], cell.tx);
+	vec3 y0 = mix(x00, x10, cell.ty);
+	vec3 y1 = mix(x01, x11, cell.ty);
+
+	vec3 dx0 = mix(corners[1] - corners[0], corners[3] - corners[2], cell.ty);
+	vec3 dx1 = mix(corners[5] - corners[4], corners[7] - corners[6], cell.ty);
+	jacobian[0] = mix(dx0, dx1, cell.tz) * myVoxelsPerUnit;
+	jacobian[1] = mix(x10 - x00, x11 - x01, cell.tz) * myVoxelsPerUnit;
+	jacobian[2] = (y1 - y0) * myVoxelsPerUnit;
+	return mix(y0, y1, cell.tz);
+}
@@ -0,0 +1,352 @@
+#include "OutlierFilter.h"
+#include "parallel.h"
+
+static const int maxNeighbours = 32;
+
+// Enough for 32 neighbours in a square window around a grid point
+static const int maxWindowRadius = 3;
+
+// Per block sums are added up in order, so the statistics don't depend
+// on how the work was split
+static const int statsBlockSize = 65536;
+
+//--------------------------------------------------------------
+static inline uint32_t hashCell(int x, int y, int z) {
+	return (uint32_t(x) * 73856093u) ^ (uint32_t(y) * 19349663u) ^ (uint32_t(z) * 83492791u);
+}
+
+//--------------------------------------------------------------
+static inline void getCell(const vec3 &p, const vec3 &low, float cellSize, int &x, int &y, int &z) {
+	vec3 cell = (p - low) / cellSize;
+	x = int(cell.x);
+	y = int(cell.y);
+	z = int(cell.z);
+}
+
+//--------------------------------------------------------------
+// Adds a squared distance to the k smallest seen so far, kept sorted
+// in best. Without branches, which the CPU would mostly mispredict.
+static inline void insertDistance(float *best, int k, float d2) {
+	for (int i = k - 1; i > 0; i--) {
+		best[i] = max(best[i - 1], min(d2, best[i]));
+	}
+	best[0] = min(d2, best[0]);
+}
+
+//--------------------------------------------------------------
+OutlierFilter::OutlierFilter() :
+	myNumNeighbours(8), myThreshold(2.0), myMeanDistance(0), myDistanceDeviation(0), myNumOutliers(0), myTime(0) {
+}
+
+//--------------------------------------------------------------
+void OutlierFilter::setNumNeighbours(int numNeighbours) {
+	myNumNeighbours = ofClamp(numNeighbours, 1, maxNeighbours);
+}
+
+//--------------------------------------------------------------
+int OutlierFilter::getNumNeighbours() const {
+	return myNumNeighbours;
+}
+
+//--------------------------------------------------------------
+void OutlierFilter::setThreshold(float threshold) {
+	myThreshold = threshold;
+}
+
+//--------------------------------------------------------------
+float OutlierFilter::getThreshold() const {
+	return myThreshold;
+}
+
+//--------------------------------------------------------------
+int OutlierFilter::findGridOutliers(const vec3 *positions, const uint8_t *valid, int width, int height, uint8_t *outliers) {
+	uint64_t startTime = ofGetElapsedTimeMicros();
+	int numPoints = width * height;
+	myDistances.resize(numPoints);
+
+	// The smallest square window with enough neighbours in it
+	int k = myNumNeighbours;
+	int radius = 1;
+	while ((2 * radius + 1) * (2 * radius + 1) - 1 < k) {
+		radius++;
+	}
+
+	float *distances = myDistances.data();
+	parallelFor(0, width, [&](int begin, int end) {
+		float found[(2 * maxWindowRadius + 1) * (2 * maxWindowRadius + 1)];
+		for (int x = begin; x < end; x++) {
+			for (int y = 0; y < height; y++) {
+				int i = x * height + y;
+				if (valid && !valid[i]) {
+					distances[i] = 0;
+					continue;
+				}
+				int numFound = 0;
+				for (int nx = max(x - radius, 0); nx <= min(x + radius, width - 1); nx++) {
+					for (int ny = max(y - radius, 0); ny <= min(y + radius, height - 1); ny++) {
+						int n = nx * height + ny;
+						if (n == i || (valid && !valid[n])) {
+							continue;
+						}
+						vec3 delta = positions[n] - positions[i];
+						found[numFound++] = dot(delta, delta);
+					}
+				}
+
+				// Usually the window has exactly k neighbours, near the
+				// edges of the data there may be fewer
+				if (numFound > k) {
+					std::nth_element(found, found + k, found + numFound);
+				}
+				int count = min(numFound, k);
+				float sum = 0;
+				for (int j = 0; j < count; j++) {
+					sum += sqrtf(found[j]);
+				}
+				distances[i] = count > 0 ? sum / count : INFINITY;
+			}
+		}
+	}, max(1, 4096 / max(height, 1)));
+
+	int numOutliers = classify(valid, numPoints, outliers);
+	myTime = (ofGetElapsedTimeMicros() - startTime) / 1000.0;
+	return numOutliers;
+}
+
+//--------------------------------------------------------------
+int OutlierFilter::buildCells(const vec3 *positions, int numPoints, const vec3 &low, float cellSize) {
+	int tableSize = 1024;
+	while (tableSize < 2 * numPoints) {
+		tableSize *= 2;
+	}
+	uint32_t mask = tableSize - 1;
+
+	vector<int> buckets(numPoints);
+	parallelFor(0, numPoints, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			int x, y, z;
+			getCell(positions[i], low, cellSize, x, y, z);
+			buckets[i] = hashCell(x, y, z) & mask;
+		}
+	});
+
+	// A counting sort by bucket, keeping the points' order within each
+	myCellStarts.assign(tableSize + 1, 0);
+	for (int i = 0; i < numPoints; i++) {
+		myCellStarts[buckets[i] + 1]++;
+	}
+	int numOccupied = 0;
+	for (int b = 0; b < tableSize; b++) {
+		numOccupied += myCellStarts[b + 1] > 0;
+		myCellStarts[b + 1] += myCellStarts[b];
+	}
+	myCellPoints.resize(numPoints);
+	myCellPositions.resize(numPoints);
+	vector<int> next(myCellStarts.begin(), myCellStarts.end() - 1);
+	for (int i = 0; i < numPoints; i++) {
+		int slot = next[buckets[i]]++;
+		myCellPoints[slot] = i;
+		myCellPositions[slot] = positions[i];
+	}
+	return numOccupied;
+}
+
+//--------------------------------------------------------------
+int OutlierFilter::findOutliers(const vec3 *positions, int numPoints, uint8_t *outliers) {
+	uint64_t startTime = ofGetElapsedTimeMicros();
+	myDistances.resize(numPoints);
+	if (numPoints < 2) {
+		std::fill(outliers, outliers + numPoints, 0);
+		myNumOutliers = 0;
+		return 0;
+	}
+
+	// Bounds, per block of points and then combined
+	int numBlocks = (numPoints + statsBlockSize - 1) / statsBlockSize;
+	vector<vec3> blockMin(numBlocks);
+	vector<vec3> blockMax(numBlocks);
+	parallelFor(0, numBlocks, [&](int begin, int end) {
+		for (int block = begin; block < end; block++) {
+			int first = block * statsBlockSize;
+			int last = min(first + statsBlockSize, numPoints);
+			vec3 low = positions[first];
+			vec3 high = positions[first];
+			for (int i = first + 1; i < last; i++) {
+				low = min(low, positions[i]);
+				high = max(high, positions[i]);
+			}
+			blockMin[block] = low;
+			blockMax[block] = high;
+		}
+	}, 1);
+	vec3 low = blockMin[0];
+	vec3 high = blockMax[0];
+	for (int block = 1; block < numBlocks; block++) {
+		low = min(low, blockMin[block]);
+		high = max(high, blockMax[block]);
+	}
+
+	// Scans are surfaces, so a first guess spreads the points over a
+	// square the size of the bounds. If the cells hold far more or fewer
+	// than k points, the size is corrected once from what they do hold.
+	int k = myNumNeighbours;
+	float extent = max(max(high.x - low.x, high.y - low.y), max(high.z - low.z, 1e-6f));
+	float cellSize = extent * sqrtf(float(k) / numPoints);
+	int numOccupied = buildCells(positions, numPoints, low, cellSize);
+	float pointsPerCell = float(numPoints) / numOccupied;
+	if (pointsPerCell < k * 0.5f || pointsPerCell > k * 2.0f) {
+		cellSize *= ofClamp(sqrtf(k / pointsPerCell), 0.25f, 4.0f);
+		buildCells(positions, numPoints, low, cellSize);
+	}
+
+	// Each bucket's points are nearly always from one cell, and share
+	// their candidate neighbours. Those are copied together once per
+	// cell, so the distances are taken over one short array.
+	int tableSize = myCellStarts.size() - 1;
+	uint32_t mask = tableSize - 1;
+	float *distances = myDistances.data();
+	parallelFor(0, tableSize, [&](int begin, int end) {
+		float best[maxNeighbours + 1];
+		uint32_t cellBuckets[27];
+		vector<vec3> candidates;
+		int cellX = -1;
+		int cellY = -1;
+		int cellZ = -1;
+		for (int bucket = begin; bucket < end; bucket++) {
+			for (int slot = myCellStarts[bucket]; slot < myCellStarts[bucket + 1]; slot++) {
+				const vec3 &p = myCellPositions[slot];
+				int x, y, z;
+				getCell(p, low, cellSize, x, y, z);
+				if (x != cellX || y != cellY || z != cellZ) {
+					cellX = x;
+					cellY = y;
+					cellZ = z;
+
+					// Neighbouring cells may share a bucket, search each once
+					int numBuckets = 0;
+					for (int dx = -1; dx <= 1; dx++) {
+						for (int dy = -1; dy <= 1; dy++) {
+							for (int dz = -1; dz <= 1; dz++) {
+								cellBuckets[numBuckets++] = hashCell(x + dx, y + dy, z + dz) & mask;
+							}
+						}
+					}
+					std::sort(cellBuckets, cellBuckets + numBuckets);
+					numBuckets = std::unique(cellBuckets, cellBuckets + numBuckets) - cellBuckets;
+
+					candidates.clear();
+					for (int b = 0; b < numBuckets; b++) {
+						int first = myCellStarts[cellBuckets[b]];
+						int last = myCellStarts[cellBuckets[b] + 1];
+						candidates.insert(candidates.end(), myCellPositions.begin() + first, myCellPositions.begin() + last);
+					}
+				}
+
+				// Anything further than a cell may not have been searched,
+				// so that's as far as a neighbour can be. The point itself
+				// is among the candidates, it's the first of the k + 1
+				// nearest, at distance 0.
+				std::fill(best, best + k + 1, cellSize * cellSize);
+				int numCandidates = candidates.size();
+				for (int n = 0; n < numCandidates; n++) {
+					vec3 delta = candidates[n] - p;
+					float d2 = dot(delta, delta);
+					if (d2 < best[k]) {
+						insertDistance(best, k + 1, d2);
+					}
+				}
+				float sum = 0;
+				for (int j = 1; j <= k; j++) {
+					sum += sqrtf(best[j]);
+				}
+				distances[myCellPoints[slot]] = sum / k;
+			}
+		}
+	}, 256);
+
+	int numOutliers = classify(nullptr, numPoints, outliers);
+	myTime = (ofGetElapsedTimeMicros() - startTime) / 1000.0;
+	return numOutliers;
+}
+
+//--------------------------------------------------------------
+int OutlierFilter::classify(const uint8_t *valid, int numPoints, uint8_t *outliers) {
+	// Mean and deviation of the distances, leaving out invalid and
+	// isolated points
+	int numBlocks = (numPoints + statsBlockSize - 1) / statsBlockSize;
+	// Kept between calls, so filtering every depth frame doesn't allocate
+	myBlockSums.resize(numBlocks);
+	myBlockSquares.resize(numBlocks);
+	myBlockCounts.resize(numBlocks);
+	double *blockSums = myBlockSums.data();
+	double *blockSquares = myBlockSquares.data();
+	int *blockCounts = myBlockCounts.data();
+	const float *distances = myDistances.data();
+	parallelFor(0, numBlocks, [&](int begin, int end) {
+		for (int block = begin; block < end; block++) {
+			double sum = 0;
+			double squares = 0;
+			int count = 0;
+			for (int i = block * statsBlockSize; i < min((block + 1) * statsBlockSize, numPoints); i++) {
+				if ((!valid || valid[i]) && std::isfinite(distances[i])) {
+					sum += distances[i];
+					squares += double(distances[i]) * distances[i];
+					count++;
+				}
+			}
+			blockSums[block] = sum;
+			blockSquares[block] = squares;
+			blockCounts[block] = count;
+		}
+	}, 1);
+	double sum = 0;
+	double squares = 0;
+	int count = 0;
+	for (int block = 0; block < numBlocks; block++) {
+		sum += blockSums[block];
+		squares += blockSquares[block];
+		count += blockCounts[block];
+	}
+	double mean = count > 0 ? sum / count : 0;
+	double deviation = count > 0 ? sqrt(max(squares / count - mean * mean, 0.0)) : 0;
+	float limit = mean + myThreshold * deviation;
+
+	parallelFor(0, numBlocks, [&](int begin, int end) {
+		for (int block = begin; block < end; block++) {
+			int count = 0;
+			for (int i = block * statsBlockSize; i < min((block + 1) * statsBlockSize, numPoints); i++) {
+				outliers[i] = (!valid || valid[i]) && distances[i] > limit;
+				count += outliers[i];
+			}
+			blockCounts[block] = count;
+		}
+	}, 1);
+	myNumOutliers = 0;
+	for (int block = 0; block < numBlocks; block++) {
+		myNumOutliers += blockCounts[block];
+	}
+
+	myMeanDistance = mean;
+	myDistanceDeviation = deviation;
+	return myNumOutliers;
+}
+
+//--------------------------------------------------------------
+float OutlierFilter::getMeanDistance() const {
+	return myMeanDistance;
+}
+
+//--------------------------------------------------------------
+float OutlierFilter::getDistanceDeviation() const {
+	return myDistanceDeviation;
+}
+
+//--------------------------------------------------------------
+int OutlierFilter::getNumOutliers() const {
+	return myNumOutliers;
+}
+
+//--------------------------------------------------------------
+float OutlierFilter::getTime() const {
+	return myTime;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "ofMain.h"
+
+using namespace glm;
+
+// Finds outlying points, such as the flying pixels at silhouette edges
+// of Kinect depth and stray points in scans.
+//
+// Each point's mean distance to its k nearest neighbours is compared
+// with the same distance over the whole cloud. Points further than
+// threshold standard deviations above the mean are outliers, as are
+// points with no neighbours at all.
+//
+// Depth grids are organized, so the neighbours are the valid grid
+// points in a small window around each point, 3x3 for up to 8 of them.
+// Other clouds are put into a hashed grid of cells sized to hold about
+// k points each, and the neighbours are searched for in the 27 cells
+// around each point; neighbours further than a cell away count as being
+// one cell away. Both are split across all cores with parallelFor, and
+// the results don't depend on the number of threads.
+class OutlierFilter {
+public:
+	OutlierFilter();
+
+	// Neighbours per point, at most 32
+	void setNumNeighbours(int numNeighbours);
+	int getNumNeighbours() const;
+
+	// Standard deviations above the mean distance that are still inliers
+	void setThreshold(float threshold);
+	float getThreshold() const;
+
+	// Positions in a grid of width columns of height points, stored
+	// column by column. Points with valid[i] == 0 are neither used as
+	// neighbours nor flagged, valid can be null. Sets outliers[i] to 1
+	// for outliers, 0 otherwise, and returns how many there are.
+	int findGridOutliers(const vec3 *positions, const uint8_t *valid, int width, int height, uint8_t *outliers);
+
+	// The same for unorganized points
+	int findOutliers(const vec3 *positions, int numPoints, uint8_t *outliers);
+
+	// From the last call, the mean neighbour distance and its deviation
+	float getMeanDistance() const;
+	float getDistanceDeviation() const;
+	int getNumOutliers() const;
+	float getTime() const;
+
+private:
+	int classify(const uint8_t *valid, int numPoints, uint8_t *outliers);
+	int buildCells(const vec3 *positions, int numPoints, const vec3 &low, float cellSize);
+
+	int myNumNeighbours;
+	float myThreshold;
+
+	// Mean neighbour distance of each point
+	vector<float> myDistances;
+
+	// Points sorted by hashed cell, and where each cell starts
+	vector<int> myCellStarts;
+	vector<int> myCellPoints;
+	vector<vec3> myCellPositions;
+
+	// Per block sums for the statistics
+	vector<double> myBlockSums;
+	vector<double> myBlockSquares;
+	vector<int> myBlockCounts;
+
+	float myMeanDistance;
+	float myDistanceDeviation;
+	int myNumOutliers;
+	float myTime;
+};
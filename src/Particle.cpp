@@ -10,12 +10,40 @@ void Particle::setup(vec3 pos, vec3 dir) {
 }
 
 //--------------------------------------------------------------
-void Particle::update(float amplitude, float frequency, float scale) {
-	float phase = frequency * ofGetElapsedTimef();
-	float sinVal = sinf(myOrigPos.x / scale + phase) * sinf(myOrigPos.y / scale + phase) * sinf(myOrigPos.z / scale + phase);
-	float noiseVal = ofNoise(myOrigPos / scale);
+void Particle::update(float amplitude, float frequency, float scale, float time) {
+	float phase = frequency * time;
+	myPos = myOrigPos + amplitude * calcDisplacement(myOrigPos, phase, scale) * myDir;
+}
+
+//--------------------------------------------------------------
+float Particle::calcDisplacement(const vec3 &origPos, float phase, float scale) {
+	float sinVal = sinf(origPos.x / scale + phase) * sinf(origPos.y / scale + phase) * sinf(origPos.z / scale + phase);
+	float noiseVal = ofNoise(origPos / scale);
+	return sinVal * noiseVal;
+}
 
-	myPos = myOrigPos + amplitude * sinVal * noiseVal * myDir;
+//--------------------------------------------------------------
+float Particle::calcDisplacement(const vec3 &origPos, float phase, float scale, const NoiseVolume &noise) {
+	float sinVal = sinf(origPos.x / scale + phase) * sinf(origPos.y / scale + phase) * sinf(origPos.z / scale + phase);
+	float noiseVal = 0.5f + 0.5f * noise.lookup(origPos / scale);
+	return sinVal * noiseVal;
+}
+
+//--------------------------------------------------------------
+float Particle::calcDisplacement(const vec3 &origPos, float phase, float scale, const NoiseVolume &noise, vec3 &gradient) {
+	float sinX = sinf(origPos.x / scale + phase);
+	float sinY = sinf(origPos.y / scale + phase);
+	float sinZ = sinf(origPos.z / scale + phase);
+	float sinVal = sinX * sinY * sinZ;
+	vec3 noiseGradient;
+	float noiseVal = 0.5f + 0.5f * noise.lookup(origPos / scale, noiseGradient);
+
+	// Product rule, and the chain rule for the division by the scale
+	vec3 sinGradient(cosf(origPos.x / scale + phase) * sinY * sinZ,
+		sinX * cosf(origPos.y / scale + phase) * sinZ,
+		sinX * sinY * cosf(origPos.z / scale + phase));
+	gradient = (sinGradient * noiseVal + 0.5f * noiseGradient * sinVal) / scale;
+	return sinVal * noiseVal;
 }
 
 //--------------------------------------------------------------
@@ -27,3 +55,13 @@ void Particle::draw() {
 vec3 Particle::getPos() {
 	return myPos;
 }
+
+//--------------------------------------------------------------
+vec3 Particle::getOrigPos() {
+	return myOrigPos;
+}
+
+//--------------------------------------------------------------
+vec3 Particle::getDir() {
+	return myDir;
+}
@@ -1,15 +1,28 @@
 #pragma once
 
 #include "ofMain.h"
+#include "NoiseVolume.h"
 
 using namespace glm;
 
 class Particle {
 public:
 	void setup(vec3 pos, vec3 dir);
-	void update(float amplitude, float frequency, float scale);
+	void update(float amplitude, float frequency, float scale, float time);
 	void draw();
 	vec3 getPos();
+	vec3 getOrigPos();
+	vec3 getDir();
+
+	// Displacement along the direction, before scaling by the amplitude
+	static float calcDisplacement(const vec3 &origPos, float phase, float scale);
+
+	// The same with the noise looked up in a baked single octave volume
+	static float calcDisplacement(const vec3 &origPos, float phase, float scale, const NoiseVolume &noise);
+
+	// The same again, also giving the gradient of the displacement with
+	// respect to origPos
+	static float calcDisplacement(const vec3 &origPos, float phase, float scale, const NoiseVolume &noise, vec3 &gradient);
 
 private:
 	vec3 myPos;
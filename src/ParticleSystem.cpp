@@ -1,12 +1,50 @@
 #include "ParticleSystem.h"
 #include "helpers.h"
+#include "parallel.h"
+#include "FrameArena.h"
+#include "meshCache.h"
 
+//--------------------------------------------------------------
+// Particle storage as seen by the effect chains
+struct FullParticleSource {
+	Particle *particles;
+
+	inline vec3 getPosition(int i) const {
+		return particles[i].getOrigPos();
+	}
+
+	inline vec3 getDirection(int i) const {
+		return particles[i].getDir();
+	}
+};
+
+// Decodes each particle on the fly, only 10 bytes are read per vertex
+// and the direction is only decoded for the effects that use it
+struct CompactParticleSource {
+	const CompactParticle *particles;
+	QuantizationBounds bounds;
+
+	inline vec3 getPosition(int i) const {
+		return dequantizePosition(particles[i].pos, bounds);
+	}
 
+	inline vec3 getDirection(int i) const {
+		return octDecode(particles[i].dir[0], particles[i].dir[1]);
+	}
+};
+
+
+
+//--------------------------------------------------------------
+void ParticleSystem::setupUsingMesh(const ofMesh &inputMesh, ofPrimitiveMode displayMode) {
+	setupUsingMesh(inputMesh, vector<ofIndexType>(), displayMode);
+}
 
 //--------------------------------------------------------------
-void ParticleSystem::setupUsingMesh(ofMesh inputMesh, ofPrimitiveMode displayMode) {
+void ParticleSystem::setupUsingMesh(const ofMesh &inputMesh, const vector<ofIndexType> &edgeIndices, ofPrimitiveMode displayMode) {
 	// Clear any existing particles and mesh data
 	myParticles.clear();
+	myCompactParticles.clear();
 
 	// Copy the input mesh into myMesh
 	myMesh = inputMesh;
@@ -15,11 +53,30 @@ void ParticleSystem::setupUsingMesh(ofMesh inputMesh, ofPrimitiveMode displayMod
 	myDisplayMode = displayMode;
 	myMesh.setMode(myDisplayMode);
 
+	// The springs follow the unique edges whatever the display mode,
+	// they're only worked out while simulating
+	vector<ofIndexType> springEdges;
+	if (!edgeIndices.empty()) {
+		springEdges = edgeIndices;
+	}
+	else if (mySimulation) {
+		calcEdgeIndices(inputMesh, springEdges);
+	}
+
+	// Stray scan points go before anything is built from the vertices
+	if (myOutlierRemoval) {
+		removeOutlierVertices(inputMesh.getMode(), springEdges);
+	}
+
 	// If the mesh doesn't have any normals, calculate them4
 	if (myMesh.getNumNormals() != myMesh.getNumVertices()) {
 		calcNormals(myMesh);
 	}
 
+	// The particles move along the normals, so their directions are the
+	// original normals for the analytic ones
+	myBaseNormals.clear();
+
 	// Declare a particle for each vertex, using the normals
 	// from the mesh as the direction to move each particle
 	for (int i = 0; i < myMesh.getNumVertices(); i++) {
@@ -36,7 +93,11 @@ void ParticleSystem::setupUsingMesh(ofMesh inputMesh, ofPrimitiveMode displayMod
 	// If the display mode is lines we need to convert from the triangles
 	// to lines
 
-	if (myDisplayMode == OF_PRIMITIVE_LINES) {
+	if (myDisplayMode == OF_PRIMITIVE_LINES && !edgeIndices.empty()) {
+		// Each edge once, as listed by the caller
+		myMesh.getIndices().assign(springEdges.begin(), springEdges.end());
+	}
+	else if (myDisplayMode == OF_PRIMITIVE_LINES) {
 		// Calculated index list for lines. For simplicity here we're just
 		// going to declare every edge of every triangle as a line. This
 		// means that a lot of lines are probably going to get drawn twice.
@@ -68,20 +129,29 @@ void ParticleSystem::setupUsingMesh(ofMesh inputMesh, ofPrimitiveMode displayMod
 
 	// Set the correct display mode on the mesh
 	myMesh.setMode(myDisplayMode);
+	myEffectBounds = calcEffectBounds(myMesh.getVertices().data(), myMesh.getNumVertices());
+
+	// Large point clouds are drawn through the octree, which reorders the
+	// points
+	myOctree.clear();
+	myDrawVisibleMesh = false;
+	if (myDisplayMode == OF_PRIMITIVE_POINTS && myPointBudget > 0) {
+		buildOctree(springEdges);
+	}
+	if (mySimulation) {
+		mySpringSystem.setup(myMesh.getVertices().data(), myMesh.getNumVertices(), springEdges.data(), springEdges.size());
+	}
+	else {
+		mySpringSystem.clear();
+	}
+
+	if (myCompactStorage) {
+		buildCompactParticles();
+	}
 }
 
 //--------------------------------------------------------------
 void ParticleSystem::setupUsingPointCloud(int gridSizeX, int gridSizeY, float planeRangeX, float planeRangeY, ofPrimitiveMode displayMode) {
-    myParticles.clear();
-    myMesh.clear();
-    int w = planeRangeX;
-    int h = planeRangeY;
-    // Store grid size values into member variables
-    myGridSizeX = gridSizeX;
-    myGridSizeY = gridSizeY;
-    myMesh.setMode(displayMode);
-    int step = 2;
-    
     //LOG if kinect is detected
     bool connection = kinect.isConnected();
     
@@ -94,41 +164,115 @@ void ParticleSystem::setupUsingPointCloud(int gridSizeX, int gridSizeY, float pl
     
     if(kinect.isInitialized() == false){
         cout<<"IS KINECT CONNECTED?"<<endl;
+        myParticles.clear();
+        myCompactParticles.clear();
+        myMesh.clear();
     } else {
-    
-    for (int i = 0; i < myGridSizeX; i++){
+        // Only new frames are preprocessed, so learning the background
+        // sees every depth frame once
+        if (kinect.isFrameNew() || !myDepthPreprocessor.getProcessedDepth().isAllocated()) {
+            myDepthPreprocessor.process(kinect.getRawDepthPixels());
+            myDepthTimestamp = ofGetElapsedTimeMicros();
+        }
+        myDisplayTime = ofGetElapsedTimeMicros();
+        setupUsingDepth(myDepthPreprocessor.getProcessedDepth(), gridSizeX, gridSizeY, planeRangeX, planeRangeY, displayMode);
+    }
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::setupUsingDepth(const ofShortPixels &depth, int gridSizeX, int gridSizeY, float planeRangeX, float planeRangeY, ofPrimitiveMode displayMode) {
+    myParticles.clear();
+    myCompactParticles.clear();
+    myMesh.clear();
+    mySpringSystem.clear();
+    myOctree.clear();
+    myDrawVisibleMesh = false;
+    // Store grid size values into member variables
+    myGridSizeX = gridSizeX;
+    myGridSizeY = gridSizeY;
+    myDisplayMode = displayMode;
+    myMesh.setMode(displayMode);
+
+    if (!depth.isAllocated()) {
+        return;
+    }
+
+    // Between depth frames the grid isn't sampled again, the interpolator
+    // moves the last frame's positions on
+    int numParticles = myGridSizeX * myGridSizeY;
+    bool newDepthFrame = myAdaptiveSampling || !myTemporalInterpolation ||
+        !myDepthInterpolator.isLatestFrame(myDepthTimestamp, numParticles);
+    if (newDepthFrame) {
+        myDepthPyramid.build(depth);
+    }
+    if (myAdaptiveSampling) {
+        setupUsingSamples(depth, planeRangeX, planeRangeY);
+        return;
+    }
+
+    // Read the depth from the pyramid level whose pixels are about the
+    // size of a grid square, so each vertex gets the averaged depth
+    // under it rather than one pixel
+    float spacing = min(planeRangeX / max(myGridSizeX - 1, 1), planeRangeY / max(myGridSizeY - 1, 1));
+    int level = myDepthPyramid.getLevelForSpacing(spacing);
+    const ofShortPixels &levelDepth = myDepthPyramid.getLevel(level);
+    const unsigned short *depthData = levelDepth.getData();
+    int depthWidth = depth.getWidth();
+    int depthHeight = depth.getHeight();
+    int levelWidth = levelDepth.getWidth();
+    int levelHeight = levelDepth.getHeight();
+
+    // This runs every frame in point cloud mode, so the positions go into
+    // frame scratch memory and the particle and mesh arrays keep their
+    // capacity between frames
+    vec3 *positions = getFrameArena().allocate<vec3>(numParticles);
+    for (int i = 0; i < myGridSizeX && newDepthFrame; i++){
            for (int j = 0; j < myGridSizeY; j++) {
                float x  = ofMap(i, 0, myGridSizeX - 1, 0, planeRangeX);
                float y = ofMap(j, 0, myGridSizeY - 1, 0, planeRangeY);
-               float z = 1;
                // The point cloud needs reversing and repositioning
                float reverseY = ofMap(y, 0, 480, 480, 0);
                //Create a variable to reposition x value, this centres the mesh
                //To get connect point cloud the planeRangeX has to match Kinect resolution
                float xRePosition = -0.5*planeRangeX;
-            if(kinect.getDistanceAt(x, y) > 0 && kinect.getDistanceAt(x, y) < 800) {
+               // With registration on the raw depth is the world z in mm.
+               // The last grid column/row lands on the image edge, clamp it
+               int depthX = ofClamp(int(x), 0, depthWidth - 1);
+               int depthY = ofClamp(int(y), 0, depthHeight - 1);
+               int levelX = min(depthX >> level, levelWidth - 1);
+               int levelY = min(depthY >> level, levelHeight - 1);
+               float distance = depthData[levelY * levelWidth + levelX];
+            if(distance > 0 && distance < 800) {
                 //put the kinect depth values into the mesh, use a threshold for depth
-                vec3 depthPt = vec3(kinect.getWorldCoordinateAt(x, y));
-                float zOffset =  depthPt.z - 800;
-                vec3 pos = vec3(x + xRePosition, reverseY, -zOffset);
-                vec3 dir = vec3(0, 0, 1);
-                Particle par;
-                par.setup(pos, dir);
-                myParticles.push_back(par);
+                float zOffset =  distance - 800;
+                positions[getParticleIndex(i, j)] = vec3(x + xRePosition, reverseY, -zOffset);
             } else {
-                vec3 pos = vec3(x + xRePosition, reverseY, -01);
-                vec3 dir = vec3(0, 0, 1);
-                Particle par;
-                par.setup(pos, dir);
-                myParticles.push_back(par);
+                positions[getParticleIndex(i, j)] = vec3(x + xRePosition, reverseY, -01);
             }
         }
     }
-    // Create a vertex for each particle
-    for (int i = 0; i < myParticles.size(); i++) {
-        vec3 pos = myParticles[i].getPos();
-        myMesh.addVertex(pos);
+    if (myOutlierRemoval && newDepthFrame) {
+        // Flying pixels are moved back with the pixels without depth,
+        // which are the ones at z = -1
+        uint8_t *valid = getFrameArena().allocate<uint8_t>(numParticles);
+        uint8_t *outliers = getFrameArena().allocate<uint8_t>(numParticles);
+        for (int i = 0; i < numParticles; i++) {
+            valid[i] = positions[i].z != -1;
+        }
+        myOutlierFilter.findGridOutliers(positions, valid, myGridSizeX, myGridSizeY, outliers);
+        for (int i = 0; i < numParticles; i++) {
+            if (outliers[i]) {
+                positions[i].z = -1;
+            }
+        }
+    }
+    if (myTemporalInterpolation) {
+        if (newDepthFrame) {
+            myDepthInterpolator.addFrame(positions, numParticles, myDepthTimestamp);
+        }
+        myDepthInterpolator.interpolate(myDisplayTime, positions);
     }
+    setDepthParticles(positions, numParticles);
     
     // Initialize the mesh
     if (myDisplayMode == OF_PRIMITIVE_POINTS) {
@@ -138,6 +282,7 @@ void ParticleSystem::setupUsingPointCloud(int gridSizeX, int gridSizeY, float pl
         // Declare lines connecting the vertices in a square grid using the vertex indices
         // We add lines by creating a list of pairs of vertex indices that should be
         // connected by lines
+        myMesh.getIndices().reserve(4 * numParticles);
         for (int i = 0; i < myGridSizeX; i++) {
             for (int j = 0; j < myGridSizeY; j++) {
                 if (i < myGridSizeX - 1) {
@@ -154,6 +299,7 @@ void ParticleSystem::setupUsingPointCloud(int gridSizeX, int gridSizeY, float pl
     }
     else if (myDisplayMode == OF_PRIMITIVE_TRIANGLES) {
         // Declare two triangles for each square in the grid
+        myMesh.getIndices().reserve(6 * numParticles);
         for (int i = 0; i < myGridSizeX - 1; i++) {
             for (int j = 0; j < myGridSizeY - 1; j++) {
                 myMesh.addTriangle(
@@ -171,32 +317,499 @@ void ParticleSystem::setupUsingPointCloud(int gridSizeX, int gridSizeY, float pl
         // Add a normal for each vertex. This can be done by calling the
         // calcNormals helper function
         calcNormals(myMesh);
+
+        // The particles all move towards the camera, so the analytic
+        // normals start from these instead
+        myBaseNormals.assign(myMesh.getNormals().begin(), myMesh.getNormals().end());
     }
     else {
         ofLogError("ParticleSystem::setup, displayMode set to invalid value");
     }
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::setupUsingSamples(const ofShortPixels &depth, float planeRangeX, float planeRangeY) {
+    // The same number of vertices as the uniform grid, all on the foreground
+    mySampler.sample(myDepthPyramid, myGridSizeX * myGridSizeY, myDisplayMode);
+    const vector<vec3> &samples = mySampler.getSamples();
+    int numParticles = samples.size();
+    vec3 *positions = getFrameArena().allocate<vec3>(numParticles);
+
+    // The sample count changes a little every frame, leave some room so
+    // the arrays don't grow each time there are a few more
+    if (myMesh.getVertices().capacity() < size_t(numParticles)) {
+        int capacity = numParticles + numParticles / 4;
+        myMesh.getVertices().reserve(capacity);
+        myMesh.getNormals().reserve(capacity);
+        myParticles.reserve(myCompactStorage ? 0 : capacity);
+        myCompactParticles.reserve(myCompactStorage ? capacity : 0);
+    }
+    if (myMesh.getIndices().capacity() < mySampler.getIndices().size()) {
+        myMesh.getIndices().reserve(mySampler.getIndices().size() * 5 / 4);
+    }
+
+    // Same placement as the uniform grid, samples are in depth pixels
+    float scaleX = planeRangeX / depth.getWidth();
+    float scaleY = planeRangeY / depth.getHeight();
+    float xRePosition = -0.5*planeRangeX;
+    for (int i = 0; i < numParticles; i++) {
+        float x = samples[i].x * scaleX;
+        float y = samples[i].y * scaleY;
+        float reverseY = ofMap(y, 0, 480, 480, 0);
+        float zOffset = samples[i].z - 800;
+        positions[i] = vec3(x + xRePosition, reverseY, -zOffset);
+    }
+    setDepthParticles(positions, numParticles);
+
+    // The sampler's index buffer matches its samples
+    myMesh.getIndices().assign(mySampler.getIndices().begin(), mySampler.getIndices().end());
+    if (myDisplayMode == OF_PRIMITIVE_TRIANGLES) {
+        calcNormals(myMesh);
+        myBaseNormals.assign(myMesh.getNormals().begin(), myMesh.getNormals().end());
+    }
+}
 
+//--------------------------------------------------------------
+void ParticleSystem::setDepthParticles(const vec3 *positions, int numParticles) {
+    // Create a vertex for each particle
+    myMesh.getVertices().assign(positions, positions + numParticles);
+    myEffectBounds = calcEffectBounds(positions, numParticles);
 
+    // All particles move towards the camera
+    vec3 *directions = getFrameArena().allocate<vec3>(numParticles);
+    std::fill(directions, directions + numParticles, vec3(0, 0, 1));
+    if (myCompactStorage) {
+        setCompactParticles(positions, directions, numParticles);
     }
+    else {
+        myParticles.resize(numParticles);
+        for (int i = 0; i < numParticles; i++) {
+            myParticles[i].setup(positions[i], directions[i]);
+        }
+    }
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::setAdaptiveSampling(bool adaptive) {
+    myAdaptiveSampling = adaptive;
+}
+
+//--------------------------------------------------------------
+bool ParticleSystem::isAdaptiveSampling() const {
+    return myAdaptiveSampling;
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::setTemporalInterpolation(bool interpolate) {
+    if (interpolate && !myTemporalInterpolation) {
+        myDepthInterpolator.reset();
+    }
+    myTemporalInterpolation = interpolate;
+}
+
+//--------------------------------------------------------------
+bool ParticleSystem::isTemporalInterpolation() const {
+    return myTemporalInterpolation;
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::setDepthTime(uint64_t depthTimestamp, uint64_t displayTime) {
+    myDepthTimestamp = depthTimestamp;
+    myDisplayTime = displayTime;
 }
 
+//--------------------------------------------------------------
+DepthInterpolator &ParticleSystem::getDepthInterpolator() {
+    return myDepthInterpolator;
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::setOutlierRemoval(bool remove) {
+    myOutlierRemoval = remove;
+}
+
+//--------------------------------------------------------------
+bool ParticleSystem::isOutlierRemoval() const {
+    return myOutlierRemoval;
+}
 
 //--------------------------------------------------------------
-void ParticleSystem::update(float amplitude, float frequency, float scale) {
-	for (int i = 0; i < myParticles.size(); i++) {
-		myParticles[i].update(amplitude, frequency, scale);
-		myMesh.setVertex(i, myParticles[i].getPos());
+OutlierFilter &ParticleSystem::getOutlierFilter() {
+    return myOutlierFilter;
+}
+
+
+//--------------------------------------------------------------
+void ParticleSystem::update(float amplitude, float frequency, float scale, const Clock &clock) {
+	EffectSettings settings;
+	settings.effects = EFFECT_NOISE;
+	settings.amplitude = amplitude;
+	settings.frequency = frequency;
+	settings.scale = scale;
+	update(settings, clock);
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::update(const EffectSettings &effects, const Clock &clock) {
+	uint64_t startTime = ofGetElapsedTimeMicros();
+
+	// Read the time once so every particle sees the same frame time
+	EffectFrame frame = makeEffectFrame(effects, myEffectBounds, clock.getElapsedTimef());
+
+	// Each particle only writes its own vertex, so the particles can be
+	// split across all cores
+	vector<vec3> &vertices = myMesh.getVertices();
+	int first = myUpdateCount % myUpdateStride;
+
+	// Pick the points to move and draw from the octree
+	bool culling = myOctree.isBuilt() && myPointBudget > 0 && myHasView && myOctree.getNumPoints() == int(vertices.size());
+	if (culling) {
+		myNumVisiblePoints = myOctree.select(myView, myPointBudget, myPointSpacing, myVisibleRanges);
+		myCullingTime = (ofGetElapsedTimeMicros() - startTime) / 1000.0;
 	}
 
+	// Triangle normals can come from the effects themselves, see
+	// effects.h, otherwise they're worked out from the triangles below
+	bool simulating = mySimulation && mySpringSystem.getNumVertices() == int(vertices.size());
+	vector<vec3> &normals = myMesh.getNormals();
+	bool analyticNormals = myAnalyticNormals && myDisplayMode == OF_PRIMITIVE_TRIANGLES && !simulating && !culling
+		&& hasAnalyticNormals(effects) && normals.size() == vertices.size();
+	const vec3 *baseNormals = myBaseNormals.size() == vertices.size() ? myBaseNormals.data() : nullptr;
+
+	if (simulating) {
+		// Every vertex moves every step, the update stride doesn't apply
+		mySpringSystem.update(clock.getElapsedTimef());
+		const vec3 *positions = mySpringSystem.getPositions();
+		std::copy(positions, positions + vertices.size(), vertices.begin());
+	}
+	else if (culling && myCompactStorage) {
+		CompactParticleSource source = { myCompactParticles.data(), myQuantizationBounds };
+		applyEffects(source, frame, vertices.data(), myVisibleRanges.data(), myVisibleRanges.size());
+	}
+	else if (culling) {
+		FullParticleSource source = { myParticles.data() };
+		applyEffects(source, frame, vertices.data(), myVisibleRanges.data(), myVisibleRanges.size());
+	}
+	else if (analyticNormals && myCompactStorage) {
+		CompactParticleSource source = { myCompactParticles.data(), myQuantizationBounds };
+		applyEffects(source, frame, baseNormals, vertices.data(), normals.data(), myCompactParticles.size(), first, myUpdateStride);
+	}
+	else if (analyticNormals) {
+		FullParticleSource source = { myParticles.data() };
+		applyEffects(source, frame, baseNormals, vertices.data(), normals.data(), myParticles.size(), first, myUpdateStride);
+	}
+	else if (myCompactStorage) {
+		CompactParticleSource source = { myCompactParticles.data(), myQuantizationBounds };
+		applyEffects(source, frame, vertices.data(), myCompactParticles.size(), first, myUpdateStride);
+	}
+	else {
+		FullParticleSource source = { myParticles.data() };
+		applyEffects(source, frame, vertices.data(), myParticles.size(), first, myUpdateStride);
+	}
+	myDrawVisibleMesh = culling;
+	if (culling) {
+		gatherVisiblePoints();
+	}
+	uint64_t effectsTime = ofGetElapsedTimeMicros();
+
 	// If we've got a mesh of triangles we need to update the vertex normals
-	if (myDisplayMode == OF_PRIMITIVE_TRIANGLES) {
+	if (myDisplayMode == OF_PRIMITIVE_TRIANGLES && !analyticNormals && myUpdateCount % myNormalsInterval == 0) {
 		calcNormals(myMesh);
 	}
+
+	myEffectsTime = (effectsTime - startTime) / 1000.0;
+	myNormalsTime = (ofGetElapsedTimeMicros() - effectsTime) / 1000.0;
+	myUpdateCount++;
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::setAnalyticNormals(bool analytic) {
+	myAnalyticNormals = analytic;
+}
+
+//--------------------------------------------------------------
+bool ParticleSystem::isAnalyticNormals() const {
+	return myAnalyticNormals;
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::setUpdateStride(int stride) {
+	myUpdateStride = max(stride, 1);
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::setNormalsInterval(int interval) {
+	myNormalsInterval = max(interval, 1);
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::setSimulation(bool simulate) {
+	if (simulate && !mySimulation) {
+		mySpringSystem.reset();
+	}
+	else if (!simulate) {
+		mySpringSystem.clear();
+	}
+	mySimulation = simulate;
+}
+
+//--------------------------------------------------------------
+bool ParticleSystem::isSimulation() const {
+	return mySimulation;
+}
+
+//--------------------------------------------------------------
+SpringSystem &ParticleSystem::getSpringSystem() {
+	return mySpringSystem;
+}
+
+//--------------------------------------------------------------
+float ParticleSystem::getEffectsTime() const {
+	return myEffectsTime;
+}
+
+//--------------------------------------------------------------
+float ParticleSystem::getNormalsTime() const {
+	return myNormalsTime;
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::setPointBudget(int budget) {
+	myPointBudget = max(budget, 0);
+}
+
+//--------------------------------------------------------------
+int ParticleSystem::getPointBudget() const {
+	return myPointBudget;
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::setPointSpacing(float pointSpacing) {
+	myPointSpacing = pointSpacing;
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::setView(const OctreeView &view) {
+	myView = view;
+	myHasView = true;
+}
+
+//--------------------------------------------------------------
+const PointOctree &ParticleSystem::getOctree() const {
+	return myOctree;
+}
+
+//--------------------------------------------------------------
+int ParticleSystem::getNumVisiblePoints() const {
+	return myDrawVisibleMesh ? myNumVisiblePoints : myMesh.getNumVertices();
+}
+
+//--------------------------------------------------------------
+float ParticleSystem::getCullingTime() const {
+	return myCullingTime;
+}
+
+//--------------------------------------------------------------
+// Reorders a per vertex array into tree order
+template<typename T>
+static void reorderVertexData(vector<T> &data, const vector<int> &order) {
+	if (data.size() != order.size()) {
+		return;
+	}
+	vector<T> reordered(data.size());
+	parallelFor(0, order.size(), [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			reordered[i] = data[order[i]];
+		}
+	});
+	data.swap(reordered);
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::buildOctree(vector<ofIndexType> &edgeIndices) {
+	vector<int> order;
+	myOctree.build(myMesh.getVertices().data(), myMesh.getNumVertices(), order);
+
+	reorderVertexData(myParticles, order);
+	reorderVertexData(myMesh.getVertices(), order);
+	reorderVertexData(myMesh.getNormals(), order);
+	reorderVertexData(myMesh.getColors(), order);
+	reorderVertexData(myMesh.getTexCoords(), order);
+
+	// Indices follow their vertices
+	vector<ofIndexType> newIndices(order.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		newIndices[order[i]] = i;
+	}
+	for (ofIndexType &index : myMesh.getIndices()) {
+		index = newIndices[index];
+	}
+	for (ofIndexType &index : edgeIndices) {
+		index = newIndices[index];
+	}
+}
+
+//--------------------------------------------------------------
+// Keeps the entries of a per vertex array that aren't removed
+template<typename T>
+static void removeVertexData(vector<T> &data, const vector<uint8_t> &removed) {
+	if (data.size() != removed.size()) {
+		return;
+	}
+	size_t numKept = 0;
+	for (size_t i = 0; i < data.size(); i++) {
+		if (!removed[i]) {
+			data[numKept++] = data[i];
+		}
+	}
+	data.resize(numKept);
+}
+
+//--------------------------------------------------------------
+// Drops each primitive, of indicesPerPrimitive indices, that uses a
+// removed vertex and renumbers the rest
+static void removeIndices(vector<ofIndexType> &indices, int indicesPerPrimitive, const vector<uint8_t> &removed, const vector<ofIndexType> &newIndices) {
+	size_t numKept = 0;
+	for (size_t first = 0; first + indicesPerPrimitive <= indices.size(); first += indicesPerPrimitive) {
+		bool keep = true;
+		for (int i = 0; i < indicesPerPrimitive; i++) {
+			keep = keep && !removed[indices[first + i]];
+		}
+		for (int i = 0; i < indicesPerPrimitive && keep; i++) {
+			indices[numKept++] = newIndices[indices[first + i]];
+		}
+	}
+	indices.resize(numKept);
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::removeOutlierVertices(ofPrimitiveMode indexMode, vector<ofIndexType> &edgeIndices) {
+	int numVertices = myMesh.getNumVertices();
+	vector<uint8_t> outliers(numVertices);
+	int numOutliers = myOutlierFilter.findOutliers(myMesh.getVertices().data(), numVertices, outliers.data());
+	ofLogNotice("ParticleSystem::removeOutlierVertices") << numOutliers << " of " << numVertices
+		<< " vertices are outliers, found in " << myOutlierFilter.getTime() << "ms";
+	if (numOutliers == 0) {
+		return;
+	}
+
+	vector<ofIndexType> newIndices(numVertices);
+	int numKept = 0;
+	for (int i = 0; i < numVertices; i++) {
+		newIndices[i] = numKept;
+		numKept += !outliers[i];
+	}
+	removeVertexData(myMesh.getVertices(), outliers);
+	removeVertexData(myMesh.getNormals(), outliers);
+	removeVertexData(myMesh.getColors(), outliers);
+	removeVertexData(myMesh.getTexCoords(), outliers);
+
+	int indicesPerPrimitive = 1;
+	if (indexMode == OF_PRIMITIVE_TRIANGLES) {
+		indicesPerPrimitive = 3;
+	}
+	else if (indexMode == OF_PRIMITIVE_LINES) {
+		indicesPerPrimitive = 2;
+	}
+	removeIndices(myMesh.getIndices(), indicesPerPrimitive, outliers, newIndices);
+	removeIndices(edgeIndices, 2, outliers, newIndices);
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::gatherVisiblePoints() {
+	// Where each range goes in the visible mesh
+	int numRanges = myVisibleRanges.size();
+	int *offsets = getFrameArena().allocate<int>(numRanges);
+	int numPoints = 0;
+	for (int i = 0; i < numRanges; i++) {
+		offsets[i] = numPoints;
+		numPoints += myVisibleRanges[i].count;
+	}
+
+	bool hasNormals = myMesh.getNumNormals() == myMesh.getNumVertices();
+	bool hasColors = myMesh.getNumColors() == myMesh.getNumVertices();
+	myVisibleMesh.setMode(OF_PRIMITIVE_POINTS);
+	myVisibleMesh.getVertices().resize(numPoints);
+	myVisibleMesh.getNormals().resize(hasNormals ? numPoints : 0);
+	myVisibleMesh.getColors().resize(hasColors ? numPoints : 0);
+
+	const VertexRange *ranges = myVisibleRanges.data();
+	parallelFor(0, numRanges, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			const VertexRange &range = ranges[i];
+			std::copy_n(&myMesh.getVertices()[range.begin], range.count, &myVisibleMesh.getVertices()[offsets[i]]);
+			if (hasNormals) {
+				std::copy_n(&myMesh.getNormals()[range.begin], range.count, &myVisibleMesh.getNormals()[offsets[i]]);
+			}
+			if (hasColors) {
+				std::copy_n(&myMesh.getColors()[range.begin], range.count, &myVisibleMesh.getColors()[offsets[i]]);
+			}
+		}
+	}, 4);
 }
 
 //--------------------------------------------------------------
 void ParticleSystem::draw() {
-	myMesh.draw();
+	// Only the selected points are submitted
+	if (myDrawVisibleMesh) {
+		myVisibleMesh.draw();
+	}
+	else {
+		myMesh.draw();
+	}
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::setCompactStorage(bool compact) {
+	// Decoding the compact particles would keep their quantization, so
+	// neither layout is converted into the other. The next setup builds
+	// the particles from full precision data.
+	myCompactStorage = compact;
+}
+
+//--------------------------------------------------------------
+bool ParticleSystem::isCompactStorage() const {
+	return myCompactStorage;
+}
+
+//--------------------------------------------------------------
+float ParticleSystem::getCompactPositionError() const {
+	return myCompactPositionError;
+}
+
+//--------------------------------------------------------------
+float ParticleSystem::getCompactDirectionError() const {
+	return myCompactDirectionError;
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::buildCompactParticles() {
+	// Gather the original positions and directions. This only runs when
+	// a mesh is set up, so the temporaries come from the heap rather than
+	// growing the frame arena to the size of the mesh.
+	int numParticles = myParticles.size();
+	vector<vec3> positions(numParticles);
+	vector<vec3> directions(numParticles);
+	for (int i = 0; i < numParticles; i++) {
+		positions[i] = myParticles[i].getOrigPos();
+		directions[i] = myParticles[i].getDir();
+	}
+	setCompactParticles(positions.data(), directions.data(), numParticles);
+
+	// Release the full size particles
+	vector<Particle>().swap(myParticles);
+
+	ofLogVerbose("ParticleSystem::buildCompactParticles") << numParticles << " particles, max position error "
+		<< myCompactPositionError << ", max direction error " << myCompactDirectionError << " degrees";
+}
+
+//--------------------------------------------------------------
+void ParticleSystem::setCompactParticles(const vec3 *positions, const vec3 *directions, int numParticles) {
+	myQuantizationBounds = calcQuantizationBounds(positions, numParticles);
+	myCompactParticles.resize(numParticles);
+	encodeCompactParticles(positions, directions, numParticles, myQuantizationBounds, myCompactParticles.data());
+	measureCompactError(positions, directions, myCompactParticles.data(), numParticles,
+		myQuantizationBounds, myCompactPositionError, myCompactDirectionError);
 }
 
 //--------------------------------------------------------------
@@ -207,7 +820,7 @@ int ParticleSystem::getParticleIndex(int x, int y) {
 }
 
 //--------------------------------------------------------------
-ofMesh ParticleSystem::getMesh() {
+const ofMesh &ParticleSystem::getMesh() const {
 	return myMesh;
 }
 //--------------------------------------------------------------
@@ -221,6 +834,11 @@ void ParticleSystem::setupKinect(){
     //kinect.init(true); // shows infrared instead of RGB video image
     kinect.init(false, false); // disable video image (faster fps)
     
+    ofSetFrameRate(60);
+}
+//--------------------------------------------------------------
+void ParticleSystem::openKinect(){
+    // Nothing else may use the Kinect until this returns
     kinect.open();        // opens first available kinect
     //kinect.open(1);    // open a kinect by id, starting with 0 (sorted by serial # lexicographically))
     //kinect.open("A00362A08602047A");    // open a kinect using it's unique serial #
@@ -233,9 +851,6 @@ void ParticleSystem::setupKinect(){
         ofLogNotice() << "zero plane dist: " << kinect.getZeroPlaneDistance() << "mm";
     }
     
-
-    
-    ofSetFrameRate(60);
     
     // zero the tilt on startup
     angle = 0;
@@ -248,3 +863,16 @@ void ParticleSystem::updateKinect(){
     kinect.update();
 }
 //--------------------------------------------------------------
+bool ParticleSystem::isKinectFrameNew(){
+    return kinect.isFrameNew();
+}
+//--------------------------------------------------------------
+DepthPreprocessor &ParticleSystem::getDepthPreprocessor(){
+    return myDepthPreprocessor;
+}
+//--------------------------------------------------------------
+ofShortPixels &ParticleSystem::getRawDepthPixels(){
+    // Raw depth in millimetres, registered to the video image
+    return kinect.getRawDepthPixels();
+}
+//--------------------------------------------------------------
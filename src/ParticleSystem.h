@@ -2,6 +2,16 @@
 
 #include "ofMain.h"
 #include "Particle.h"
+#include "Clock.h"
+#include "quantization.h"
+#include "DepthPreprocessor.h"
+#include "AdaptiveSampler.h"
+#include "DepthPyramid.h"
+#include "DepthInterpolator.h"
+#include "PointOctree.h"
+#include "OutlierFilter.h"
+#include "effects.h"
+#include "SpringSystem.h"
 #include "ofxOpenCv.h"
 #include "ofxKinect.h"
 
@@ -11,17 +21,81 @@ class ParticleSystem {
 public:
 	void setupPlane(int gridSizeX, int gridSizeY, float planeRangeX, float planeRangeY, ofPrimitiveMode displayMode);
 	void setupSphere(int gridSizeX, int gridSizeY, float sphereRadius, ofPrimitiveMode displayMode);
-	void setupUsingMesh(ofMesh inputMesh, ofPrimitiveMode displayMode);
-	void update(float amplitude, float frequency, float scale);
+	void setupUsingMesh(const ofMesh &inputMesh, ofPrimitiveMode displayMode);
+
+	// Line mode draws the given edges instead of every triangle edge
+	void setupUsingMesh(const ofMesh &inputMesh, const vector<ofIndexType> &edgeIndices, ofPrimitiveMode displayMode);
+	void update(float amplitude, float frequency, float scale, const Clock &clock);
+	void update(const EffectSettings &effects, const Clock &clock);
+
+	// Move every stride-th vertex per update and redo normals every interval updates
+	void setUpdateStride(int stride);
+	void setNormalsInterval(int interval);
+
+	// Normals from the effects' derivatives, for triangles with baked noise only
+	void setAnalyticNormals(bool analytic);
+	bool isAnalyticNormals() const;
+
+	// Time the last update spent on the effects and on the normals
+	float getEffectsTime() const;
+	float getNormalsTime() const;
+
+	// Spring-mass simulation instead of the effects, applied at the next setupUsingMesh
+	void setSimulation(bool simulate);
+	bool isSimulation() const;
+	SpringSystem &getSpringSystem();
+
+	// Octree culling of point meshes (0 is off), applied at the next setupUsingMesh
+	void setPointBudget(int budget);
+	int getPointBudget() const;
+	void setPointSpacing(float pointSpacing);
+	void setView(const OctreeView &view);
+	const PointOctree &getOctree() const;
+	int getNumVisiblePoints() const;
+	float getCullingTime() const;
 	void draw();
-	ofMesh getMesh();
+	const ofMesh &getMesh() const;
+    // setupKinect is for the main thread, the slow openKinect can run on another
     void setupKinect();
+    void openKinect();
     void updateKinect();
+    bool isKinectFrameNew();
+    ofShortPixels &getRawDepthPixels();
     void setupUsingPointCloud(int gridSizeX, int gridSizeY, float planeRangeX, float planeRangeY, ofPrimitiveMode displayMode);
+    void setupUsingDepth(const ofShortPixels &depth, int gridSizeX, int gridSizeY, float planeRangeX, float planeRangeY, ofPrimitiveMode displayMode);
+    DepthPreprocessor &getDepthPreprocessor();
+
+    // Spend the grid's vertices on the depth image's foreground
+    void setAdaptiveSampling(bool adaptive);
+    bool isAdaptiveSampling() const;
+
+    // Move the grid between depth frames, times in microseconds, see DepthInterpolator
+    void setTemporalInterpolation(bool interpolate);
+    bool isTemporalInterpolation() const;
+    void setDepthTime(uint64_t depthTimestamp, uint64_t displayTime);
+    DepthInterpolator &getDepthInterpolator();
+
+    // Drop outlying depth samples and mesh vertices, see OutlierFilter
+    void setOutlierRemoval(bool remove);
+    bool isOutlierRemoval() const;
+    OutlierFilter &getOutlierFilter();
     float p;
 
+    // 10 byte particles (16 bit positions, octahedral directions), applied at the next setup
+    void setCompactStorage(bool compact);
+    bool isCompactStorage() const;
+    float getCompactPositionError() const;
+    float getCompactDirectionError() const;
+
 private:
 	int getParticleIndex(int x, int y);
+	void buildCompactParticles();
+	void setCompactParticles(const vec3 *positions, const vec3 *directions, int numParticles);
+    void setupUsingSamples(const ofShortPixels &depth, float planeRangeX, float planeRangeY);
+    void setDepthParticles(const vec3 *positions, int numParticles);
+	void buildOctree(vector<ofIndexType> &edgeIndices);
+	void gatherVisiblePoints();
+	void removeOutlierVertices(ofPrimitiveMode indexMode, vector<ofIndexType> &edgeIndices);
     int angle;// kinect start angle
     
 	vector<Particle> myParticles;
@@ -29,9 +103,47 @@ private:
 	ofPrimitiveMode myDisplayMode;
 	int myGridSizeX;
 	int myGridSizeY;
+
+	bool myCompactStorage = false;
+	vector<CompactParticle> myCompactParticles;
+	QuantizationBounds myQuantizationBounds;
+	float myCompactPositionError = 0;
+	float myCompactDirectionError = 0;
+	EffectBounds myEffectBounds = { vec3(0, 0, 0), 0 };
+	int myUpdateStride = 1;
+	int myNormalsInterval = 1;
+	uint64_t myUpdateCount = 0;
+	float myEffectsTime = 0;
+	float myNormalsTime = 0;
+	bool myAnalyticNormals = false;
+	// Normals of the depth grid before the effects, the particles there
+	// don't move along them
+	vector<vec3> myBaseNormals;
+	SpringSystem mySpringSystem;
+	bool mySimulation = false;
+	PointOctree myOctree;
+	int myPointBudget = 0;
+	float myPointSpacing = 2.0;
+	OctreeView myView;
+	bool myHasView = false;
+	vector<VertexRange> myVisibleRanges;
+	ofMesh myVisibleMesh;
+	bool myDrawVisibleMesh = false;
+	int myNumVisiblePoints = 0;
+	float myCullingTime = 0;
     // used for viewing the point cloud
     ofEasyCam easyCam;
     ofxKinect kinect;
+    DepthPreprocessor myDepthPreprocessor;
+    AdaptiveSampler mySampler;
+    DepthPyramid myDepthPyramid;
+    bool myAdaptiveSampling = false;
+    DepthInterpolator myDepthInterpolator;
+    bool myTemporalInterpolation = false;
+    uint64_t myDepthTimestamp = 0;
+    uint64_t myDisplayTime = 0;
+    OutlierFilter myOutlierFilter;
+    bool myOutlierRemoval = false;
     
     
     
@@ -0,0 +1,315 @@
+#include "PointOctree.h"
+#include "parallel.h"
+
+// Morton keys have 10 bits per axis, so the tree is at most 10 levels
+// deep. The low 32 bits of each sort key are the point's index.
+static const int maxOctreeDepth = 10;
+
+//--------------------------------------------------------------
+static inline uint32_t expandMortonBits(uint32_t v) {
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+//--------------------------------------------------------------
+static inline int getOctant(uint64_t key, int level) {
+	return (key >> (32 + 3 * (maxOctreeDepth - 1 - level))) & 7;
+}
+
+//--------------------------------------------------------------
+// Sorts blocks in parallel and merges them pairwise, also in parallel
+static void sortKeys(vector<uint64_t> &keys) {
+	int numKeys = keys.size();
+	int numBlocks = max(1, min(getNumParallelThreads() * 4, numKeys / 65536));
+	vector<int> blockStarts(numBlocks + 1);
+	for (int i = 0; i <= numBlocks; i++) {
+		blockStarts[i] = int(int64_t(numKeys) * i / numBlocks);
+	}
+	parallelFor(0, numBlocks, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			sort(keys.begin() + blockStarts[i], keys.begin() + blockStarts[i + 1]);
+		}
+	}, 1);
+	if (numBlocks == 1) {
+		return;
+	}
+
+	vector<uint64_t> merged(numKeys);
+	for (int width = 1; width < numBlocks; width *= 2) {
+		int numPairs = (numBlocks + 2 * width - 1) / (2 * width);
+		parallelFor(0, numPairs, [&](int begin, int end) {
+			for (int pair = begin; pair < end; pair++) {
+				int first = blockStarts[pair * 2 * width];
+				int middle = blockStarts[min((pair * 2 + 1) * width, numBlocks)];
+				int last = blockStarts[min((pair * 2 + 2) * width, numBlocks)];
+				std::merge(keys.begin() + first, keys.begin() + middle, keys.begin() + middle, keys.begin() + last, merged.begin() + first);
+			}
+		}, 1);
+		keys.swap(merged);
+	}
+}
+
+//--------------------------------------------------------------
+OctreeView makeOctreeView(const vec3 &eye, const vec3 &target, float fovY, float width, float height) {
+	float fovRadians = ofDegToRad(fovY);
+	OctreeView view;
+	view.viewProjection = perspective(fovRadians, width / height, 1.0f, 100000.0f) * lookAt(eye, target, vec3(0, 1, 0));
+	view.position = eye;
+	view.pixelScale = height / (2 * tanf(fovRadians / 2));
+	return view;
+}
+
+//--------------------------------------------------------------
+PointOctree::PointOctree() :
+	myMaxLeafPoints(4096), myNumPoints(0), myNumLeaves(0), myDepth(0) {
+}
+
+//--------------------------------------------------------------
+void PointOctree::setMaxLeafPoints(int maxLeafPoints) {
+	myMaxLeafPoints = max(maxLeafPoints, 1);
+}
+
+//--------------------------------------------------------------
+void PointOctree::build(const vec3 *positions, int numPoints, vector<int> &order) {
+	uint64_t startTime = ofGetElapsedTimeMicros();
+	clear();
+	order.resize(numPoints);
+	if (numPoints == 0) {
+		return;
+	}
+	myNumPoints = numPoints;
+
+	// Bounds, per block of points and then combined
+	const int boundsBlockSize = 65536;
+	int numBoundsBlocks = (numPoints + boundsBlockSize - 1) / boundsBlockSize;
+	vector<vec3> blockMin(numBoundsBlocks);
+	vector<vec3> blockMax(numBoundsBlocks);
+	parallelFor(0, numBoundsBlocks, [&](int begin, int end) {
+		for (int block = begin; block < end; block++) {
+			int first = block * boundsBlockSize;
+			int last = min(first + boundsBlockSize, numPoints);
+			vec3 low = positions[first];
+			vec3 high = positions[first];
+			for (int i = first + 1; i < last; i++) {
+				low = min(low, positions[i]);
+				high = max(high, positions[i]);
+			}
+			blockMin[block] = low;
+			blockMax[block] = high;
+		}
+	}, 1);
+	vec3 low = blockMin[0];
+	vec3 high = blockMax[0];
+	for (int block = 1; block < numBoundsBlocks; block++) {
+		low = min(low, blockMin[block]);
+		high = max(high, blockMax[block]);
+	}
+
+	// A cube around the points, a little larger so the far faces are in
+	Node root;
+	root.center = (low + high) * 0.5f;
+	root.halfSize = max(max(high.x - low.x, high.y - low.y), max(high.z - low.z, 1e-3f)) * 0.5f * 1.0001f;
+	root.begin = 0;
+	root.end = numPoints;
+	root.firstChild = -1;
+	root.numChildren = 0;
+	myNodes.push_back(root);
+
+	vec3 cubeMin = root.center - vec3(root.halfSize);
+	float scale = (1 << maxOctreeDepth) / (2 * root.halfSize);
+	vector<uint64_t> keys(numPoints);
+	parallelFor(0, numPoints, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			vec3 cell = (positions[i] - cubeMin) * scale;
+			uint32_t x = ofClamp(int(cell.x), 0, (1 << maxOctreeDepth) - 1);
+			uint32_t y = ofClamp(int(cell.y), 0, (1 << maxOctreeDepth) - 1);
+			uint32_t z = ofClamp(int(cell.z), 0, (1 << maxOctreeDepth) - 1);
+			uint64_t morton = (expandMortonBits(x) << 2) | (expandMortonBits(y) << 1) | expandMortonBits(z);
+			keys[i] = (morton << 32) | uint32_t(i);
+		}
+	});
+	sortKeys(keys);
+	buildNode(0, keys.data(), 0);
+
+	// Each leaf in bit-reversed order of its Morton order, so its first
+	// n points are spread over the whole leaf
+	vector<int> leaves;
+	for (int i = 0; i < int(myNodes.size()); i++) {
+		if (myNodes[i].firstChild < 0) {
+			leaves.push_back(i);
+		}
+	}
+	parallelFor(0, leaves.size(), [&](int begin, int end) {
+		for (int leaf = begin; leaf < end; leaf++) {
+			const Node &node = myNodes[leaves[leaf]];
+			int count = node.end - node.begin;
+			int bits = 0;
+			while ((1 << bits) < count) {
+				bits++;
+			}
+			int *out = &order[node.begin];
+			for (int rank = 0; rank < (1 << bits); rank++) {
+				int reversed = 0;
+				for (int bit = 0; bit < bits; bit++) {
+					reversed |= ((rank >> bit) & 1) << (bits - 1 - bit);
+				}
+				if (reversed < count) {
+					*out++ = int(keys[node.begin + reversed] & 0xFFFFFFFF);
+				}
+			}
+		}
+	}, 1);
+
+	ofLogNotice("PointOctree::build") << numPoints << " points, " << myNodes.size() << " nodes, " << myNumLeaves
+		<< " leaves, depth " << myDepth << " in " << (ofGetElapsedTimeMicros() - startTime) / 1000.0 << "ms";
+}
+
+//--------------------------------------------------------------
+void PointOctree::buildNode(int nodeIndex, const uint64_t *keys, int level) {
+	Node node = myNodes[nodeIndex];
+	if (node.end - node.begin <= myMaxLeafPoints || level == maxOctreeDepth) {
+		myNumLeaves++;
+		myDepth = max(myDepth, level);
+		return;
+	}
+
+	// The keys are sorted, so each octant is one run of them
+	Node children[8];
+	int numChildren = 0;
+	int first = node.begin;
+	float childHalfSize = node.halfSize * 0.5f;
+	for (int octant = 0; octant < 8 && first < node.end; octant++) {
+		const uint64_t *last = std::partition_point(keys + first, keys + node.end, [&](uint64_t key) {
+			return getOctant(key, level) <= octant;
+		});
+		int end = last - keys;
+		if (end > first) {
+			Node &child = children[numChildren++];
+			child.center = node.center + vec3((octant & 4) ? childHalfSize : -childHalfSize,
+				(octant & 2) ? childHalfSize : -childHalfSize, (octant & 1) ? childHalfSize : -childHalfSize);
+			child.halfSize = childHalfSize;
+			child.begin = first;
+			child.end = end;
+			child.firstChild = -1;
+			child.numChildren = 0;
+		}
+		first = end;
+	}
+
+	int firstChild = myNodes.size();
+	myNodes[nodeIndex].firstChild = firstChild;
+	myNodes[nodeIndex].numChildren = numChildren;
+	myNodes.insert(myNodes.end(), children, children + numChildren);
+	for (int i = 0; i < numChildren; i++) {
+		buildNode(firstChild + i, keys, level + 1);
+	}
+}
+
+//--------------------------------------------------------------
+void PointOctree::clear() {
+	myNodes.clear();
+	myNumPoints = 0;
+	myNumLeaves = 0;
+	myDepth = 0;
+}
+
+//--------------------------------------------------------------
+bool PointOctree::isBuilt() const {
+	return !myNodes.empty();
+}
+
+//--------------------------------------------------------------
+int PointOctree::select(const OctreeView &view, int pointBudget, float pointSpacing, vector<VertexRange> &ranges) const {
+	ranges.clear();
+	myVisibleLeaves.clear();
+	myWantedPoints.clear();
+	if (myNodes.empty()) {
+		return 0;
+	}
+
+	// Frustum planes from the rows of the clip matrix, inside is >= 0
+	const mat4 &m = view.viewProjection;
+	vec4 rows[4];
+	for (int i = 0; i < 4; i++) {
+		rows[i] = vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+	}
+	vec4 planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] };
+
+	float totalWanted = 0;
+	pointSpacing = max(pointSpacing, 0.1f);
+	myStack.clear();
+	myStack.push_back(0);
+	while (!myStack.empty()) {
+		const Node &node = myNodes[myStack.back()];
+		int nodeIndex = myStack.back();
+		myStack.pop_back();
+
+		// Outside if the corner furthest along a plane's normal is behind it
+		bool visible = true;
+		for (int i = 0; i < 6 && visible; i++) {
+			const vec4 &p = planes[i];
+			float reach = node.halfSize * (fabsf(p.x) + fabsf(p.y) + fabsf(p.z));
+			visible = p.x * node.center.x + p.y * node.center.y + p.z * node.center.z + p.w + reach >= 0;
+		}
+		if (!visible) {
+			continue;
+		}
+
+		if (node.firstChild >= 0) {
+			// Pushed in reverse so the leaves come out in memory order
+			for (int i = node.numChildren - 1; i >= 0; i--) {
+				myStack.push_back(node.firstChild + i);
+			}
+			continue;
+		}
+
+		// About enough points to cover the cell's projected size
+		float distance = max(glm::length(node.center - view.position) - node.halfSize * 1.732f, node.halfSize * 0.1f);
+		float pixels = 2 * node.halfSize * view.pixelScale / distance / pointSpacing;
+		float wanted = min(float(node.end - node.begin), pixels * pixels);
+		myVisibleLeaves.push_back(nodeIndex);
+		myWantedPoints.push_back(wanted);
+		totalWanted += wanted;
+	}
+
+	// Over the budget every leaf gives up the same share
+	float share = (pointBudget > 0 && totalWanted > pointBudget) ? pointBudget / totalWanted : 1.0f;
+	int numSelected = 0;
+	for (size_t i = 0; i < myVisibleLeaves.size(); i++) {
+		int count = int(myWantedPoints[i] * share);
+		if (count > 0) {
+			VertexRange range = { myNodes[myVisibleLeaves[i]].begin, count };
+			ranges.push_back(range);
+			numSelected += count;
+		}
+	}
+	return numSelected;
+}
+
+//--------------------------------------------------------------
+int PointOctree::getNumPoints() const {
+	return myNumPoints;
+}
+
+//--------------------------------------------------------------
+int PointOctree::getNumNodes() const {
+	return myNodes.size();
+}
+
+//--------------------------------------------------------------
+int PointOctree::getNumLeaves() const {
+	return myNumLeaves;
+}
+
+//--------------------------------------------------------------
+int PointOctree::getDepth() const {
+	return myDepth;
+}
+
+//--------------------------------------------------------------
+const vector<PointOctree::Node> &PointOctree::getNodes() const {
+	return myNodes;
+}
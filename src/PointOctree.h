@@ -0,0 +1,85 @@
+#pragma once
+
+#include "ofMain.h"
+#include "helpers.h"
+
+using namespace glm;
+
+// Octree over a large point set, for drawing and updating only the
+// points that matter from the current view.
+//
+// build() sorts the points along a Morton curve over a cube around them
+// and cuts the curve into nodes, so every node is a contiguous range of
+// the sorted points. The caller reorders its own arrays with the
+// returned permutation. Keys, bounds and the sort are split across all
+// cores; the nodes themselves are few and found by binary searches.
+//
+// Within a leaf the points are stored in bit-reversed Morton order, so
+// any prefix of a leaf is an even subsample of it. select() culls the
+// nodes against the view frustum and gives each visible leaf as many
+// points as it needs to cover its projected size at the requested
+// spacing, then scales every leaf down alike if the total is over the
+// point budget. The result is a list of vertex ranges, one prefix per
+// visible leaf, in memory order.
+
+// What select() needs to know about the camera
+struct OctreeView {
+	// Projection times view, world to clip space
+	mat4 viewProjection;
+	vec3 position;
+
+	// Pixels covered by one unit at a distance of one unit
+	float pixelScale;
+};
+
+// A synthetic view looking from eye at target, for headless runs
+OctreeView makeOctreeView(const vec3 &eye, const vec3 &target, float fovY, float width, float height);
+
+class PointOctree {
+public:
+	struct Node {
+		vec3 center;
+		float halfSize;
+		int begin;
+		int end;
+
+		// Children are stored next to each other, -1 for leaves
+		int firstChild;
+		int numChildren;
+	};
+
+	PointOctree();
+
+	// Leaves are only split above this many points
+	void setMaxLeafPoints(int maxLeafPoints);
+
+	// order gets, for each point in tree order, its index in positions
+	void build(const vec3 *positions, int numPoints, vector<int> &order);
+	void clear();
+	bool isBuilt() const;
+
+	// Fills ranges with the points to draw from the view, at about
+	// pointSpacing pixels apart and at most pointBudget of them, and
+	// returns how many that is
+	int select(const OctreeView &view, int pointBudget, float pointSpacing, vector<VertexRange> &ranges) const;
+
+	int getNumPoints() const;
+	int getNumNodes() const;
+	int getNumLeaves() const;
+	int getDepth() const;
+	const vector<Node> &getNodes() const;
+
+private:
+	void buildNode(int nodeIndex, const uint64_t *keys, int level);
+
+	vector<Node> myNodes;
+	int myMaxLeafPoints;
+	int myNumPoints;
+	int myNumLeaves;
+	int myDepth;
+
+	// Visible leaves and their wanted point counts, kept between calls
+	mutable vector<int> myVisibleLeaves;
+	mutable vector<float> myWantedPoints;
+	mutable vector<int> myStack;
+};
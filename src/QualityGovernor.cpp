@@ -0,0 +1,257 @@
+#include "QualityGovernor.h"
+
+// Share of the frame interval the CPU work may use, the rest is left for
+// the GPU, the driver and the OS
+const float cpuFrameShare = 0.75;
+
+// Smoothing of the measured times, per frame
+const float timeSmoothing = 0.1;
+
+// Frames over the target before quality is lowered, and the first wait
+// under raiseThreshold times the target before it is raised again
+const int framesToLower = 15;
+const int initialRaiseDelay = 120;
+const int maxRaiseDelay = 3840;
+const float raiseThreshold = 0.7;
+
+// Frames to wait after any change, so the smoothed times reflect it
+const int settleFrames = 30;
+
+// Lowering this soon after raising means the raise didn't fit
+const int relapseFrames = 240;
+
+const int maxGridStep = 6;
+const float gridStepScale = 0.8;
+const int maxUpdateStride = 4;
+const int maxNormalsInterval = 4;
+
+//--------------------------------------------------------------
+QualityGovernor::QualityGovernor() :
+	myEnabled(false), myTargetFrameTime(1000.0 / 60.0 * cpuFrameShare) {
+	reset();
+}
+
+//--------------------------------------------------------------
+void QualityGovernor::setEnabled(bool enabled) {
+	myEnabled = enabled;
+	if (!myEnabled) {
+		reset();
+	}
+}
+
+//--------------------------------------------------------------
+bool QualityGovernor::isEnabled() const {
+	return myEnabled;
+}
+
+//--------------------------------------------------------------
+void QualityGovernor::setTargetFrameRate(float fps) {
+	myTargetFrameTime = 1000.0 / max(fps, 1.0f) * cpuFrameShare;
+}
+
+//--------------------------------------------------------------
+void QualityGovernor::reset() {
+	for (int i = 0; i < NUM_STAGES; i++) {
+		myStageTimes[i] = 0;
+		myFrameStageTimes[i] = 0;
+	}
+	myFrameTime = 0;
+	myHasTimes = false;
+
+	mySteps.clear();
+	myGridStep = 0;
+	myUpdateStride = 1;
+	myNormalsInterval = 1;
+
+	myFramesOver = 0;
+	myFramesUnder = 0;
+	myFramesSinceChange = 0;
+	myFramesSinceRaise = relapseFrames;
+	myRaiseDelay = initialRaiseDelay;
+}
+
+//--------------------------------------------------------------
+void QualityGovernor::addStageTime(Stage stage, float milliseconds) {
+	myFrameStageTimes[stage] += milliseconds;
+}
+
+//--------------------------------------------------------------
+bool QualityGovernor::update(float frameMilliseconds) {
+	// Smooth this frame's times, stages that didn't run count as 0
+	float smoothing = myHasTimes ? timeSmoothing : 1;
+	for (int i = 0; i < NUM_STAGES; i++) {
+		myStageTimes[i] += smoothing * (myFrameStageTimes[i] - myStageTimes[i]);
+		myFrameStageTimes[i] = 0;
+	}
+	myFrameTime += smoothing * (frameMilliseconds - myFrameTime);
+	myHasTimes = true;
+
+	if (!myEnabled) {
+		return false;
+	}
+
+	myFramesSinceChange++;
+	myFramesSinceRaise++;
+	if (myFramesSinceChange < settleFrames) {
+		return false;
+	}
+
+	if (myFrameTime > myTargetFrameTime) {
+		myFramesOver++;
+		myFramesUnder = 0;
+	}
+	else if (myFrameTime < myTargetFrameTime * raiseThreshold) {
+		myFramesUnder++;
+		myFramesOver = 0;
+	}
+	else {
+		myFramesOver = 0;
+		myFramesUnder = 0;
+	}
+
+	bool changed = false;
+	if (myFramesOver >= framesToLower) {
+		if (myFramesSinceRaise < relapseFrames) {
+			myRaiseDelay = min(2 * myRaiseDelay, maxRaiseDelay);
+		}
+		changed = lowerQuality();
+	}
+	else if (myFramesUnder >= myRaiseDelay) {
+		changed = raiseQuality();
+		if (changed) {
+			myFramesSinceRaise = 0;
+		}
+	}
+
+	if (changed) {
+		myFramesSinceChange = 0;
+		myFramesOver = 0;
+		myFramesUnder = 0;
+		ofLogNotice("QualityGovernor") << getSettingsDescription() << " (" << getTimingDescription() << ")";
+	}
+	return changed;
+}
+
+//--------------------------------------------------------------
+bool QualityGovernor::canLower(Lever lever) const {
+	switch (lever) {
+	case LEVER_GRID:
+		// Only helps when there is a point cloud being sampled
+		return myGridStep < maxGridStep && myStageTimes[STAGE_POINT_CLOUD] > 0;
+	case LEVER_STRIDE:
+		return myUpdateStride < maxUpdateStride;
+	case LEVER_NORMALS:
+		return myNormalsInterval < maxNormalsInterval;
+	}
+	return false;
+}
+
+//--------------------------------------------------------------
+void QualityGovernor::applyStep(Lever lever, int direction) {
+	switch (lever) {
+	case LEVER_GRID:
+		myGridStep += direction;
+		break;
+	case LEVER_STRIDE:
+		myUpdateStride += direction;
+		break;
+	case LEVER_NORMALS:
+		myNormalsInterval += direction;
+		break;
+	}
+}
+
+//--------------------------------------------------------------
+bool QualityGovernor::lowerQuality() {
+	// Stages from the most to the least expensive
+	Stage stages[NUM_STAGES] = { STAGE_POINT_CLOUD, STAGE_EFFECTS, STAGE_NORMALS, STAGE_DRAW };
+	sort(stages, stages + NUM_STAGES, [this](Stage a, Stage b) {
+		return myStageTimes[a] > myStageTimes[b];
+	});
+
+	for (Stage stage : stages) {
+		Lever lever = LEVER_GRID;
+		if (stage == STAGE_EFFECTS) {
+			lever = LEVER_STRIDE;
+		}
+		else if (stage == STAGE_NORMALS) {
+			lever = LEVER_NORMALS;
+		}
+		if (myStageTimes[stage] > 0 && canLower(lever)) {
+			applyStep(lever, 1);
+			mySteps.push_back(lever);
+			return true;
+		}
+	}
+	return false;
+}
+
+//--------------------------------------------------------------
+bool QualityGovernor::raiseQuality() {
+	if (mySteps.empty()) {
+		return false;
+	}
+	applyStep(mySteps.back(), -1);
+	mySteps.pop_back();
+	return true;
+}
+
+//--------------------------------------------------------------
+float QualityGovernor::getGridScale() const {
+	return powf(gridStepScale, myGridStep);
+}
+
+//--------------------------------------------------------------
+int QualityGovernor::getUpdateStride() const {
+	return myUpdateStride;
+}
+
+//--------------------------------------------------------------
+int QualityGovernor::getNormalsInterval() const {
+	return myNormalsInterval;
+}
+
+//--------------------------------------------------------------
+float QualityGovernor::getStageTime(Stage stage) const {
+	return myStageTimes[stage];
+}
+
+//--------------------------------------------------------------
+float QualityGovernor::getFrameTime() const {
+	return myFrameTime;
+}
+
+//--------------------------------------------------------------
+const char *QualityGovernor::getStageName(Stage stage) {
+	switch (stage) {
+	case STAGE_POINT_CLOUD:
+		return "cloud";
+	case STAGE_EFFECTS:
+		return "fx";
+	case STAGE_NORMALS:
+		return "nrm";
+	case STAGE_DRAW:
+		return "draw";
+	default:
+		return "";
+	}
+}
+
+//--------------------------------------------------------------
+string QualityGovernor::getSettingsDescription() const {
+	char text[64];
+	snprintf(text, sizeof(text), "grid %d%% stride %d normals 1/%d",
+		int(getGridScale() * 100 + 0.5), myUpdateStride, myNormalsInterval);
+	return text;
+}
+
+//--------------------------------------------------------------
+string QualityGovernor::getTimingDescription() const {
+	char text[96];
+	snprintf(text, sizeof(text), "%s %.1f %s %.1f %s %.1f %s %.1f / %.1fms",
+		getStageName(STAGE_POINT_CLOUD), myStageTimes[STAGE_POINT_CLOUD],
+		getStageName(STAGE_EFFECTS), myStageTimes[STAGE_EFFECTS],
+		getStageName(STAGE_NORMALS), myStageTimes[STAGE_NORMALS],
+		getStageName(STAGE_DRAW), myStageTimes[STAGE_DRAW], myFrameTime);
+	return text;
+}
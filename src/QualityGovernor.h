@@ -0,0 +1,93 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Trades quality for frame time so slow machines still hold the target
+// frame rate.
+//
+// Each frame the app reports how long each stage took and the CPU time
+// of the whole frame. The times are smoothed, and when the frame time
+// stays above the target the governor lowers the quality setting that
+// belongs to the most expensive stage it can still do something about:
+//   point cloud   grid size (and so the adaptive sampling budget)
+//   effects       update stride, only every n-th vertex moves per frame
+//   normals       normals interval, normals are recalculated every n-th
+//                 frame
+//   draw          grid size
+//
+// Hysteresis: quality is lowered after the frame time has been over the
+// target for a while, and only raised again after it has been well
+// under for much longer, undoing the most recent step first. A step up
+// that has to be taken back soon after doubles the wait before the next
+// one, so a machine right at the edge settles instead of flickering
+// between two settings.
+class QualityGovernor {
+public:
+	enum Stage {
+		STAGE_POINT_CLOUD,
+		STAGE_EFFECTS,
+		STAGE_NORMALS,
+		STAGE_DRAW,
+		NUM_STAGES
+	};
+
+	QualityGovernor();
+
+	void setEnabled(bool enabled);
+	bool isEnabled() const;
+	void setTargetFrameRate(float fps);
+
+	// Back to full quality
+	void reset();
+
+	void addStageTime(Stage stage, float milliseconds);
+
+	// Call once per frame after all the stages, with the CPU time the
+	// frame took. Returns true if the quality settings changed.
+	bool update(float frameMilliseconds);
+
+	// Multiplier for the point cloud grid size, 1 is full resolution
+	float getGridScale() const;
+	int getUpdateStride() const;
+	int getNormalsInterval() const;
+
+	float getStageTime(Stage stage) const;
+	float getFrameTime() const;
+	static const char *getStageName(Stage stage);
+
+	// Short descriptions for the GUI
+	string getSettingsDescription() const;
+	string getTimingDescription() const;
+
+private:
+	enum Lever {
+		LEVER_GRID,
+		LEVER_STRIDE,
+		LEVER_NORMALS
+	};
+
+	bool lowerQuality();
+	bool raiseQuality();
+	bool canLower(Lever lever) const;
+	void applyStep(Lever lever, int direction);
+
+	bool myEnabled;
+	float myTargetFrameTime;
+
+	float myStageTimes[NUM_STAGES];
+	float myFrameStageTimes[NUM_STAGES];
+	float myFrameTime;
+	bool myHasTimes;
+
+	// Steps taken down, undone from the back
+	vector<Lever> mySteps;
+	int myGridStep;
+	int myUpdateStride;
+	int myNormalsInterval;
+
+	int myFramesOver;
+	int myFramesUnder;
+	int myFramesSinceChange;
+	int myFramesSinceRaise;
+	int myRaiseDelay;
+};
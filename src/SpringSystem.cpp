@@ -0,0 +1,247 @@
+#include "SpringSystem.h"
+#include "parallel.h"
+
+// Springs at a vertex that has run out of colours
+static const int serialColor = 64;
+
+//--------------------------------------------------------------
+SpringSystem::SpringSystem() :
+	myGravity(0, -500, 0), myDamping(0.02), myStiffness(1.0), myNumIterations(8), myPinHeight(0.05),
+	myPinnedHeight(-1), myLastTime(0), myHasLastTime(false) {
+}
+
+//--------------------------------------------------------------
+void SpringSystem::setup(const vec3 *positions, int numVertices, const ofIndexType *edgeIndices, int numEdgeIndices) {
+	uint64_t startTime = ofGetElapsedTimeMicros();
+
+	// Each edge once, lower index first
+	vector<uint64_t> edges;
+	edges.reserve(numEdgeIndices / 2);
+	for (int i = 0; i + 1 < numEdgeIndices; i += 2) {
+		uint64_t a = edgeIndices[i];
+		uint64_t b = edgeIndices[i + 1];
+		if (a != b && a < uint64_t(numVertices) && b < uint64_t(numVertices)) {
+			edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+		}
+	}
+	sort(edges.begin(), edges.end());
+	edges.erase(unique(edges.begin(), edges.end()), edges.end());
+	if (edges.empty()) {
+		// Nothing to simulate, point clouds can be too big to copy for it
+		clear();
+		return;
+	}
+
+	myRestPositions.assign(positions, positions + numVertices);
+	myInverseMasses.assign(numVertices, 1.0);
+	myPinnedHeight = -1;
+
+	// Greedy colouring, each spring gets the lowest colour neither of its
+	// vertices has yet
+	vector<uint64_t> usedColors(numVertices, 0);
+	vector<uint8_t> colors(edges.size());
+	int numColors = 0;
+	for (size_t i = 0; i < edges.size(); i++) {
+		uint32_t a = edges[i] >> 32;
+		uint32_t b = edges[i] & 0xFFFFFFFF;
+		uint64_t used = usedColors[a] | usedColors[b];
+		int color = 0;
+		while (color < serialColor && (used >> color) & 1) {
+			color++;
+		}
+		if (color < serialColor) {
+			usedColors[a] |= uint64_t(1) << color;
+			usedColors[b] |= uint64_t(1) << color;
+			numColors = max(numColors, color + 1);
+		}
+		colors[i] = color;
+	}
+
+	// Sort by colour, keeping the vertex order within each colour
+	vector<int> counts(serialColor + 1, 0);
+	for (uint8_t color : colors) {
+		counts[color]++;
+	}
+	myColorStarts.assign(numColors + 2, 0);
+	for (int color = 0; color < numColors; color++) {
+		myColorStarts[color + 1] = myColorStarts[color] + counts[color];
+	}
+	myColorStarts[numColors + 1] = myColorStarts[numColors] + counts[serialColor];
+
+	vector<int> next(myColorStarts.begin(), myColorStarts.end() - 1);
+	mySprings.resize(edges.size());
+	for (size_t i = 0; i < edges.size(); i++) {
+		int group = colors[i] == serialColor ? numColors : colors[i];
+		Spring &spring = mySprings[next[group]++];
+		spring.a = edges[i] >> 32;
+		spring.b = edges[i] & 0xFFFFFFFF;
+		spring.restLength = distance(positions[spring.a], positions[spring.b]);
+	}
+
+	reset();
+	ofLogNotice("SpringSystem::setup") << mySprings.size() << " springs in " << numColors << " colours ("
+		<< counts[serialColor] << " serial) in " << (ofGetElapsedTimeMicros() - startTime) / 1000.0 << "ms";
+}
+
+//--------------------------------------------------------------
+void SpringSystem::clear() {
+	myRestPositions.clear();
+	myPositions.clear();
+	myPreviousPositions.clear();
+	myInverseMasses.clear();
+	mySprings.clear();
+	myColorStarts.clear();
+}
+
+//--------------------------------------------------------------
+bool SpringSystem::isSetup() const {
+	return !myRestPositions.empty();
+}
+
+//--------------------------------------------------------------
+void SpringSystem::reset() {
+	myPositions = myRestPositions;
+	myPreviousPositions = myRestPositions;
+	myHasLastTime = false;
+}
+
+//--------------------------------------------------------------
+void SpringSystem::setGravity(const vec3 &gravity) {
+	myGravity = gravity;
+}
+
+//--------------------------------------------------------------
+void SpringSystem::setDamping(float damping) {
+	myDamping = ofClamp(damping, 0, 1);
+}
+
+//--------------------------------------------------------------
+void SpringSystem::setStiffness(float stiffness) {
+	myStiffness = ofClamp(stiffness, 0, 1);
+}
+
+//--------------------------------------------------------------
+void SpringSystem::setNumIterations(int numIterations) {
+	myNumIterations = max(numIterations, 1);
+}
+
+//--------------------------------------------------------------
+void SpringSystem::setPinHeight(float pinHeight) {
+	myPinHeight = ofClamp(pinHeight, 0, 1);
+}
+
+//--------------------------------------------------------------
+void SpringSystem::updatePins() {
+	if (myPinHeight == myPinnedHeight || myRestPositions.empty()) {
+		return;
+	}
+	myPinnedHeight = myPinHeight;
+
+	float minY = myRestPositions[0].y;
+	float maxY = myRestPositions[0].y;
+	for (const vec3 &p : myRestPositions) {
+		minY = min(minY, p.y);
+		maxY = max(maxY, p.y);
+	}
+
+	// Pinned vertices go back to where they started
+	float pinY = maxY - myPinHeight * (maxY - minY);
+	for (size_t i = 0; i < myRestPositions.size(); i++) {
+		bool pinned = myPinHeight > 0 && myRestPositions[i].y >= pinY;
+		myInverseMasses[i] = pinned ? 0.0 : 1.0;
+		if (pinned) {
+			myPositions[i] = myRestPositions[i];
+			myPreviousPositions[i] = myRestPositions[i];
+		}
+	}
+}
+
+//--------------------------------------------------------------
+void SpringSystem::integrate(float timestep) {
+	float keep = powf(1.0 - myDamping, timestep * 60.0);
+	vec3 acceleration = myGravity * timestep * timestep;
+	vec3 *positions = myPositions.data();
+	vec3 *previous = myPreviousPositions.data();
+	const float *inverseMasses = myInverseMasses.data();
+
+	parallelFor(0, myPositions.size(), [=](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			if (inverseMasses[i] == 0) {
+				continue;
+			}
+			vec3 p = positions[i];
+			positions[i] = p + (p - previous[i]) * keep + acceleration;
+			previous[i] = p;
+		}
+	});
+}
+
+//--------------------------------------------------------------
+void SpringSystem::solveSprings(int begin, int end) {
+	vec3 *positions = myPositions.data();
+	const float *inverseMasses = myInverseMasses.data();
+	for (int i = begin; i < end; i++) {
+		const Spring &spring = mySprings[i];
+		float wa = inverseMasses[spring.a];
+		float wb = inverseMasses[spring.b];
+		vec3 delta = positions[spring.b] - positions[spring.a];
+		float length = glm::length(delta);
+		if (wa + wb == 0 || length < 1e-6) {
+			continue;
+		}
+
+		// Split the correction by inverse mass
+		vec3 correction = delta * (myStiffness * (length - spring.restLength) / (length * (wa + wb)));
+		positions[spring.a] += correction * wa;
+		positions[spring.b] -= correction * wb;
+	}
+}
+
+//--------------------------------------------------------------
+void SpringSystem::update(float time) {
+	if (!isSetup()) {
+		return;
+	}
+	float timestep = myHasLastTime ? time - myLastTime : 1.0 / 60.0;
+	myLastTime = time;
+	myHasLastTime = true;
+	if (timestep <= 0) {
+		return;
+	}
+	timestep = min(timestep, 1.0f / 30.0f);
+
+	updatePins();
+	integrate(timestep);
+
+	// Springs of one colour share no vertices, so each colour can be
+	// spread over the threads
+	int numColors = getNumColors();
+	for (int iteration = 0; iteration < myNumIterations; iteration++) {
+		for (int color = 0; color < numColors; color++) {
+			parallelFor(myColorStarts[color], myColorStarts[color + 1], [this](int begin, int end) {
+				solveSprings(begin, end);
+			}, 512);
+		}
+		solveSprings(myColorStarts[numColors], myColorStarts[numColors + 1]);
+	}
+}
+
+//--------------------------------------------------------------
+const vec3 *SpringSystem::getPositions() const {
+	return myPositions.data();
+}
+
+//--------------------------------------------------------------
+int SpringSystem::getNumVertices() const {
+	return myPositions.size();
+}
+
+//--------------------------------------------------------------
+int SpringSystem::getNumSprings() const {
+	return mySprings.size();
+}
+
+//--------------------------------------------------------------
+int SpringSystem::getNumColors() const {
+	return max(int(myColorStarts.size()) - 2, 0);
+}
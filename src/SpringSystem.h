@@ -0,0 +1,87 @@
+#pragma once
+
+#include "ofMain.h"
+
+using namespace glm;
+
+// Spring-mass simulation over the edges of a mesh.
+//
+// Every vertex is a unit mass moved with Verlet integration under
+// gravity and damping, every edge a spring that keeps its rest length.
+// The springs are solved as position constraints (Gauss-Seidel, a few
+// iterations per step), and the vertices in the top band of the mesh
+// are pinned so it hangs instead of falling away.
+//
+// Solving a spring moves both its vertices, so two springs sharing a
+// vertex can't be solved at the same time. The springs are coloured so
+// that no two springs of the same colour share a vertex and sorted by
+// colour; each colour is then solved with parallelFor and the colours
+// one after another. Triangle meshes need about as many colours as
+// their highest vertex degree plus one. Springs at a vertex with more
+// than 64 neighbours go into an extra group that is solved on one
+// thread. The result doesn't depend on the number of threads.
+class SpringSystem {
+public:
+	SpringSystem();
+
+	// Springs along the given edges (two indices each, duplicates are
+	// fine), at rest in the given positions
+	void setup(const vec3 *positions, int numVertices, const ofIndexType *edgeIndices, int numEdgeIndices);
+	void clear();
+	bool isSetup() const;
+
+	// Back to the rest positions, at rest
+	void reset();
+
+	// Units per second squared
+	void setGravity(const vec3 &gravity);
+
+	// Fraction of the velocity lost per 1/60 s
+	void setDamping(float damping);
+
+	// Fraction of each spring's error corrected per iteration, 0 to 1
+	void setStiffness(float stiffness);
+	void setNumIterations(int numIterations);
+
+	// Fraction of the mesh height, from the top, that is pinned in place
+	void setPinHeight(float pinHeight);
+
+	// Advances to the given time, the first step after setup or reset
+	// takes 1/60 s and no step more than 1/30 s
+	void update(float time);
+
+	const vec3 *getPositions() const;
+	int getNumVertices() const;
+	int getNumSprings() const;
+	int getNumColors() const;
+
+private:
+	struct Spring {
+		uint32_t a;
+		uint32_t b;
+		float restLength;
+	};
+
+	void updatePins();
+	void integrate(float timestep);
+	void solveSprings(int begin, int end);
+
+	vector<vec3> myRestPositions;
+	vector<vec3> myPositions;
+	vector<vec3> myPreviousPositions;
+	vector<float> myInverseMasses;
+	vector<Spring> mySprings;
+
+	// Springs of colour c are [myColorStarts[c], myColorStarts[c + 1]),
+	// the last group is the one solved on a single thread
+	vector<int> myColorStarts;
+
+	vec3 myGravity;
+	float myDamping;
+	float myStiffness;
+	int myNumIterations;
+	float myPinHeight;
+	float myPinnedHeight;
+	float myLastTime;
+	bool myHasLastTime;
+};
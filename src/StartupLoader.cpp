@@ -0,0 +1,149 @@
+#include "StartupLoader.h"
+
+//--------------------------------------------------------------
+StartupLoader::StartupLoader() :
+	myNumFinished(0), myStarted(false), myStartTime(0), myEndTime(0) {
+}
+
+//--------------------------------------------------------------
+StartupLoader::~StartupLoader() {
+	// Closing the app while it loads, the work steps still have to end
+	// before what they write to goes away
+	for (size_t i = 0; i < myTasks.size(); i++) {
+		if (myTasks[i]->worker.joinable()) {
+			myTasks[i]->worker.join();
+		}
+	}
+}
+
+//--------------------------------------------------------------
+int StartupLoader::addTask(const string &name, const Step &work, const Step &finish, const vector<int> &dependencies) {
+	unique_ptr<Task> task(new Task());
+	task->name = name;
+	task->work = work;
+	task->finish = finish;
+	task->dependencies = dependencies;
+	task->state = TASK_WAITING;
+	task->workDone = false;
+	task->startTime = 0;
+	myTasks.push_back(std::move(task));
+	return myTasks.size() - 1;
+}
+
+//--------------------------------------------------------------
+void StartupLoader::start() {
+	myStarted = true;
+	myStartTime = ofGetElapsedTimeMicros();
+	myEndTime = myStartTime;
+	startReadyTasks();
+}
+
+//--------------------------------------------------------------
+void StartupLoader::startReadyTasks() {
+	for (size_t i = 0; i < myTasks.size(); i++) {
+		Task &task = *myTasks[i];
+		if (task.state != TASK_WAITING) {
+			continue;
+		}
+		bool ready = true;
+		for (int dependency : task.dependencies) {
+			ready = ready && myTasks[dependency]->state == TASK_FINISHED;
+		}
+		if (!ready) {
+			continue;
+		}
+
+		task.startTime = ofGetElapsedTimeMicros();
+		if (task.work) {
+			task.state = TASK_WORKING;
+			Task *running = &task;
+			task.worker = thread([running] {
+				running->work();
+				running->workDone = true;
+			});
+		}
+		else {
+			task.state = TASK_WORKED;
+		}
+	}
+}
+
+//--------------------------------------------------------------
+void StartupLoader::collectWorkers() {
+	for (size_t i = 0; i < myTasks.size(); i++) {
+		Task &task = *myTasks[i];
+		if (task.state == TASK_WORKING && task.workDone) {
+			task.worker.join();
+			task.state = TASK_WORKED;
+		}
+	}
+}
+
+//--------------------------------------------------------------
+void StartupLoader::update() {
+	if (!myStarted || isDone()) {
+		return;
+	}
+	collectWorkers();
+
+	// One finish step per frame, in the order the tasks were added
+	for (size_t i = 0; i < myTasks.size(); i++) {
+		Task &task = *myTasks[i];
+		if (task.state == TASK_WORKED) {
+			if (task.finish) {
+				task.finish();
+			}
+			task.state = TASK_FINISHED;
+			myNumFinished++;
+			ofLogNotice("StartupLoader") << task.name << " took " << (ofGetElapsedTimeMicros() - task.startTime) / 1000 << "ms";
+			break;
+		}
+	}
+	startReadyTasks();
+
+	if (isDone()) {
+		myEndTime = ofGetElapsedTimeMicros();
+		ofLogNotice("StartupLoader") << "startup took " << getElapsedTime() << "ms";
+	}
+}
+
+//--------------------------------------------------------------
+bool StartupLoader::isStarted() const {
+	return myStarted;
+}
+
+//--------------------------------------------------------------
+bool StartupLoader::isDone() const {
+	return myStarted && myNumFinished == int(myTasks.size());
+}
+
+//--------------------------------------------------------------
+int StartupLoader::getNumTasks() const {
+	return myTasks.size();
+}
+
+//--------------------------------------------------------------
+int StartupLoader::getNumFinished() const {
+	return myNumFinished;
+}
+
+//--------------------------------------------------------------
+string StartupLoader::getStatus() const {
+	string status;
+	for (size_t i = 0; i < myTasks.size(); i++) {
+		TaskState state = myTasks[i]->state;
+		if (state == TASK_WORKING || state == TASK_WORKED) {
+			status += (status.empty() ? "" : ", ") + myTasks[i]->name;
+		}
+	}
+	return status;
+}
+
+//--------------------------------------------------------------
+float StartupLoader::getElapsedTime() const {
+	if (!myStarted) {
+		return 0;
+	}
+	uint64_t endTime = isDone() ? myEndTime : ofGetElapsedTimeMicros();
+	return (endTime - myStartTime) / 1000.0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Runs the app's startup as a small task graph instead of one long
+// blocking setup().
+//
+// Each task has a work step that runs on its own thread, for file
+// parsing, image decoding and opening devices, and a finish step that
+// runs on the main thread, for GL uploads and anything else that has to
+// happen there. Either can be empty. A task starts once every task it
+// depends on has finished both steps, so independent work overlaps.
+// update() runs at most one finish step per call, so the app keeps
+// drawing frames while it loads.
+
+class StartupLoader {
+public:
+	typedef std::function<void()> Step;
+
+	StartupLoader();
+	~StartupLoader();
+
+	// Returns the task's id for use as a dependency of later tasks
+	int addTask(const string &name, const Step &work, const Step &finish, const vector<int> &dependencies = vector<int>());
+
+	// Starts the tasks that don't depend on anything
+	void start();
+
+	// Call from the main thread every frame until isDone()
+	void update();
+
+	bool isStarted() const;
+	bool isDone() const;
+	int getNumTasks() const;
+	int getNumFinished() const;
+
+	// The tasks running or waiting for the main thread, e.g. "mesh, kinect"
+	string getStatus() const;
+
+	// Milliseconds since start(), or the whole startup once done
+	float getElapsedTime() const;
+
+private:
+	enum TaskState {
+		TASK_WAITING,
+		TASK_WORKING,
+		TASK_WORKED,
+		TASK_FINISHED
+	};
+
+	struct Task {
+		string name;
+		Step work;
+		Step finish;
+		vector<int> dependencies;
+		TaskState state;
+		thread worker;
+		atomic<bool> workDone;
+		uint64_t startTime;
+	};
+
+	void startReadyTasks();
+	void collectWorkers();
+
+	vector<unique_ptr<Task>> myTasks;
+	int myNumFinished;
+	bool myStarted;
+	uint64_t myStartTime;
+	uint64_t myEndTime;
+};
@@ -0,0 +1,1225 @@
+#include "StreamingMeshProcessor.h"
+#include "parallel.h"
+
+typedef StreamingMeshProcessor::CellKey CellKey;
+typedef StreamingMeshProcessor::Triangle Triangle;
+typedef StreamingMeshProcessor::CellVertex CellVertex;
+
+// Coarse cells along the longest axis, each chunk is a box of them
+const int coarseResolution = 64;
+
+// Bytes a chunk needs per triangle it gets while it's processed: the
+// triangle, its cell keys, the sorted copy for finding repeats, the
+// cells' positions and normals and the lookups of neighbouring cells
+const uint64_t bytesPerChunkTriangle = 256;
+
+// Triangles read, routed or written at a time
+const int triangleBlockSize = 1 << 16;
+
+// Cells read at a time from the tables of neighbouring chunks
+const int tableBlockSize = 1 << 12;
+
+//--------------------------------------------------------------
+static inline bool operator<(const CellKey &a, const CellKey &b) {
+	if (a.x != b.x) return a.x < b.x;
+	if (a.y != b.y) return a.y < b.y;
+	return a.z < b.z;
+}
+
+//--------------------------------------------------------------
+static inline bool operator==(const CellKey &a, const CellKey &b) {
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+//--------------------------------------------------------------
+// Minimal streaming PLY reader, ASCII or binary of either byte order.
+// Records are decoded straight from a block of the file, only the
+// positions and face indices are converted.
+enum PlyType {
+	PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_INVALID
+};
+
+struct PlyProperty {
+	string name;
+	PlyType type;
+	bool isList;
+	PlyType countType;
+
+	// What the reader keeps of it: a position axis, or -1, and whether
+	// it's the face's index list
+	int axis;
+	bool isIndices;
+};
+
+struct PlyElement {
+	string name;
+	uint64_t count;
+	vector<PlyProperty> properties;
+};
+
+//--------------------------------------------------------------
+static PlyType parsePlyType(const string &name) {
+	if (name == "char" || name == "int8") return PLY_INT8;
+	if (name == "uchar" || name == "uint8") return PLY_UINT8;
+	if (name == "short" || name == "int16") return PLY_INT16;
+	if (name == "ushort" || name == "uint16") return PLY_UINT16;
+	if (name == "int" || name == "int32") return PLY_INT32;
+	if (name == "uint" || name == "uint32") return PLY_UINT32;
+	if (name == "float" || name == "float32") return PLY_FLOAT32;
+	if (name == "double" || name == "float64") return PLY_FLOAT64;
+	return PLY_INVALID;
+}
+
+//--------------------------------------------------------------
+static int getPlyTypeSize(PlyType type) {
+	switch (type) {
+	case PLY_INT8: case PLY_UINT8: return 1;
+	case PLY_INT16: case PLY_UINT16: return 2;
+	case PLY_INT32: case PLY_UINT32: case PLY_FLOAT32: return 4;
+	case PLY_FLOAT64: return 8;
+	default: return 0;
+	}
+}
+
+//--------------------------------------------------------------
+class PlyInput {
+public:
+	PlyInput() : myAscii(false), mySwap(false), myPos(0), myEnd(0), myEof(false) {
+	}
+
+	bool open(const string &path) {
+		myFile.open(path, ios::binary);
+		if (!myFile) {
+			return false;
+		}
+		myBuffer.resize(1 << 20);
+
+		string line;
+		if (!readLine(line) || line != "ply") {
+			return false;
+		}
+		while (readLine(line)) {
+			vector<string> words = ofSplitString(line, " ", true, true);
+			if (words.empty() || words[0] == "comment" || words[0] == "obj_info") {
+				continue;
+			}
+			if (words[0] == "end_header") {
+				return true;
+			}
+			if (words[0] == "format" && words.size() >= 2) {
+				myAscii = words[1] == "ascii";
+				bool bigEndian = words[1] == "binary_big_endian";
+				if (!myAscii && !bigEndian && words[1] != "binary_little_endian") {
+					return false;
+				}
+				uint16_t one = 1;
+				bool hostBigEndian = *reinterpret_cast<uint8_t *>(&one) == 0;
+				mySwap = !myAscii && bigEndian != hostBigEndian;
+			}
+			else if (words[0] == "element" && words.size() >= 3) {
+				PlyElement element;
+				element.name = words[1];
+				element.count = strtoull(words[2].c_str(), nullptr, 10);
+				myElements.push_back(element);
+			}
+			else if (words[0] == "property" && !myElements.empty()) {
+				PlyProperty property;
+				property.isList = words.size() >= 5 && words[1] == "list";
+				if (property.isList) {
+					property.countType = parsePlyType(words[2]);
+					property.type = parsePlyType(words[3]);
+					property.name = words[4];
+				}
+				else if (words.size() >= 3) {
+					property.countType = PLY_INVALID;
+					property.type = parsePlyType(words[1]);
+					property.name = words[2];
+				}
+				else {
+					property.type = PLY_INVALID;
+				}
+				if (property.type == PLY_INVALID || (property.isList && property.countType == PLY_INVALID)) {
+					return false;
+				}
+				const string &element = myElements.back().name;
+				bool isAxis = !property.isList && property.name.size() == 1 && property.name[0] >= 'x' && property.name[0] <= 'z';
+				property.axis = element == "vertex" && isAxis ? property.name[0] - 'x' : -1;
+				property.isIndices = element == "face" && property.isList
+					&& (property.name == "vertex_indices" || property.name == "vertex_index");
+				myElements.back().properties.push_back(property);
+			}
+		}
+		return false;
+	}
+
+	const vector<PlyElement> &getElements() const {
+		return myElements;
+	}
+
+	// Reads the next record of the element, its position into position
+	// and its index list into indices
+	bool readRecord(const PlyElement &element, vec3 &position, vector<uint32_t> &indices) {
+		indices.clear();
+		for (const PlyProperty &property : element.properties) {
+			if (!property.isList) {
+				if (property.axis >= 0) {
+					if (!readValue(property.type, position[property.axis])) {
+						return false;
+					}
+				}
+				else if (!skipValue(property.type)) {
+					return false;
+				}
+				continue;
+			}
+
+			uint32_t count;
+			if (!readValue(property.countType, count)) {
+				return false;
+			}
+			if (property.isIndices) {
+				indices.resize(count);
+				for (uint32_t j = 0; j < count; j++) {
+					if (!readValue(property.type, indices[j])) {
+						return false;
+					}
+				}
+			}
+			else {
+				for (uint32_t j = 0; j < count; j++) {
+					if (!skipValue(property.type)) {
+						return false;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	// Reads the positions of the next count records of the element.
+	// Binary records without lists are decoded a block at a time.
+	bool readPositions(const PlyElement &element, vec3 *positions, size_t count) {
+		size_t recordSize = 0;
+		size_t offsets[3] = { 0, 0, 0 };
+		PlyType types[3] = { PLY_INVALID, PLY_INVALID, PLY_INVALID };
+		for (const PlyProperty &property : element.properties) {
+			if (property.isList) {
+				recordSize = 0;
+				break;
+			}
+			if (property.axis >= 0) {
+				offsets[property.axis] = recordSize;
+				types[property.axis] = property.type;
+			}
+			recordSize += getPlyTypeSize(property.type);
+		}
+
+		if (myAscii || recordSize == 0) {
+			vector<uint32_t> indices;
+			for (size_t i = 0; i < count; i++) {
+				positions[i] = vec3(0, 0, 0);
+				if (!readRecord(element, positions[i], indices)) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		size_t blockRecords = max(size_t(1), (myBuffer.size() - 1) / recordSize);
+		while (count > 0) {
+			size_t numRecords = min(count, blockRecords);
+			if (!fill(numRecords * recordSize)) {
+				return false;
+			}
+			const uint8_t *record = reinterpret_cast<const uint8_t *>(myBuffer.data()) + myPos;
+			for (size_t i = 0; i < numRecords; i++) {
+				for (int axis = 0; axis < 3; axis++) {
+					positions[i][axis] = types[axis] == PLY_INVALID ? 0 : decodeValue<float>(types[axis], record + offsets[axis]);
+				}
+				record += recordSize;
+			}
+			myPos += numRecords * recordSize;
+			positions += numRecords;
+			count -= numRecords;
+		}
+		return true;
+	}
+
+private:
+	// Makes at least size bytes available from myPos, fewer only at the
+	// end of the file. The byte after the data is always 0 so ASCII
+	// numbers can be parsed in place.
+	bool fill(size_t size) {
+		if (myEnd - myPos >= size || myEof) {
+			return myEnd - myPos >= size;
+		}
+		memmove(myBuffer.data(), myBuffer.data() + myPos, myEnd - myPos);
+		myEnd -= myPos;
+		myPos = 0;
+		if (myBuffer.size() < size + 1) {
+			myBuffer.resize(size + 1);
+		}
+		while (myEnd < size && !myEof) {
+			myFile.read(myBuffer.data() + myEnd, myBuffer.size() - 1 - myEnd);
+			myEnd += size_t(myFile.gcount());
+			myEof = !myFile;
+		}
+		myBuffer[myEnd] = 0;
+		return myEnd - myPos >= size;
+	}
+
+	template<typename T>
+	bool readValue(PlyType type, T &value) {
+		if (myAscii) {
+			if (!fillToken()) {
+				return false;
+			}
+			char *start = myBuffer.data() + myPos;
+			char *end;
+			if (type == PLY_FLOAT32 || type == PLY_FLOAT64) {
+				value = T(strtod(start, &end));
+			}
+			else {
+				value = T(strtoll(start, &end, 10));
+			}
+			myPos += end - start;
+			return end != start;
+		}
+
+		int size = getPlyTypeSize(type);
+		if (!fill(size)) {
+			return false;
+		}
+		value = decodeValue<T>(type, reinterpret_cast<const uint8_t *>(myBuffer.data()) + myPos);
+		myPos += size;
+		return true;
+	}
+
+	// Converts one binary value straight to T
+	template<typename T>
+	T decodeValue(PlyType type, const uint8_t *bytes) const {
+		uint8_t swapped[8];
+		if (mySwap) {
+			int size = getPlyTypeSize(type);
+			for (int i = 0; i < size; i++) {
+				swapped[i] = bytes[size - 1 - i];
+			}
+			bytes = swapped;
+		}
+		switch (type) {
+		case PLY_INT8: return T(int8_t(bytes[0]));
+		case PLY_UINT8: return T(bytes[0]);
+		case PLY_INT16: return T(copyValue<int16_t>(bytes));
+		case PLY_UINT16: return T(copyValue<uint16_t>(bytes));
+		case PLY_INT32: return T(copyValue<int32_t>(bytes));
+		case PLY_UINT32: return T(copyValue<uint32_t>(bytes));
+		case PLY_FLOAT32: return T(copyValue<float>(bytes));
+		case PLY_FLOAT64: return T(copyValue<double>(bytes));
+		default: return T(0);
+		}
+	}
+
+	bool skipValue(PlyType type) {
+		if (myAscii) {
+			if (!fillToken()) {
+				return false;
+			}
+			while (myPos < myEnd && !isSpace(myBuffer[myPos])) {
+				myPos++;
+			}
+			return true;
+		}
+		size_t size = getPlyTypeSize(type);
+		if (!fill(size)) {
+			return false;
+		}
+		myPos += size;
+		return true;
+	}
+
+	// Skips to the next ASCII token and makes sure all of it is in the
+	// buffer, no number in a PLY file is longer than this
+	bool fillToken() {
+		const size_t longestToken = 128;
+		while (true) {
+			fill(longestToken);
+			while (myPos < myEnd && isSpace(myBuffer[myPos])) {
+				myPos++;
+			}
+			if (myPos < myEnd) {
+				fill(longestToken);
+				return true;
+			}
+			if (myEof) {
+				return false;
+			}
+		}
+	}
+
+	static inline bool isSpace(char c) {
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+
+	template<typename T>
+	static T copyValue(const uint8_t *bytes) {
+		T value;
+		memcpy(&value, bytes, sizeof(T));
+		return value;
+	}
+
+	bool readLine(string &line) {
+		line.clear();
+		while (true) {
+			fill(1);
+			if (myPos == myEnd) {
+				return !line.empty();
+			}
+			const char *start = myBuffer.data() + myPos;
+			const char *newline = static_cast<const char *>(memchr(start, '\n', myEnd - myPos));
+			size_t length = newline ? size_t(newline - start) : myEnd - myPos;
+			line.append(start, length);
+			myPos += length;
+			if (newline) {
+				myPos++;
+				if (!line.empty() && line.back() == '\r') {
+					line.pop_back();
+				}
+				return true;
+			}
+		}
+	}
+
+	ifstream myFile;
+	vector<PlyElement> myElements;
+	bool myAscii;
+	bool mySwap;
+	vector<char> myBuffer;
+	size_t myPos;
+	size_t myEnd;
+	bool myEof;
+};
+
+//--------------------------------------------------------------
+template<typename T>
+static bool readArray(const string &path, vector<T> &values) {
+	ifstream file(path, ios::binary | ios::ate);
+	if (!file) {
+		return false;
+	}
+	values.resize(size_t(file.tellg()) / sizeof(T));
+	file.seekg(0);
+	file.read(reinterpret_cast<char *>(values.data()), values.size() * sizeof(T));
+	return bool(file) || values.empty();
+}
+
+//--------------------------------------------------------------
+// Writes the values to a new file, or to the end of it. Temporary files
+// that can't be written fail the run, a full disk would otherwise leave
+// a corrupt mesh.
+template<typename T>
+static bool writeArray(const string &path, const T *values, size_t count, bool append = false) {
+	ofstream file(path, ios::binary | (append ? ios::app : ios::trunc));
+	file.write(reinterpret_cast<const char *>(values), count * sizeof(T));
+	file.close();
+	if (file.fail()) {
+		ofLogError("StreamingMeshProcessor") << "could not write " << path;
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+// Closes a file written in several steps and reports if any failed
+static bool closeFile(ofstream &file, const string &path) {
+	file.close();
+	if (file.fail()) {
+		ofLogError("StreamingMeshProcessor") << "could not write " << path;
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+StreamingMeshProcessor::StreamingMeshProcessor() :
+	myWeldThreshold(0.0001), myCellSize(0), myMemoryBudget(uint64_t(4) << 30), myAsciiOutput(false),
+	myNumInputVertices(0), myNumInputTriangles(0), myNumOutputVertices(0), myNumOutputTriangles(0), myNumWindows(0),
+	myGridCellSize(1), myCellsPerCoarse(1), myNumChunks(0) {
+	myCoarseSize[0] = myCoarseSize[1] = myCoarseSize[2] = 1;
+}
+
+//--------------------------------------------------------------
+void StreamingMeshProcessor::setWeldThreshold(float threshold) {
+	myWeldThreshold = max(threshold, 0.0f);
+}
+
+//--------------------------------------------------------------
+float StreamingMeshProcessor::getWeldThreshold() const {
+	return myWeldThreshold;
+}
+
+//--------------------------------------------------------------
+void StreamingMeshProcessor::setCellSize(float cellSize) {
+	myCellSize = max(cellSize, 0.0f);
+}
+
+//--------------------------------------------------------------
+float StreamingMeshProcessor::getCellSize() const {
+	return myCellSize;
+}
+
+//--------------------------------------------------------------
+void StreamingMeshProcessor::setMemoryBudget(uint64_t bytes) {
+	myMemoryBudget = max(bytes, uint64_t(1) << 20);
+}
+
+//--------------------------------------------------------------
+uint64_t StreamingMeshProcessor::getMemoryBudget() const {
+	return myMemoryBudget;
+}
+
+//--------------------------------------------------------------
+void StreamingMeshProcessor::setAsciiOutput(bool ascii) {
+	myAsciiOutput = ascii;
+}
+
+//--------------------------------------------------------------
+bool StreamingMeshProcessor::isAsciiOutput() const {
+	return myAsciiOutput;
+}
+
+//--------------------------------------------------------------
+uint64_t StreamingMeshProcessor::getNumInputVertices() const {
+	return myNumInputVertices;
+}
+
+//--------------------------------------------------------------
+uint64_t StreamingMeshProcessor::getNumInputTriangles() const {
+	return myNumInputTriangles;
+}
+
+//--------------------------------------------------------------
+uint64_t StreamingMeshProcessor::getNumOutputVertices() const {
+	return myNumOutputVertices;
+}
+
+//--------------------------------------------------------------
+uint64_t StreamingMeshProcessor::getNumOutputTriangles() const {
+	return myNumOutputTriangles;
+}
+
+//--------------------------------------------------------------
+int StreamingMeshProcessor::getNumChunks() const {
+	return myNumChunks;
+}
+
+//--------------------------------------------------------------
+int StreamingMeshProcessor::getNumWindows() const {
+	return myNumWindows;
+}
+
+//--------------------------------------------------------------
+inline CellKey StreamingMeshProcessor::getCellKey(const vec3 &p) const {
+	// In double so every stage gets exactly the same cell
+	CellKey key;
+	key.x = int32_t(floor((double(p.x) - myLow.x) / myGridCellSize));
+	key.y = int32_t(floor((double(p.y) - myLow.y) / myGridCellSize));
+	key.z = int32_t(floor((double(p.z) - myLow.z) / myGridCellSize));
+	return key;
+}
+
+//--------------------------------------------------------------
+inline int StreamingMeshProcessor::getChunk(const CellKey &key) const {
+	int x = min(key.x / myCellsPerCoarse, myCoarseSize[0] - 1);
+	int y = min(key.y / myCellsPerCoarse, myCoarseSize[1] - 1);
+	int z = min(key.z / myCellsPerCoarse, myCoarseSize[2] - 1);
+	return myCoarseChunks[(z * myCoarseSize[1] + y) * myCoarseSize[0] + x];
+}
+
+//--------------------------------------------------------------
+string StreamingMeshProcessor::getTemporaryPath(const string &name, int chunk) const {
+	return myTemporaryPrefix + name + (chunk >= 0 ? ofToString(chunk) : "") + ".tmp";
+}
+
+//--------------------------------------------------------------
+bool StreamingMeshProcessor::process(const string &inputPath, const string &outputPath) {
+	uint64_t startTime = ofGetElapsedTimeMicros();
+	myTemporaryPrefix = ofToDataPath(outputPath) + ".";
+	myNumInputVertices = myNumInputTriangles = myNumOutputVertices = myNumOutputTriangles = 0;
+	myNumChunks = myNumWindows = 0;
+
+	bool ok = readInput(ofToDataPath(inputPath));
+	uint64_t readTime = ofGetElapsedTimeMicros();
+	ok = ok && buildChunks() && routeTriangles();
+	uint64_t routeTime = ofGetElapsedTimeMicros();
+
+	// Chunks are independent within each stage, a failure in any of them
+	// fails the whole run
+	atomic<bool> chunksOk(ok);
+	if (ok) {
+		parallelFor(0, myNumChunks, [&](int begin, int end) {
+			for (int chunk = begin; chunk < end; chunk++) {
+				if (!prepareChunk(chunk)) {
+					chunksOk = false;
+				}
+			}
+		}, 1);
+	}
+
+	// Each chunk's vertices follow the chunks before it
+	myChunkFirstVertex.assign(myNumChunks, 0);
+	for (int chunk = 1; chunk < myNumChunks; chunk++) {
+		myChunkFirstVertex[chunk] = myChunkFirstVertex[chunk - 1] + myChunkVertices[chunk - 1];
+	}
+	if (chunksOk) {
+		parallelFor(0, myNumChunks, [&](int begin, int end) {
+			for (int chunk = begin; chunk < end; chunk++) {
+				if (!writeChunk(chunk)) {
+					chunksOk = false;
+				}
+			}
+		}, 1);
+	}
+	uint64_t chunkTime = ofGetElapsedTimeMicros();
+
+	ok = chunksOk && writeOutput(outputPath);
+	removeTemporaryFiles();
+	if (!ok) {
+		ofLogError("StreamingMeshProcessor::process") << "could not process " << inputPath;
+		return false;
+	}
+
+	ofLogNotice("StreamingMeshProcessor::process") << myNumInputVertices << " vertices and " << myNumInputTriangles
+		<< " triangles to " << myNumOutputVertices << " and " << myNumOutputTriangles << " in " << myNumChunks
+		<< " chunks, " << myNumWindows << " vertex windows";
+	ofLogNotice("StreamingMeshProcessor::process") << "read " << (readTime - startTime) / 1000 << "ms, route "
+		<< (routeTime - readTime) / 1000 << "ms, chunks " << (chunkTime - routeTime) / 1000 << "ms, write "
+		<< (ofGetElapsedTimeMicros() - chunkTime) / 1000 << "ms";
+	return true;
+}
+
+//--------------------------------------------------------------
+bool StreamingMeshProcessor::readInput(const string &inputPath) {
+	PlyInput input;
+	if (!input.open(inputPath)) {
+		ofLogError("StreamingMeshProcessor::readInput") << "could not read the PLY header of " << inputPath;
+		return false;
+	}
+
+	uint64_t numVertices = 0;
+	for (const PlyElement &element : input.getElements()) {
+		if (element.name == "vertex") {
+			numVertices = element.count;
+		}
+	}
+
+	string vertexPath = getTemporaryPath("vertices");
+	string facePath = getTemporaryPath("faces");
+	ofstream vertexFile(vertexPath, ios::binary | ios::trunc);
+	ofstream faceFile(facePath, ios::binary | ios::trunc);
+	if (!vertexFile || !faceFile) {
+		ofLogError("StreamingMeshProcessor::readInput") << "could not write temporary files next to the output";
+		return false;
+	}
+
+	myLow = vec3(numeric_limits<float>::max());
+	myHigh = vec3(-numeric_limits<float>::max());
+	vector<vec3> vertexBlock;
+	vector<uint32_t> faceBlock;
+	vector<uint32_t> polygon;
+	uint64_t numSkipped = 0;
+
+	for (const PlyElement &element : input.getElements()) {
+		if (element.name == "vertex") {
+			for (uint64_t i = 0; i < element.count; i += triangleBlockSize) {
+				vertexBlock.resize(size_t(min(element.count - i, uint64_t(triangleBlockSize))));
+				if (!input.readPositions(element, vertexBlock.data(), vertexBlock.size())) {
+					ofLogError("StreamingMeshProcessor::readInput") << inputPath << " ends early";
+					return false;
+				}
+				for (const vec3 &position : vertexBlock) {
+					myLow = glm::min(myLow, position);
+					myHigh = glm::max(myHigh, position);
+				}
+				vertexFile.write(reinterpret_cast<const char *>(vertexBlock.data()), vertexBlock.size() * sizeof(vec3));
+			}
+			continue;
+		}
+
+		for (uint64_t i = 0; i < element.count; i++) {
+			vec3 position(0, 0, 0);
+			if (!input.readRecord(element, position, polygon)) {
+				ofLogError("StreamingMeshProcessor::readInput") << inputPath << " ends early";
+				return false;
+			}
+
+			// Polygons become fans, triangles that can't be used are
+			// left out here so later stages never see them
+			for (int j = 1; j + 1 < int(polygon.size()); j++) {
+				uint32_t a = polygon[0];
+				uint32_t b = polygon[j];
+				uint32_t c = polygon[j + 1];
+				if (a >= numVertices || b >= numVertices || c >= numVertices || a == b || b == c || a == c) {
+					numSkipped++;
+					continue;
+				}
+				faceBlock.push_back(a);
+				faceBlock.push_back(b);
+				faceBlock.push_back(c);
+				myNumInputTriangles++;
+			}
+			if (faceBlock.size() >= size_t(3 * triangleBlockSize)) {
+				faceFile.write(reinterpret_cast<const char *>(faceBlock.data()), faceBlock.size() * sizeof(uint32_t));
+				faceBlock.clear();
+			}
+		}
+	}
+	faceFile.write(reinterpret_cast<const char *>(faceBlock.data()), faceBlock.size() * sizeof(uint32_t));
+	myNumInputVertices = numVertices;
+	if (!closeFile(vertexFile, vertexPath) || !closeFile(faceFile, facePath)) {
+		return false;
+	}
+
+	if (numSkipped > 0) {
+		ofLogWarning("StreamingMeshProcessor::readInput") << "skipped " << numSkipped << " degenerate or invalid triangles";
+	}
+	if (myNumInputTriangles == 0) {
+		ofLogError("StreamingMeshProcessor::readInput") << inputPath << " has no triangles";
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+bool StreamingMeshProcessor::buildChunks() {
+	// Cells stay small enough for 32 bit keys
+	vec3 extent = myHigh - myLow;
+	double longest = max(max(extent.x, extent.y), max(extent.z, 1e-6f));
+	myGridCellSize = max(double(myCellSize > 0 ? myCellSize : myWeldThreshold), longest / (1 << 30));
+	int numCells = int(longest / myGridCellSize) + 1;
+	myCellsPerCoarse = max(1, (numCells + coarseResolution - 1) / coarseResolution);
+	for (int axis = 0; axis < 3; axis++) {
+		myCoarseSize[axis] = int(extent[axis] / myGridCellSize) / myCellsPerCoarse + 1;
+	}
+	int sizeX = myCoarseSize[0];
+	int sizeY = myCoarseSize[1];
+	int sizeZ = myCoarseSize[2];
+	myCoarseChunks.assign(sizeX * sizeY * sizeZ, 0);
+
+	// Vertices per coarse cell, streamed from the vertex file
+	vector<uint64_t> counts(myCoarseChunks.size(), 0);
+	ifstream vertexFile(getTemporaryPath("vertices"), ios::binary);
+	vector<vec3> block(triangleBlockSize);
+	while (vertexFile) {
+		vertexFile.read(reinterpret_cast<char *>(block.data()), block.size() * sizeof(vec3));
+		int numRead = vertexFile.gcount() / sizeof(vec3);
+		for (int i = 0; i < numRead; i++) {
+			CellKey key = getCellKey(block[i]);
+			int x = min(key.x / myCellsPerCoarse, sizeX - 1);
+			int y = min(key.y / myCellsPerCoarse, sizeY - 1);
+			int z = min(key.z / myCellsPerCoarse, sizeZ - 1);
+			counts[(z * sizeY + y) * sizeX + x]++;
+		}
+	}
+
+	// Every thread may hold a chunk at once. Triangles per vertex from
+	// the whole mesh turn the triangle budget into vertices.
+	uint64_t trianglesPerChunk = max(uint64_t(1), myMemoryBudget / 2 / (getNumParallelThreads() * bytesPerChunkTriangle));
+	double trianglesPerVertex = double(myNumInputTriangles) / max(myNumInputVertices, uint64_t(1));
+	uint64_t verticesPerChunk = max(uint64_t(1), uint64_t(trianglesPerChunk / max(trianglesPerVertex, 1e-3)));
+
+	// Split boxes of coarse cells at the median of their longest axis
+	// until each holds few enough vertices
+	struct Box {
+		int low[3];
+		int high[3];
+	};
+	auto countBox = [&](const Box &box) {
+		uint64_t total = 0;
+		for (int z = box.low[2]; z < box.high[2]; z++) {
+			for (int y = box.low[1]; y < box.high[1]; y++) {
+				for (int x = box.low[0]; x < box.high[0]; x++) {
+					total += counts[(z * sizeY + y) * sizeX + x];
+				}
+			}
+		}
+		return total;
+	};
+	vector<Box> stack;
+	Box whole = { { 0, 0, 0 }, { sizeX, sizeY, sizeZ } };
+	stack.push_back(whole);
+	myNumChunks = 0;
+	uint64_t largestChunk = 0;
+	while (!stack.empty()) {
+		Box box = stack.back();
+		stack.pop_back();
+		uint64_t total = countBox(box);
+		int axis = 0;
+		for (int i = 1; i < 3; i++) {
+			if (box.high[i] - box.low[i] > box.high[axis] - box.low[axis]) {
+				axis = i;
+			}
+		}
+
+		if (total > verticesPerChunk && box.high[axis] - box.low[axis] > 1) {
+			// The first slab where the running count passes half,
+			// keeping at least one slab on each side
+			Box slab = box;
+			uint64_t running = 0;
+			int split = box.low[axis] + 1;
+			for (int i = box.low[axis]; i < box.high[axis] - 1; i++) {
+				slab.low[axis] = i;
+				slab.high[axis] = i + 1;
+				running += countBox(slab);
+				split = i + 1;
+				if (running * 2 >= total) {
+					break;
+				}
+			}
+			Box first = box;
+			Box second = box;
+			first.high[axis] = split;
+			second.low[axis] = split;
+			stack.push_back(second);
+			stack.push_back(first);
+			continue;
+		}
+
+		for (int z = box.low[2]; z < box.high[2]; z++) {
+			for (int y = box.low[1]; y < box.high[1]; y++) {
+				for (int x = box.low[0]; x < box.high[0]; x++) {
+					myCoarseChunks[(z * sizeY + y) * sizeX + x] = myNumChunks;
+				}
+			}
+		}
+		largestChunk = max(largestChunk, total);
+		myNumChunks++;
+	}
+	myChunkVertices.assign(myNumChunks, 0);
+	myChunkTriangles.assign(myNumChunks, 0);
+
+	if (largestChunk > 2 * verticesPerChunk) {
+		ofLogWarning("StreamingMeshProcessor::buildChunks") << "a chunk has " << largestChunk
+			<< " vertices, more than the memory budget allows for, the mesh is very dense in one place";
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+bool StreamingMeshProcessor::routeTriangles() {
+	// Half the budget holds a window of positions, the triangles are
+	// filled in over one pass of the faces per window
+	uint64_t windowSize = max(uint64_t(1), myMemoryBudget / 2 / sizeof(vec3));
+	myNumWindows = int((myNumInputVertices + windowSize - 1) / windowSize);
+	vector<vec3> window;
+
+	// Triangles are collected per chunk and appended to its file when
+	// its buffer is full, so only one file is open at a time
+	size_t bufferSize = max(size_t(64), size_t(myMemoryBudget / 8 / sizeof(Triangle) / max(myNumChunks, 1)));
+	vector<vector<Triangle>> buffers(myNumChunks);
+	for (int chunk = 0; chunk < myNumChunks; chunk++) {
+		if (!writeArray<Triangle>(getTemporaryPath("chunk", chunk), nullptr, 0)) {
+			return false;
+		}
+	}
+
+	string cornerPath = getTemporaryPath("corners");
+	if (myNumWindows > 1 && !writeArray<Triangle>(cornerPath, nullptr, 0)) {
+		return false;
+	}
+	vector<uint32_t> faces(3 * triangleBlockSize);
+	vector<Triangle> triangles(triangleBlockSize);
+
+	for (int w = 0; w < myNumWindows; w++) {
+		uint64_t windowBegin = w * windowSize;
+		uint64_t windowEnd = min(windowBegin + windowSize, myNumInputVertices);
+		window.resize(windowEnd - windowBegin);
+		ifstream vertexFile(getTemporaryPath("vertices"), ios::binary);
+		vertexFile.seekg(windowBegin * sizeof(vec3));
+		vertexFile.read(reinterpret_cast<char *>(window.data()), window.size() * sizeof(vec3));
+		if (!vertexFile) {
+			ofLogError("StreamingMeshProcessor::routeTriangles") << "could not read the vertex window";
+			return false;
+		}
+
+		bool lastWindow = w == myNumWindows - 1;
+		ifstream faceFile(getTemporaryPath("faces"), ios::binary);
+		fstream cornerFile;
+		if (myNumWindows > 1) {
+			cornerFile.open(cornerPath, ios::binary | ios::in | ios::out);
+		}
+		uint64_t blockStart = 0;
+		while (faceFile) {
+			faceFile.read(reinterpret_cast<char *>(faces.data()), faces.size() * sizeof(uint32_t));
+			int numTriangles = faceFile.gcount() / (3 * sizeof(uint32_t));
+			if (numTriangles == 0) {
+				break;
+			}
+
+			// Corners from earlier windows are in the corner file
+			if (w > 0) {
+				cornerFile.seekg(blockStart * sizeof(Triangle));
+				cornerFile.read(reinterpret_cast<char *>(triangles.data()), numTriangles * sizeof(Triangle));
+			}
+			for (int t = 0; t < numTriangles; t++) {
+				for (int j = 0; j < 3; j++) {
+					uint64_t index = faces[3 * t + j];
+					if (index >= windowBegin && index < windowEnd) {
+						triangles[t].corners[j] = window[index - windowBegin];
+					}
+				}
+			}
+
+			if (!lastWindow) {
+				cornerFile.seekp(blockStart * sizeof(Triangle));
+				cornerFile.write(reinterpret_cast<const char *>(triangles.data()), numTriangles * sizeof(Triangle));
+			}
+			else {
+				for (int t = 0; t < numTriangles; t++) {
+					int chunks[3];
+					for (int j = 0; j < 3; j++) {
+						chunks[j] = getChunk(getCellKey(triangles[t].corners[j]));
+					}
+					for (int j = 0; j < 3; j++) {
+						if ((j > 0 && chunks[j] == chunks[0]) || (j > 1 && chunks[j] == chunks[1])) {
+							continue;
+						}
+						vector<Triangle> &buffer = buffers[chunks[j]];
+						buffer.push_back(triangles[t]);
+						if (buffer.size() >= bufferSize) {
+							if (!writeArray(getTemporaryPath("chunk", chunks[j]), buffer.data(), buffer.size(), true)) {
+								return false;
+							}
+							buffer.clear();
+						}
+					}
+				}
+			}
+			blockStart += numTriangles;
+		}
+		if (myNumWindows > 1) {
+			cornerFile.close();
+			if (cornerFile.fail()) {
+				ofLogError("StreamingMeshProcessor::routeTriangles") << "could not write " << cornerPath;
+				return false;
+			}
+		}
+	}
+
+	for (int chunk = 0; chunk < myNumChunks; chunk++) {
+		if (!writeArray(getTemporaryPath("chunk", chunk), buffers[chunk].data(), buffers[chunk].size(), true)) {
+			return false;
+		}
+	}
+
+	// Only the chunk files are needed from here on
+	std::remove(getTemporaryPath("vertices").c_str());
+	std::remove(getTemporaryPath("faces").c_str());
+	std::remove(cornerPath.c_str());
+	return true;
+}
+
+//--------------------------------------------------------------
+bool StreamingMeshProcessor::prepareChunk(int chunk) {
+	vector<Triangle> triangles;
+	if (!readArray(getTemporaryPath("chunk", chunk), triangles)) {
+		return false;
+	}
+
+	// Every corner in one of this chunk's cells, and whether its
+	// triangle survives the welding
+	struct Corner {
+		CellKey key;
+		vec3 position;
+		bool used;
+	};
+	vector<Corner> corners;
+	corners.reserve(triangles.size() * 3 / 2);
+	for (const Triangle &triangle : triangles) {
+		CellKey keys[3];
+		for (int j = 0; j < 3; j++) {
+			keys[j] = getCellKey(triangle.corners[j]);
+		}
+		bool used = !(keys[0] == keys[1] || keys[1] == keys[2] || keys[0] == keys[2]);
+		for (int j = 0; j < 3; j++) {
+			if (getChunk(keys[j]) == chunk) {
+				Corner corner = { keys[j], triangle.corners[j], used };
+				corners.push_back(corner);
+			}
+		}
+	}
+	vector<Triangle>().swap(triangles);
+	sort(corners.begin(), corners.end(), [](const Corner &a, const Corner &b) {
+		return a.key < b.key;
+	});
+
+	// One vertex per cell used by a surviving triangle, at the mean of
+	// its corners
+	vector<CellVertex> cells;
+	for (size_t i = 0; i < corners.size();) {
+		size_t end = i;
+		dvec3 sum(0, 0, 0);
+		bool used = false;
+		while (end < corners.size() && corners[end].key == corners[i].key) {
+			sum += dvec3(corners[end].position);
+			used = used || corners[end].used;
+			end++;
+		}
+		if (used) {
+			CellVertex cell = { corners[i].key, vec3(sum / double(end - i)) };
+			cells.push_back(cell);
+		}
+		i = end;
+	}
+	myChunkVertices[chunk] = cells.size();
+	return writeArray(getTemporaryPath("table", chunk), cells.data(), cells.size());
+}
+
+//--------------------------------------------------------------
+bool StreamingMeshProcessor::writeChunk(int chunk) {
+	vector<Triangle> triangles;
+	if (!readArray(getTemporaryPath("chunk", chunk), triangles)) {
+		return false;
+	}
+
+	// This chunk's cells, sorted by key
+	vector<CellVertex> own;
+	if (!readArray(getTemporaryPath("table", chunk), own) || own.size() != myChunkVertices[chunk]) {
+		return false;
+	}
+
+	// Surviving triangles as cells, sorted so repeats of the same three
+	// cells are next to each other. Every chunk sees the triangles in
+	// the same order, so they all keep the same one.
+	struct Face {
+		CellKey keys[3];
+		CellKey sorted[3];
+		uint32_t order;
+	};
+	vector<Face> faces;
+	faces.reserve(triangles.size());
+	for (size_t i = 0; i < triangles.size(); i++) {
+		Face face;
+		for (int j = 0; j < 3; j++) {
+			face.keys[j] = getCellKey(triangles[i].corners[j]);
+			face.sorted[j] = face.keys[j];
+		}
+		if (face.keys[0] == face.keys[1] || face.keys[1] == face.keys[2] || face.keys[0] == face.keys[2]) {
+			continue;
+		}
+		sort(face.sorted, face.sorted + 3);
+		face.order = i;
+		faces.push_back(face);
+	}
+	vector<Triangle>().swap(triangles);
+	auto sameCells = [](const Face &a, const Face &b) {
+		return a.sorted[0] == b.sorted[0] && a.sorted[1] == b.sorted[1] && a.sorted[2] == b.sorted[2];
+	};
+	sort(faces.begin(), faces.end(), [](const Face &a, const Face &b) {
+		for (int j = 0; j < 3; j++) {
+			if (!(a.sorted[j] == b.sorted[j])) {
+				return a.sorted[j] < b.sorted[j];
+			}
+		}
+		return a.order < b.order;
+	});
+	faces.erase(unique(faces.begin(), faces.end(), sameCells), faces.end());
+
+	// Back in input order, so the output keeps the scan's locality
+	sort(faces.begin(), faces.end(), [](const Face &a, const Face &b) {
+		return a.order < b.order;
+	});
+
+	// Cells of other chunks the triangles reach into. Their tables are
+	// streamed and merged with the sorted lookups, so memory stays
+	// within the chunk's own however many neighbours it has.
+	struct Lookup {
+		int owner;
+		CellKey key;
+		uint64_t index;
+		vec3 position;
+	};
+	auto lookupLess = [](const Lookup &a, const Lookup &b) {
+		return a.owner != b.owner ? a.owner < b.owner : a.key < b.key;
+	};
+	vector<Lookup> lookups;
+	for (const Face &face : faces) {
+		for (int j = 0; j < 3; j++) {
+			int owner = getChunk(face.keys[j]);
+			if (owner != chunk) {
+				Lookup lookup = { owner, face.keys[j], 0, vec3(0, 0, 0) };
+				lookups.push_back(lookup);
+			}
+		}
+	}
+	sort(lookups.begin(), lookups.end(), lookupLess);
+	lookups.erase(unique(lookups.begin(), lookups.end(), [](const Lookup &a, const Lookup &b) {
+		return a.owner == b.owner && a.key == b.key;
+	}), lookups.end());
+
+	vector<CellVertex> block(tableBlockSize);
+	for (size_t i = 0; i < lookups.size();) {
+		int owner = lookups[i].owner;
+		string path = getTemporaryPath("table", owner);
+		ifstream table(path, ios::binary);
+		uint64_t blockStart = 0;
+		size_t blockSize = 0;
+		size_t local = 0;
+		for (; i < lookups.size() && lookups[i].owner == owner; i++) {
+			// Cells come in key order, so the table is read only once
+			while (true) {
+				while (local < blockSize && block[local].key < lookups[i].key) {
+					local++;
+				}
+				if (local < blockSize || !table) {
+					break;
+				}
+				blockStart += blockSize;
+				table.read(reinterpret_cast<char *>(block.data()), block.size() * sizeof(CellVertex));
+				blockSize = size_t(table.gcount()) / sizeof(CellVertex);
+				local = 0;
+			}
+			if (local == blockSize || !(block[local].key == lookups[i].key)) {
+				ofLogError("StreamingMeshProcessor::writeChunk") << "a cell is missing from " << path;
+				return false;
+			}
+			lookups[i].index = myChunkFirstVertex[owner] + blockStart + local;
+			lookups[i].position = block[local].position;
+		}
+	}
+	vector<CellVertex>().swap(block);
+
+	vector<vec3> normals(own.size(), vec3(0, 0, 0));
+	vector<uint32_t> indices;
+	indices.reserve(faces.size());
+	for (const Face &face : faces) {
+		vec3 positions[3];
+		uint64_t vertexIndices[3];
+		int localIndices[3];
+		for (int j = 0; j < 3; j++) {
+			int owner = getChunk(face.keys[j]);
+			if (owner == chunk) {
+				CellVertex cell = { face.keys[j], vec3(0, 0, 0) };
+				auto found = lower_bound(own.begin(), own.end(), cell, [](const CellVertex &a, const CellVertex &b) {
+					return a.key < b.key;
+				});
+				size_t local = found - own.begin();
+				positions[j] = found->position;
+				vertexIndices[j] = myChunkFirstVertex[chunk] + local;
+				localIndices[j] = int(local);
+			}
+			else {
+				Lookup lookup = { owner, face.keys[j], 0, vec3(0, 0, 0) };
+				auto found = lower_bound(lookups.begin(), lookups.end(), lookup, lookupLess);
+				positions[j] = found->position;
+				vertexIndices[j] = found->index;
+				localIndices[j] = -1;
+			}
+		}
+
+		// Area weighted and wound the same as calcNormals
+		vec3 normal = cross(positions[2] - positions[0], positions[1] - positions[0]);
+		for (int j = 0; j < 3; j++) {
+			if (localIndices[j] >= 0) {
+				normals[localIndices[j]] += normal;
+			}
+		}
+		if (getChunk(face.sorted[0]) == chunk) {
+			for (int j = 0; j < 3; j++) {
+				indices.push_back(uint32_t(vertexIndices[j]));
+			}
+		}
+	}
+	myChunkTriangles[chunk] = indices.size() / 3;
+
+	// Positions with their normals, as the output's vertex records
+	vector<float> vertices(6 * own.size());
+	for (size_t i = 0; i < own.size(); i++) {
+		float normalLength = length(normals[i]);
+		vec3 normal = normalLength > 0 ? normals[i] / normalLength : vec3(0, 0, 0);
+		for (int j = 0; j < 3; j++) {
+			vertices[6 * i + j] = own[i].position[j];
+			vertices[6 * i + 3 + j] = normal[j];
+		}
+	}
+	std::remove(getTemporaryPath("chunk", chunk).c_str());
+	return writeArray(getTemporaryPath("vertexpart", chunk), vertices.data(), vertices.size())
+		&& writeArray(getTemporaryPath("facepart", chunk), indices.data(), indices.size());
+}
+
+//--------------------------------------------------------------
+bool StreamingMeshProcessor::writeOutput(const string &outputPath) {
+	myNumOutputVertices = 0;
+	myNumOutputTriangles = 0;
+	for (int chunk = 0; chunk < myNumChunks; chunk++) {
+		myNumOutputVertices += myChunkVertices[chunk];
+		myNumOutputTriangles += myChunkTriangles[chunk];
+	}
+	if (myNumOutputVertices > numeric_limits<uint32_t>::max()) {
+		ofLogError("StreamingMeshProcessor::writeOutput") << myNumOutputVertices << " vertices don't fit 32 bit indices, use a larger cell size";
+		return false;
+	}
+
+	string path = ofToDataPath(outputPath);
+	ofstream output(path, ios::binary | ios::trunc);
+	if (!output) {
+		ofLogError("StreamingMeshProcessor::writeOutput") << "could not write " << outputPath;
+		return false;
+	}
+	output.precision(9);
+	output << "ply\n";
+	output << (myAsciiOutput ? "format ascii 1.0\n" : "format binary_little_endian 1.0\n");
+	output << "element vertex " << myNumOutputVertices << "\n";
+	output << "property float x\nproperty float y\nproperty float z\n";
+	output << "property float nx\nproperty float ny\nproperty float nz\n";
+	output << "element face " << myNumOutputTriangles << "\n";
+	output << "property list uchar uint vertex_indices\n";
+	output << "end_header\n";
+
+	// The parts in chunk order, which is the order of the vertex numbers
+	vector<float> vertices;
+	vector<uint32_t> indices;
+	for (int chunk = 0; chunk < myNumChunks; chunk++) {
+		if (!readArray(getTemporaryPath("vertexpart", chunk), vertices)) {
+			return false;
+		}
+		if (myAsciiOutput) {
+			for (size_t i = 0; i < vertices.size(); i += 6) {
+				output << vertices[i] << " " << vertices[i + 1] << " " << vertices[i + 2] << " "
+					<< vertices[i + 3] << " " << vertices[i + 4] << " " << vertices[i + 5] << "\n";
+			}
+		}
+		else {
+			output.write(reinterpret_cast<const char *>(vertices.data()), vertices.size() * sizeof(float));
+		}
+	}
+	vector<uint8_t> record(1 + 3 * sizeof(uint32_t));
+	record[0] = 3;
+	for (int chunk = 0; chunk < myNumChunks; chunk++) {
+		if (!readArray(getTemporaryPath("facepart", chunk), indices)) {
+			return false;
+		}
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			if (myAsciiOutput) {
+				output << "3 " << indices[i] << " " << indices[i + 1] << " " << indices[i + 2] << "\n";
+			}
+			else {
+				memcpy(&record[1], &indices[i], 3 * sizeof(uint32_t));
+				output.write(reinterpret_cast<const char *>(record.data()), record.size());
+			}
+		}
+	}
+	return closeFile(output, path);
+}
+
+//--------------------------------------------------------------
+void StreamingMeshProcessor::removeTemporaryFiles() {
+	std::remove(getTemporaryPath("vertices").c_str());
+	std::remove(getTemporaryPath("faces").c_str());
+	std::remove(getTemporaryPath("corners").c_str());
+	for (int chunk = 0; chunk < myNumChunks; chunk++) {
+		std::remove(getTemporaryPath("chunk", chunk).c_str());
+		std::remove(getTemporaryPath("table", chunk).c_str());
+		std::remove(getTemporaryPath("vertexpart", chunk).c_str());
+		std::remove(getTemporaryPath("facepart", chunk).c_str());
+	}
+}
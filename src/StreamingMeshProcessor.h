@@ -0,0 +1,135 @@
+#pragma once
+
+#include "ofMain.h"
+
+using namespace glm;
+
+// Out-of-core preparation of PLY scans too large to load: welding,
+// normals and optional decimation with bounded memory, streaming from
+// one PLY file to another.
+//
+// Vertices are identified by the cell of a grid they fall in, the weld
+// threshold or the decimation cell size. All vertices in a cell become
+// one, at their mean position, which welds the duplicates of triangle
+// soups and decimates by vertex clustering with larger cells.
+// Triangles left with fewer than three distinct cells are dropped, as
+// are repeats of the same three cells.
+//
+// 1. The input is read once. Positions and triangles, with polygons
+//    split into fans, go to temporary files, and the bounds are found.
+// 2. A histogram of the vertices over a coarse grid is split, kd-tree
+//    style, into chunks of about the same number of vertices. Every
+//    cell belongs to exactly one chunk.
+// 3. Triangles get their corner positions from windows of the vertex
+//    file, as many windows as the memory budget needs, and are appended
+//    to the file of every chunk owning one of their corners. So each
+//    chunk has every triangle around each of its cells.
+// 4. Each chunk finds the mean position of its cells, in parallel
+//    across chunks, and writes them to a table.
+// 5. Each chunk numbers its vertices after those of the chunks before
+//    it, looks up the vertices of triangles crossing into other chunks
+//    in their tables, sums the triangle normals of its own vertices and
+//    writes them. Triangles are written by the chunk owning their
+//    smallest cell. The result is the same as processing the whole mesh
+//    at once, seams included, whatever the number of chunks.
+// 6. The parts are joined into the output.
+//
+// Memory is about the budget: half of it for a window of positions, and
+// the chunks are sized so every thread processing one at the same time
+// stays within it. Cells of neighbouring chunks are streamed from their
+// tables rather than loaded.
+//
+// Temporary files are written next to the output. Routing needs 12
+// bytes per input vertex and 48 per input triangle, 84 with more than
+// one window, plus 36 for every chunk a triangle is copied to, one for
+// most and up to three along chunk borders. The inputs are removed
+// once routed, each chunk's copies once it's written.
+//
+// Welding snaps vertices to the grid, so two vertices closer than the
+// threshold can stay apart if a cell boundary lies between them, unlike
+// removeDuplicateVertices. Duplicates from triangle soups are always
+// welded. Cells are at least 1/2^30 of the mesh's extent.
+class StreamingMeshProcessor {
+public:
+	StreamingMeshProcessor();
+
+	void setWeldThreshold(float threshold);
+	float getWeldThreshold() const;
+
+	// Size of the decimation cells, 0 only welds
+	void setCellSize(float cellSize);
+	float getCellSize() const;
+
+	// Roughly the most memory to use, in bytes
+	void setMemoryBudget(uint64_t bytes);
+	uint64_t getMemoryBudget() const;
+
+	// Output is binary little endian unless this is set
+	void setAsciiOutput(bool ascii);
+	bool isAsciiOutput() const;
+
+	// Reads ASCII or binary PLY triangle meshes, writes positions,
+	// normals and triangles
+	bool process(const string &inputPath, const string &outputPath);
+
+	uint64_t getNumInputVertices() const;
+	uint64_t getNumInputTriangles() const;
+	uint64_t getNumOutputVertices() const;
+	uint64_t getNumOutputTriangles() const;
+	int getNumChunks() const;
+	int getNumWindows() const;
+
+	struct CellKey {
+		int32_t x, y, z;
+	};
+
+	struct Triangle {
+		vec3 corners[3];
+	};
+
+	// A vertex of the output, the mean of the corners in its cell
+	struct CellVertex {
+		CellKey key;
+		vec3 position;
+	};
+
+private:
+	bool readInput(const string &inputPath);
+	bool buildChunks();
+	bool routeTriangles();
+	bool prepareChunk(int chunk);
+	bool writeChunk(int chunk);
+	bool writeOutput(const string &outputPath);
+	void removeTemporaryFiles();
+
+	inline CellKey getCellKey(const vec3 &p) const;
+	inline int getChunk(const CellKey &key) const;
+	string getTemporaryPath(const string &name, int chunk = -1) const;
+
+	float myWeldThreshold;
+	float myCellSize;
+	uint64_t myMemoryBudget;
+	bool myAsciiOutput;
+	string myTemporaryPrefix;
+
+	uint64_t myNumInputVertices;
+	uint64_t myNumInputTriangles;
+	uint64_t myNumOutputVertices;
+	uint64_t myNumOutputTriangles;
+	int myNumWindows;
+
+	// The clustering grid, and the coarse grid of chunks over it
+	vec3 myLow;
+	vec3 myHigh;
+	double myGridCellSize;
+	int myCellsPerCoarse;
+	int myCoarseSize[3];
+	vector<int> myCoarseChunks;
+	int myNumChunks;
+
+	// Per chunk, its vertices and triangles in the output, and the
+	// output index of its first vertex
+	vector<uint64_t> myChunkVertices;
+	vector<uint64_t> myChunkTriangles;
+	vector<uint64_t> myChunkFirstVertex;
+};
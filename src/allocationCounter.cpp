@@ -0,0 +1,157 @@
+#include "allocationCounter.h"
+
+#ifdef ALLOCATION_COUNTING_ENABLED
+
+#include <new>
+#include <cstdlib>
+
+static atomic<uint64_t> allocationCount(0);
+
+//--------------------------------------------------------------
+static void *countedAllocate(size_t size) {
+	allocationCount.fetch_add(1, memory_order_relaxed);
+	void *p = malloc(size > 0 ? size : 1);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+//--------------------------------------------------------------
+void *operator new(size_t size) {
+	return countedAllocate(size);
+}
+
+void *operator new[](size_t size) {
+	return countedAllocate(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+	allocationCount.fetch_add(1, memory_order_relaxed);
+	return malloc(size > 0 ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+	allocationCount.fetch_add(1, memory_order_relaxed);
+	return malloc(size > 0 ? size : 1);
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+	free(p);
+}
+
+#ifdef __cpp_aligned_new
+//--------------------------------------------------------------
+// Over-aligned types (alignas above the default new alignment) come
+// through these, they're counted like any other allocation
+static void *alignedAllocate(size_t size, std::align_val_t alignment) {
+	allocationCount.fetch_add(1, memory_order_relaxed);
+	size = size > 0 ? size : 1;
+#ifdef _WIN32
+	return _aligned_malloc(size, size_t(alignment));
+#else
+	void *p;
+	return posix_memalign(&p, max(size_t(alignment), sizeof(void *)), size) == 0 ? p : nullptr;
+#endif
+}
+
+static void alignedFree(void *p) {
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+	void *p = alignedAllocate(size, alignment);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+	void *p = alignedAllocate(size, alignment);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+	return alignedAllocate(size, alignment);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+	return alignedAllocate(size, alignment);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+	alignedFree(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+	alignedFree(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+	alignedFree(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+	alignedFree(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+	alignedFree(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+	alignedFree(p);
+}
+#endif
+
+//--------------------------------------------------------------
+bool isAllocationCountingEnabled() {
+	return true;
+}
+
+//--------------------------------------------------------------
+uint64_t getAllocationCount() {
+	return allocationCount.load(memory_order_relaxed);
+}
+
+#else
+
+//--------------------------------------------------------------
+bool isAllocationCountingEnabled() {
+	return false;
+}
+
+//--------------------------------------------------------------
+uint64_t getAllocationCount() {
+	return 0;
+}
+
+#endif
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Counts heap allocations made through operator new, so the render loop
+// can be checked for allocator churn. Counting replaces the global
+// operator new and delete and is only compiled into debug builds, or
+// when COUNT_ALLOCATIONS is defined (e.g. PROJECT_DEFINES in
+// config.make). Release builds report zero.
+#if defined(DEBUG) || defined(_DEBUG) || defined(COUNT_ALLOCATIONS)
+#define ALLOCATION_COUNTING_ENABLED 1
+#endif
+
+bool isAllocationCountingEnabled();
+
+// Number of operator new calls since startup, on any thread
+uint64_t getAllocationCount();
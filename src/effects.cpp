@@ -0,0 +1,66 @@
+#include "effects.h"
+
+//--------------------------------------------------------------
+EffectBounds calcEffectBounds(const vec3 *positions, size_t count) {
+	EffectBounds bounds;
+	bounds.center = vec3(0, 0, 0);
+	bounds.height = 0;
+	if (count == 0) {
+		return bounds;
+	}
+
+	vec3 minPos = positions[0];
+	vec3 maxPos = positions[0];
+	for (size_t i = 1; i < count; i++) {
+		minPos = glm::min(minPos, positions[i]);
+		maxPos = glm::max(maxPos, positions[i]);
+	}
+	bounds.center = 0.5f * (minPos + maxPos);
+	bounds.height = maxPos.y - minPos.y;
+	return bounds;
+}
+
+//--------------------------------------------------------------
+bool setupEffectNoiseVolumes(NoiseVolume &noiseVolume, NoiseVolume &flowVolume) {
+	// 16 voxels per unit of noise space, see NoiseVolume for the errors
+	bool noiseOk = noiseVolume.setup("noise.bsnoise", 128, 8, 1, 1);
+	bool flowOk = flowVolume.setup("flow.bsnoise", 128, 8, 3, FlowEffect::numOctaves);
+	return noiseOk && flowOk;
+}
+
+//--------------------------------------------------------------
+bool hasAnalyticNormals(const EffectSettings &settings) {
+	// The noise functions themselves have no derivatives here, only
+	// their baked, trilinearly interpolated volumes
+	if ((settings.effects & EFFECT_NOISE) && !settings.noiseVolume) {
+		return false;
+	}
+	if ((settings.effects & EFFECT_FLOW) && !settings.flowVolume) {
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+EffectFrame makeEffectFrame(const EffectSettings &settings, const EffectBounds &bounds, float time) {
+	EffectFrame frame;
+	frame.settings = settings;
+	frame.bounds = bounds;
+	frame.time = time;
+	frame.phase = settings.frequency * time;
+
+	frame.rippleWaveNumber = settings.rippleWavelength > 0 ? TWO_PI / settings.rippleWavelength : 0;
+
+	// Twist angle per unit of height, so the top and bottom of the mesh
+	// turn by +-twistAngle at the peak of the swing
+	float halfHeight = 0.5f * bounds.height;
+	frame.twistRadians = halfHeight > 0 ? ofDegToRad(settings.twistAngle) * sinf(frame.phase) / halfHeight : 0;
+
+	// Largest offset the additive effects can give, fbm_vec3 stays
+	// roughly within +-1 per axis
+	frame.maxOffset = 0;
+	if (settings.effects & EFFECT_NOISE) frame.maxOffset += fabsf(settings.amplitude);
+	if (settings.effects & EFFECT_RIPPLE) frame.maxOffset += fabsf(settings.rippleAmplitude);
+	if (settings.effects & EFFECT_FLOW) frame.maxOffset += fabsf(settings.flowAmplitude);
+	return frame;
+}
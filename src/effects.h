@@ -0,0 +1,339 @@
+#pragma once
+
+#include "ofMain.h"
+#include "Particle.h"
+#include "NoiseVolume.h"
+#include "helpers.h"
+#include "parallel.h"
+
+using namespace glm;
+
+// Displacement effects stacked on the particles.
+//
+// Each effect adds to the offset of a vertex from its original position,
+// in the fixed order of the flags below. Every combination of effects
+// is compiled into its own loop over the vertices, with the effects that
+// are off removed at compile time, so a frame is always one pass and
+// the only dispatch is a table lookup per chunk of vertices.
+//
+// Noise on its own gives exactly the same vertices as the original
+// sine x noise displacement.
+//
+// Each effect can also give the derivatives of its offset with respect
+// to the original position, its Jacobian, so the normals of the
+// displaced surface can be worked out in the same pass instead of from
+// the triangles afterwards. Through the whole chain the Jacobian J of
+// the total offset makes the deformation gradient F = I + J, and the
+// displaced normal is cof(F) n, the cofactor matrix mapping the two
+// tangents' cross product to the cross product of the moved tangents.
+// Noise and flow only have exact derivatives when they're looked up in
+// the baked volumes, see hasAnalyticNormals().
+
+enum EffectFlags {
+	EFFECT_NOISE = 1 << 0,
+	EFFECT_RIPPLE = 1 << 1,
+	EFFECT_TWIST = 1 << 2,
+	EFFECT_FLOW = 1 << 3,
+	EFFECT_SHAPE = 1 << 4,
+	EFFECT_ALL = (1 << 5) - 1
+};
+
+struct EffectSettings {
+	unsigned effects = EFFECT_NOISE;
+
+	// The frequency sets the speed of every effect
+	float amplitude = 10;
+	float frequency = 1;
+	float scale = 200;
+
+	// Rings moving out from the middle of the mesh
+	float rippleAmplitude = 5;
+	float rippleWavelength = 50;
+
+	// Rotation about the vertical axis, swinging between plus and minus
+	// this many degrees from the bottom to the top of the mesh
+	float twistAngle = 30;
+
+	// Drift along a 3D fbm noise field
+	float flowAmplitude = 10;
+	float flowScale = 100;
+
+	// Gain curve applied to the length of the total offset, 0.5 leaves it
+	// unchanged, lower pushes it towards the middle, higher to the ends
+	float shapeGain = 0.5;
+
+	// Baked noise instead of per vertex noise, see setupEffectNoiseVolumes
+	const NoiseVolume *noiseVolume = nullptr;
+	const NoiseVolume *flowVolume = nullptr;
+};
+
+// Middle and height of the undisplaced particles
+struct EffectBounds {
+	vec3 center;
+	float height;
+};
+
+// Everything the effects need that is the same for every vertex
+struct EffectFrame {
+	EffectSettings settings;
+	EffectBounds bounds;
+	float phase;
+	float time;
+	float rippleWaveNumber;
+	float twistRadians;
+	float maxOffset;
+};
+
+EffectBounds calcEffectBounds(const vec3 *positions, size_t count);
+EffectFrame makeEffectFrame(const EffectSettings &settings, const EffectBounds &bounds, float time);
+
+// True if every effect that's on can give its Jacobian
+bool hasAnalyticNormals(const EffectSettings &settings);
+
+// Loads the volumes for EffectSettings::noiseVolume and flowVolume from
+// the data folder, baking and saving them the first time
+bool setupEffectNoiseVolumes(NoiseVolume &noiseVolume, NoiseVolume &flowVolume);
+
+//--------------------------------------------------------------
+struct NoiseEffect {
+	static inline void apply(const EffectFrame &frame, const vec3 &origPos, const vec3 &dir, vec3 &offset) {
+		float displacement = frame.settings.noiseVolume ?
+			Particle::calcDisplacement(origPos, frame.phase, frame.settings.scale, *frame.settings.noiseVolume) :
+			Particle::calcDisplacement(origPos, frame.phase, frame.settings.scale);
+		offset += frame.settings.amplitude * displacement * dir;
+	}
+
+	// Needs the baked noise volume
+	static inline void apply(const EffectFrame &frame, const vec3 &origPos, const vec3 &dir, vec3 &offset, mat3 &jacobian) {
+		vec3 gradient;
+		float displacement = Particle::calcDisplacement(origPos, frame.phase, frame.settings.scale, *frame.settings.noiseVolume, gradient);
+		offset += frame.settings.amplitude * displacement * dir;
+		jacobian += outerProduct(dir, frame.settings.amplitude * gradient);
+	}
+};
+
+//--------------------------------------------------------------
+struct RippleEffect {
+	static inline void apply(const EffectFrame &frame, const vec3 &origPos, const vec3 &dir, vec3 &offset) {
+		float dx = origPos.x - frame.bounds.center.x;
+		float dz = origPos.z - frame.bounds.center.z;
+		float distance = sqrtf(dx * dx + dz * dz);
+		offset += frame.settings.rippleAmplitude * sinf(distance * frame.rippleWaveNumber - frame.phase) * dir;
+	}
+
+	static inline void apply(const EffectFrame &frame, const vec3 &origPos, const vec3 &dir, vec3 &offset, mat3 &jacobian) {
+		float dx = origPos.x - frame.bounds.center.x;
+		float dz = origPos.z - frame.bounds.center.z;
+		float distance = sqrtf(dx * dx + dz * dz);
+		float angle = distance * frame.rippleWaveNumber - frame.phase;
+		offset += frame.settings.rippleAmplitude * sinf(angle) * dir;
+
+		// The distance only changes across the rings, and not at all at
+		// their centre
+		if (distance > 0) {
+			float slope = frame.settings.rippleAmplitude * cosf(angle) * frame.rippleWaveNumber / distance;
+			jacobian += outerProduct(dir, vec3(dx * slope, 0, dz * slope));
+		}
+	}
+};
+
+//--------------------------------------------------------------
+struct TwistEffect {
+	static inline void apply(const EffectFrame &frame, const vec3 &origPos, const vec3 &, vec3 &offset) {
+		// Twists the already displaced position about the vertical axis
+		// through the middle of the mesh
+		vec3 p = origPos + offset - frame.bounds.center;
+		float angle = frame.twistRadians * (origPos.y - frame.bounds.center.y);
+		float c = cosf(angle);
+		float s = sinf(angle);
+		vec3 twisted(c * p.x - s * p.z, p.y, s * p.x + c * p.z);
+		offset = twisted + frame.bounds.center - origPos;
+	}
+
+	static inline void apply(const EffectFrame &frame, const vec3 &origPos, const vec3 &, vec3 &offset, mat3 &jacobian) {
+		vec3 p = origPos + offset - frame.bounds.center;
+		float angle = frame.twistRadians * (origPos.y - frame.bounds.center.y);
+		float c = cosf(angle);
+		float s = sinf(angle);
+		vec3 twisted(c * p.x - s * p.z, p.y, s * p.x + c * p.z);
+		offset = twisted + frame.bounds.center - origPos;
+
+		// The twisted point moves with p, which moves with the position
+		// and the offset so far, and turns as the angle grows with height
+		mat3 rotation(vec3(c, 0, s), vec3(0, 1, 0), vec3(-s, 0, c));
+		vec3 turning(-s * p.x - c * p.z, 0, c * p.x - s * p.z);
+		jacobian = rotation * (mat3(1) + jacobian) + outerProduct(turning, vec3(0, frame.twistRadians, 0)) - mat3(1);
+	}
+};
+
+//--------------------------------------------------------------
+struct FlowEffect {
+	static const int numOctaves = 3;
+
+	static inline void apply(const EffectFrame &frame, const vec3 &origPos, const vec3 &, vec3 &offset) {
+		if (frame.settings.flowVolume) {
+			vec3 p = origPos / frame.settings.flowScale + vec3(0.25f * frame.phase);
+			offset += frame.settings.flowAmplitude * frame.settings.flowVolume->lookup3(p);
+		}
+		else {
+			vec4 p(origPos / frame.settings.flowScale, 0.25f * frame.phase);
+			offset += frame.settings.flowAmplitude * fbm_vec3(p, numOctaves);
+		}
+	}
+
+	// Needs the baked flow volume
+	static inline void apply(const EffectFrame &frame, const vec3 &origPos, const vec3 &, vec3 &offset, mat3 &jacobian) {
+		vec3 p = origPos / frame.settings.flowScale + vec3(0.25f * frame.phase);
+		mat3 flowJacobian;
+		offset += frame.settings.flowAmplitude * frame.settings.flowVolume->lookup3(p, flowJacobian);
+		jacobian += flowJacobian * (frame.settings.flowAmplitude / frame.settings.flowScale);
+	}
+};
+
+//--------------------------------------------------------------
+struct ShapeEffect {
+	static inline void apply(const EffectFrame &frame, const vec3 &, const vec3 &, vec3 &offset) {
+		// Remap the offset length, as a fraction of the largest offset
+		// the other effects can give, through the gain curve
+		float offsetLength = length(offset);
+		if (offsetLength > 0 && frame.maxOffset > 0) {
+			float x = min(offsetLength / frame.maxOffset, 1.0f);
+			offset *= gain(x, frame.settings.shapeGain) / x;
+		}
+	}
+
+	static inline void apply(const EffectFrame &frame, const vec3 &, const vec3 &, vec3 &offset, mat3 &jacobian) {
+		float offsetLength = length(offset);
+		if (offsetLength > 0 && frame.maxOffset > 0) {
+			float x = min(offsetLength / frame.maxOffset, 1.0f);
+			float factor = gain(x, frame.settings.shapeGain) / x;
+
+			// The factor depends on the offset's length, unless that's
+			// past the largest offset
+			mat3 scaled = jacobian * factor;
+			if (offsetLength < frame.maxOffset) {
+				float slope = (gainDerivative(x, frame.settings.shapeGain) * x - gain(x, frame.settings.shapeGain)) / (x * x * frame.maxOffset);
+				vec3 lengthGradient = transpose(jacobian) * offset / offsetLength;
+				scaled += outerProduct(offset, slope * lengthGradient);
+			}
+			jacobian = scaled;
+			offset *= factor;
+		}
+	}
+};
+
+//--------------------------------------------------------------
+// Effects that move along the particles' directions. The others never
+// read them, so the chains don't fetch or decode them.
+const unsigned effectsUsingDirections = EFFECT_NOISE | EFFECT_RIPPLE;
+
+//--------------------------------------------------------------
+// One fused loop for the effect combination Effects, over every
+// stride-th vertex from begin. Source provides getPosition(i) and
+// getDirection(i) for the particle storage in use.
+template<unsigned Effects, typename Source>
+void runEffectChain(const Source &source, const EffectFrame &frame, vec3 *vertices, int begin, int end, int stride) {
+	for (int i = begin; i < end; i += stride) {
+		vec3 origPos = source.getPosition(i);
+		vec3 dir = (Effects & effectsUsingDirections) ? source.getDirection(i) : vec3(0, 0, 0);
+		vec3 offset(0, 0, 0);
+
+		// Effects is a constant, so these tests are resolved when compiling
+		if (Effects & EFFECT_NOISE) NoiseEffect::apply(frame, origPos, dir, offset);
+		if (Effects & EFFECT_RIPPLE) RippleEffect::apply(frame, origPos, dir, offset);
+		if (Effects & EFFECT_TWIST) TwistEffect::apply(frame, origPos, dir, offset);
+		if (Effects & EFFECT_FLOW) FlowEffect::apply(frame, origPos, dir, offset);
+		if (Effects & EFFECT_SHAPE) ShapeEffect::apply(frame, origPos, dir, offset);
+
+		vertices[i] = origPos + offset;
+	}
+}
+
+//--------------------------------------------------------------
+// The normal of the displaced surface from the normal of the original
+// one and the Jacobian of the offset
+static inline vec3 deformNormal(const vec3 &normal, const mat3 &jacobian) {
+	vec3 a = jacobian[0] + vec3(1, 0, 0);
+	vec3 b = jacobian[1] + vec3(0, 1, 0);
+	vec3 c = jacobian[2] + vec3(0, 0, 1);
+	vec3 n = normal.x * cross(b, c) + normal.y * cross(c, a) + normal.z * cross(a, b);
+	float nLength = length(n);
+	return nLength > 0 ? n / nLength : normal;
+}
+
+//--------------------------------------------------------------
+// The same loop also writing the displaced normals. The original
+// normals are baseNormals, or the particles' directions if that's null.
+template<unsigned Effects, typename Source>
+void runEffectChainWithNormals(const Source &source, const EffectFrame &frame, const vec3 *baseNormals, vec3 *vertices, vec3 *normals, int begin, int end, int stride) {
+	bool needsDirections = (Effects & effectsUsingDirections) || !baseNormals;
+	for (int i = begin; i < end; i += stride) {
+		vec3 origPos = source.getPosition(i);
+		vec3 dir = needsDirections ? source.getDirection(i) : vec3(0, 0, 0);
+		vec3 offset(0, 0, 0);
+		mat3 jacobian(0);
+
+		if (Effects & EFFECT_NOISE) NoiseEffect::apply(frame, origPos, dir, offset, jacobian);
+		if (Effects & EFFECT_RIPPLE) RippleEffect::apply(frame, origPos, dir, offset, jacobian);
+		if (Effects & EFFECT_TWIST) TwistEffect::apply(frame, origPos, dir, offset, jacobian);
+		if (Effects & EFFECT_FLOW) FlowEffect::apply(frame, origPos, dir, offset, jacobian);
+		if (Effects & EFFECT_SHAPE) ShapeEffect::apply(frame, origPos, dir, offset, jacobian);
+
+		vertices[i] = origPos + offset;
+		normals[i] = deformNormal(baseNormals ? baseNormals[i] : dir, jacobian);
+	}
+}
+
+template<typename Source>
+using EffectChainFunction = void (*)(const Source &source, const EffectFrame &frame, vec3 *vertices, int begin, int end, int stride);
+
+template<typename Source>
+using EffectNormalsChainFunction = void (*)(const Source &source, const EffectFrame &frame, const vec3 *baseNormals, vec3 *vertices, vec3 *normals, int begin, int end, int stride);
+
+// Table of the chains for every combination of effects
+template<typename Source, size_t... Effects>
+const EffectChainFunction<Source> *getEffectChains(std::index_sequence<Effects...>) {
+	static const EffectChainFunction<Source> chains[] = { &runEffectChain<Effects, Source>... };
+	return chains;
+}
+
+template<typename Source, size_t... Effects>
+const EffectNormalsChainFunction<Source> *getEffectNormalsChains(std::index_sequence<Effects...>) {
+	static const EffectNormalsChainFunction<Source> chains[] = { &runEffectChainWithNormals<Effects, Source>... };
+	return chains;
+}
+
+//--------------------------------------------------------------
+// Writes the displaced position of the particles in source to vertices,
+// split across all cores. With a stride above 1 only the vertices first,
+// first + stride, ... are written, the rest keep their positions.
+template<typename Source>
+void applyEffects(const Source &source, const EffectFrame &frame, vec3 *vertices, int numVertices, int first = 0, int stride = 1) {
+	EffectChainFunction<Source> chain = getEffectChains<Source>(std::make_index_sequence<EFFECT_ALL + 1>())[frame.settings.effects & EFFECT_ALL];
+	int numActive = max(0, (numVertices - first + stride - 1) / stride);
+	parallelFor(0, numActive, [&](int begin, int end) {
+		chain(source, frame, vertices, first + begin * stride, min(first + end * stride, numVertices), stride);
+	});
+}
+
+// The same also writing the displaced normals, see
+// runEffectChainWithNormals. Only for settings with analytic normals.
+template<typename Source>
+void applyEffects(const Source &source, const EffectFrame &frame, const vec3 *baseNormals, vec3 *vertices, vec3 *normals, int numVertices, int first = 0, int stride = 1) {
+	EffectNormalsChainFunction<Source> chain = getEffectNormalsChains<Source>(std::make_index_sequence<EFFECT_ALL + 1>())[frame.settings.effects & EFFECT_ALL];
+	int numActive = max(0, (numVertices - first + stride - 1) / stride);
+	parallelFor(0, numActive, [&](int begin, int end) {
+		chain(source, frame, baseNormals, vertices, normals, first + begin * stride, min(first + end * stride, numVertices), stride);
+	});
+}
+
+// The same for only the vertices in the given ranges
+template<typename Source>
+void applyEffects(const Source &source, const EffectFrame &frame, vec3 *vertices, const VertexRange *ranges, int numRanges) {
+	EffectChainFunction<Source> chain = getEffectChains<Source>(std::make_index_sequence<EFFECT_ALL + 1>())[frame.settings.effects & EFFECT_ALL];
+	parallelFor(0, numRanges, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			chain(source, frame, vertices, ranges[i].begin, ranges[i].begin + ranges[i].count, 1);
+		}
+	}, 4);
+}
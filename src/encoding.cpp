@@ -0,0 +1,252 @@
+#include "encoding.h"
+
+// Values whose Rice quotient reaches this limit are escaped and
+// written as raw 32 bit words so that outliers can't blow up the
+// code length
+const uint32_t riceQuotientLimit = 24;
+
+// Running statistics are halved once this many samples have been
+// seen, so the code parameter keeps adapting to local statistics
+const uint64_t riceResetCount = 64;
+
+//--------------------------------------------------------------
+static int countLeadingZeros64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_clzll(x);
+#else
+	int n = 0;
+	while ((x & (uint64_t(1) << 63)) == 0) {
+		x <<= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+//--------------------------------------------------------------
+BitWriter::BitWriter(vector<uint8_t> &out) : myOut(out), myAccum(0), myNumBits(0) {
+}
+
+//--------------------------------------------------------------
+void BitWriter::write(uint32_t bits, int numBits) {
+	// At most 7 bits are pending, so up to 32 new bits always fit
+	if (numBits == 0) {
+		return;
+	}
+	uint64_t mask = (uint64_t(1) << numBits) - 1;
+	myAccum = (myAccum << numBits) | (bits & mask);
+	myNumBits += numBits;
+	while (myNumBits >= 8) {
+		myNumBits -= 8;
+		myOut.push_back(uint8_t(myAccum >> myNumBits));
+	}
+	myAccum &= (uint64_t(1) << myNumBits) - 1;
+}
+
+//--------------------------------------------------------------
+void BitWriter::writeUnary(uint32_t count) {
+	// count zero bits followed by a single one bit
+	while (count >= 31) {
+		write(0, 31);
+		count -= 31;
+	}
+	write(1, count + 1);
+}
+
+//--------------------------------------------------------------
+void BitWriter::writeEliasGamma(uint32_t v) {
+	// v must be at least 1. The number of significant bits minus one
+	// is sent as zeros, followed by the significant bits themselves
+	int n = 0;
+	while ((v >> n) > 1) {
+		n++;
+	}
+	write(0, n);
+	write(v, n + 1);
+}
+
+//--------------------------------------------------------------
+void BitWriter::flush() {
+	if (myNumBits > 0) {
+		myOut.push_back(uint8_t(myAccum << (8 - myNumBits)));
+		myAccum = 0;
+		myNumBits = 0;
+	}
+}
+
+//--------------------------------------------------------------
+BitReader::BitReader(const uint8_t *data, size_t size) :
+	myData(data), myEnd(data + size), myAccum(0), myNumBits(0), myOverrun(false) {
+}
+
+//--------------------------------------------------------------
+void BitReader::refill() {
+	while (myNumBits <= 56 && myData < myEnd) {
+		myAccum = (myAccum << 8) | *myData++;
+		myNumBits += 8;
+	}
+}
+
+//--------------------------------------------------------------
+uint32_t BitReader::read(int numBits) {
+	if (numBits == 0) {
+		return 0;
+	}
+	if (myNumBits < numBits) {
+		refill();
+		if (myNumBits < numBits) {
+			// Ran off the end of the buffer, pad with zeros
+			myAccum <<= (numBits - myNumBits);
+			myNumBits = numBits;
+			myOverrun = true;
+		}
+	}
+	myNumBits -= numBits;
+	return uint32_t((myAccum >> myNumBits) & ((uint64_t(1) << numBits) - 1));
+}
+
+//--------------------------------------------------------------
+uint32_t BitReader::readUnary() {
+	uint32_t count = 0;
+	while (true) {
+		if (myNumBits == 0) {
+			refill();
+			if (myNumBits == 0) {
+				myOverrun = true;
+				return count;
+			}
+		}
+
+		// Left align the pending bits and look for the first one bit
+		uint64_t window = myAccum << (64 - myNumBits);
+		if (window != 0) {
+			int zeros = countLeadingZeros64(window);
+			myNumBits -= zeros + 1;
+			return count + zeros;
+		}
+		count += myNumBits;
+		myNumBits = 0;
+	}
+}
+
+//--------------------------------------------------------------
+uint32_t BitReader::readEliasGamma() {
+	uint32_t n = readUnary();
+	if (n > 31) {
+		myOverrun = true;
+		return 1;
+	}
+	// The leading one bit was consumed by readUnary
+	return (uint32_t(1) << n) | read(n);
+}
+
+//--------------------------------------------------------------
+bool BitReader::overrun() const {
+	return myOverrun;
+}
+
+//--------------------------------------------------------------
+void encodeResiduals(const int32_t *residuals, size_t numValues, vector<uint8_t> &out) {
+	BitWriter writer(out);
+
+	// Adaptive Golomb-Rice state: sum of recent magnitudes and count
+	uint64_t sum = 4;
+	uint64_t count = 1;
+
+	size_t i = 0;
+	while (true) {
+		// Send the number of zeros before the next non-zero value
+		size_t run = 0;
+		while (i + run < numValues && residuals[i + run] == 0) {
+			run++;
+		}
+		writer.writeEliasGamma(uint32_t(run + 1));
+		i += run;
+		if (i == numValues) {
+			break;
+		}
+
+		// Non-zero values are mapped to 0, 1, 2, ... before coding
+		uint32_t v = zigzagEncode(residuals[i]) - 1;
+
+		int k = 0;
+		while ((count << k) < sum && k < 31) {
+			k++;
+		}
+
+		uint32_t q = v >> k;
+		if (q < riceQuotientLimit) {
+			writer.writeUnary(q);
+			writer.write(v, k);
+		}
+		else {
+			writer.writeUnary(riceQuotientLimit);
+			writer.write(v, 32);
+		}
+
+		sum += v;
+		count++;
+		if (count == riceResetCount) {
+			sum >>= 1;
+			count >>= 1;
+		}
+
+		i++;
+		if (i == numValues) {
+			break;
+		}
+	}
+
+	writer.flush();
+}
+
+//--------------------------------------------------------------
+bool decodeResiduals(const uint8_t *data, size_t size, int32_t *residuals, size_t numValues) {
+	BitReader reader(data, size);
+
+	uint64_t sum = 4;
+	uint64_t count = 1;
+
+	size_t i = 0;
+	while (true) {
+		uint32_t run = reader.readEliasGamma() - 1;
+		if (run > numValues - i) {
+			return false;
+		}
+		for (uint32_t j = 0; j < run; j++) {
+			residuals[i++] = 0;
+		}
+		if (i == numValues) {
+			break;
+		}
+
+		int k = 0;
+		while ((count << k) < sum && k < 31) {
+			k++;
+		}
+
+		uint32_t v;
+		uint32_t q = reader.readUnary();
+		if (q < riceQuotientLimit) {
+			v = (q << k) | reader.read(k);
+		}
+		else {
+			v = reader.read(32);
+		}
+		residuals[i] = zigzagDecode(v + 1);
+
+		sum += v;
+		count++;
+		if (count == riceResetCount) {
+			sum >>= 1;
+			count >>= 1;
+		}
+
+		i++;
+		if (i == numValues) {
+			break;
+		}
+	}
+
+	return !reader.overrun();
+}
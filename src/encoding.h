@@ -0,0 +1,61 @@
+#pragma once
+
+#include "ofMain.h"
+
+using namespace glm;
+
+// Small lossless coding toolkit shared by the recorders and exporters.
+// Values are written as signed residuals (the difference between a
+// sample and its prediction). Residuals are zig-zag mapped to unsigned,
+// runs of zeros are run-length coded and the remaining values are
+// entropy coded with adaptive Golomb-Rice codes.
+
+//--------------------------------------------------------------
+inline uint32_t zigzagEncode(int32_t v) {
+	return (uint32_t(v) << 1) ^ uint32_t(v >> 31);
+}
+
+//--------------------------------------------------------------
+inline int32_t zigzagDecode(uint32_t u) {
+	return int32_t(u >> 1) ^ -int32_t(u & 1);
+}
+
+//--------------------------------------------------------------
+class BitWriter {
+public:
+	BitWriter(vector<uint8_t> &out);
+	void write(uint32_t bits, int numBits);
+	void writeUnary(uint32_t count);
+	void writeEliasGamma(uint32_t v);
+	void flush();
+
+private:
+	vector<uint8_t> &myOut;
+	uint64_t myAccum;
+	int myNumBits;
+};
+
+//--------------------------------------------------------------
+class BitReader {
+public:
+	BitReader(const uint8_t *data, size_t size);
+	uint32_t read(int numBits);
+	uint32_t readUnary();
+	uint32_t readEliasGamma();
+	bool overrun() const;
+
+private:
+	void refill();
+
+	const uint8_t *myData;
+	const uint8_t *myEnd;
+	uint64_t myAccum;
+	int myNumBits;
+	bool myOverrun;
+};
+
+// Appends the coded form of numValues residuals to out
+void encodeResiduals(const int32_t *residuals, size_t numValues, vector<uint8_t> &out);
+
+// Decodes exactly numValues residuals, returns false on corrupt input
+bool decodeResiduals(const uint8_t *data, size_t size, int32_t *residuals, size_t numValues);
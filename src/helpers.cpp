@@ -180,6 +180,18 @@ float gain(float x, float g) {
 		return bias(x * 2.0 - 1.0, 1.0 - g) / 2.0 + 0.5;
 }
 
+//--------------------------------------------------------------
+// bias(x, b) = x / (a (1 - x) + 1) with a = 1 / b - 2, whose slope is
+// (a + 1) / (a (1 - x) + 1)^2. Each half of gain() halves the value
+// and doubles x, so its slope is bias's at the scaled x.
+float gainDerivative(float x, float g) {
+	float b = x < 0.5 ? g : 1.0 - g;
+	float t = x < 0.5 ? x * 2.0 : x * 2.0 - 1.0;
+	float a = 1.0 / b - 2.0;
+	float d = a * (1.0 - t) + 1.0;
+	return (a + 1.0) / (d * d);
+}
+
 //--------------------------------------------------------------
 void calcNormals(ofMesh &curMesh) {
 	// Calculates normals for triangle meshes with indices
@@ -208,14 +220,15 @@ void calcNormals(ofMesh &curMesh) {
 	}
 
 	// Get vertex position arrays
-	const vector<vec3> vertices = curMesh.getVertices();
+	const vector<vec3> &vertices = curMesh.getVertices();
 
-	// Initialize an array for an accumulated sum for each normal
-	vector<vec3> sumNormals;
-	sumNormals.resize(numVertices, vec3(0, 0, 0));
+	// Accumulate the sum for each normal straight into the mesh normals,
+	// so no temporary array is allocated every frame
+	vector<vec3> &sumNormals = curMesh.getNormals();
+	std::fill(sumNormals.begin(), sumNormals.end(), vec3(0, 0, 0));
 
 	// Each set of 3 consecutive indices indicates one triangle
-	const vector<ofIndexType> indices = curMesh.getIndices();
+	const vector<ofIndexType> &indices = curMesh.getIndices();
 	int numTriangles = indices.size() / 3;
 
 	// Loop through each triangle
@@ -239,7 +252,7 @@ void calcNormals(ofMesh &curMesh) {
 	// Loop through each vertex and re-normalize the accumulated sum
 	// to calculate the final value for each normal
 	for (int i = 0; i < numVertices; i++) {
-		curMesh.setNormal(i, normalize(sumNormals[i]));
+		sumNormals[i] = normalize(sumNormals[i]);
 	}
 }
 
@@ -27,6 +27,15 @@ vec4 fbm_vec4(vec4 v4, int numOctaves = 8);
 float bias(float x, float b);
 float gain(float x, float g);
 
+// Slope of gain() at x
+float gainDerivative(float x, float g);
+
 void calcNormals(ofMesh &curMesh);
 
+// A run of consecutive vertices, [begin, begin + count)
+struct VertexRange {
+	int begin;
+	int count;
+};
+
 void removeDuplicateVertices(ofMesh &curMesh, float threshold);
@@ -1,8 +1,15 @@
 #include "ofMain.h"
 #include "ofApp.h"
+#include "BatchRunner.h"
 
 //========================================================================
-int main( ){
+int main(int argc, char *argv[]){
+	// Headless batch processing, see BatchRunner.h for the options
+	BatchSettings batchSettings;
+	if (parseBatchArguments(argc, argv, batchSettings)) {
+		return runBatch(batchSettings);
+	}
+
 	ofSetupOpenGL(1280, 720, OF_WINDOW);			// <-------- setup the GL context
 
 	// this kicks off the running of my app
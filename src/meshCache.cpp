@@ -0,0 +1,327 @@
+#include "meshCache.h"
+#include "helpers.h"
+#include "meshOptimizer.h"
+
+#include <sys/stat.h>
+#ifndef TARGET_WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char meshCacheMagic[8] = { 'B', 'S', 'M', 'C', 'A', 'C', 'H', 'E' };
+static const uint32_t meshCacheVersion = 1;
+static const uint64_t meshCachePageSize = 4096;
+
+const uint32_t meshCacheReordered = 1;
+const uint32_t meshCacheHasColors = 2;
+const uint32_t meshCacheHasTexCoords = 4;
+
+struct MeshCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	int64_t sourceModified;
+	uint64_t sourceSize;
+	float weldThreshold;
+	uint32_t numVertices;
+	uint32_t numIndices;
+	uint32_t numEdgeIndices;
+	uint64_t vertexOffset;
+	uint64_t normalOffset;
+	uint64_t colorOffset;
+	uint64_t texCoordOffset;
+	uint64_t indexOffset;
+	uint64_t edgeOffset;
+	uint64_t fileSize;
+	char sourcePath[1024];
+};
+
+//--------------------------------------------------------------
+// Read only view of a whole file, mapped where the platform allows
+class MappedFile {
+public:
+	MappedFile() : myData(nullptr), mySize(0) {
+	}
+
+	~MappedFile() {
+#ifndef TARGET_WIN32
+		if (myData) {
+			munmap((void *)myData, mySize);
+		}
+#endif
+	}
+
+	bool open(const string &path) {
+#ifndef TARGET_WIN32
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			::close(fd);
+			return false;
+		}
+		void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED) {
+			return false;
+		}
+		myData = static_cast<const uint8_t *>(data);
+		mySize = info.st_size;
+		return true;
+#else
+		ifstream file(path, ios::binary | ios::ate);
+		if (!file) {
+			return false;
+		}
+		myBuffer.resize(size_t(file.tellg()));
+		file.seekg(0);
+		file.read(reinterpret_cast<char *>(myBuffer.data()), myBuffer.size());
+		if (!file || myBuffer.empty()) {
+			return false;
+		}
+		myData = myBuffer.data();
+		mySize = myBuffer.size();
+		return true;
+#endif
+	}
+
+	const uint8_t *getData() const {
+		return myData;
+	}
+
+	size_t getSize() const {
+		return mySize;
+	}
+
+private:
+	const uint8_t *myData;
+	size_t mySize;
+#ifdef TARGET_WIN32
+	vector<uint8_t> myBuffer;
+#endif
+};
+
+//--------------------------------------------------------------
+static bool getSourceKey(const string &path, int64_t &modified, uint64_t &size) {
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) {
+		return false;
+	}
+	modified = int64_t(info.st_mtime);
+	size = uint64_t(info.st_size);
+	return true;
+}
+
+//--------------------------------------------------------------
+static uint64_t alignToPage(uint64_t offset) {
+	return (offset + meshCachePageSize - 1) / meshCachePageSize * meshCachePageSize;
+}
+
+//--------------------------------------------------------------
+static bool isSectionValid(const MeshCacheHeader &header, uint64_t offset, uint64_t size) {
+	return offset % meshCachePageSize == 0 && offset <= header.fileSize && size <= header.fileSize - offset;
+}
+
+//--------------------------------------------------------------
+template<typename T>
+static void copySection(const uint8_t *data, uint64_t offset, uint32_t count, vector<T> &values) {
+	const T *begin = reinterpret_cast<const T *>(data + offset);
+	values.assign(begin, begin + count);
+}
+
+//--------------------------------------------------------------
+static bool readMeshCache(const string &cachePath, const MeshCacheHeader &key, ofMesh &mesh, vector<ofIndexType> &edgeIndices) {
+	MappedFile file;
+	if (!file.open(cachePath) || file.getSize() < sizeof(MeshCacheHeader)) {
+		return false;
+	}
+
+	MeshCacheHeader header;
+	memcpy(&header, file.getData(), sizeof(header));
+	header.sourcePath[sizeof(header.sourcePath) - 1] = 0;
+	if (memcmp(header.magic, meshCacheMagic, sizeof(meshCacheMagic)) != 0 || header.version != meshCacheVersion ||
+		header.fileSize != file.getSize()) {
+		ofLogWarning("loadPreparedMesh") << cachePath << " is not a valid mesh cache, rebuilding it";
+		return false;
+	}
+
+	// Stale if anything the preparation depends on has changed
+	if (header.sourceModified != key.sourceModified || header.sourceSize != key.sourceSize ||
+		header.weldThreshold != key.weldThreshold ||
+		(header.flags & meshCacheReordered) != (key.flags & meshCacheReordered) ||
+		strcmp(header.sourcePath, key.sourcePath) != 0) {
+		return false;
+	}
+
+	bool hasColors = (header.flags & meshCacheHasColors) != 0;
+	bool hasTexCoords = (header.flags & meshCacheHasTexCoords) != 0;
+	uint64_t numVertices = header.numVertices;
+	if (!isSectionValid(header, header.vertexOffset, numVertices * sizeof(vec3)) ||
+		!isSectionValid(header, header.normalOffset, numVertices * sizeof(vec3)) ||
+		(hasColors && !isSectionValid(header, header.colorOffset, numVertices * sizeof(ofFloatColor))) ||
+		(hasTexCoords && !isSectionValid(header, header.texCoordOffset, numVertices * sizeof(vec2))) ||
+		!isSectionValid(header, header.indexOffset, uint64_t(header.numIndices) * sizeof(ofIndexType)) ||
+		!isSectionValid(header, header.edgeOffset, uint64_t(header.numEdgeIndices) * sizeof(ofIndexType))) {
+		ofLogWarning("loadPreparedMesh") << cachePath << " is truncated, rebuilding it";
+		return false;
+	}
+
+	const uint8_t *data = file.getData();
+	mesh.clear();
+	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+	copySection(data, header.vertexOffset, header.numVertices, mesh.getVertices());
+	copySection(data, header.normalOffset, header.numVertices, mesh.getNormals());
+	if (hasColors) {
+		copySection(data, header.colorOffset, header.numVertices, mesh.getColors());
+	}
+	if (hasTexCoords) {
+		copySection(data, header.texCoordOffset, header.numVertices, mesh.getTexCoords());
+	}
+	copySection(data, header.indexOffset, header.numIndices, mesh.getIndices());
+	copySection(data, header.edgeOffset, header.numEdgeIndices, edgeIndices);
+	return true;
+}
+
+//--------------------------------------------------------------
+template<typename T>
+static void writeSection(ostream &stream, uint64_t offset, const vector<T> &values) {
+	stream.seekp(offset);
+	stream.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+}
+
+//--------------------------------------------------------------
+static bool writeMeshCache(const string &cachePath, const MeshCacheHeader &key, const ofMesh &mesh, const vector<ofIndexType> &edgeIndices) {
+	MeshCacheHeader header = key;
+	bool hasColors = mesh.getNumColors() == mesh.getNumVertices() && mesh.getNumColors() > 0;
+	bool hasTexCoords = mesh.getNumTexCoords() == mesh.getNumVertices() && mesh.getNumTexCoords() > 0;
+	header.flags |= (hasColors ? meshCacheHasColors : 0) | (hasTexCoords ? meshCacheHasTexCoords : 0);
+	header.numVertices = mesh.getNumVertices();
+	header.numIndices = mesh.getNumIndices();
+	header.numEdgeIndices = edgeIndices.size();
+
+	uint64_t offset = alignToPage(sizeof(header));
+	header.vertexOffset = offset;
+	offset = alignToPage(offset + mesh.getNumVertices() * sizeof(vec3));
+	header.normalOffset = offset;
+	offset = alignToPage(offset + mesh.getNumVertices() * sizeof(vec3));
+	header.colorOffset = offset;
+	offset = alignToPage(offset + (hasColors ? mesh.getNumVertices() * sizeof(ofFloatColor) : 0));
+	header.texCoordOffset = offset;
+	offset = alignToPage(offset + (hasTexCoords ? mesh.getNumVertices() * sizeof(vec2) : 0));
+	header.indexOffset = offset;
+	offset = alignToPage(offset + mesh.getNumIndices() * sizeof(ofIndexType));
+	header.edgeOffset = offset;
+	offset = alignToPage(offset + edgeIndices.size() * sizeof(ofIndexType));
+	header.fileSize = offset;
+
+	// Written under a temporary name and renamed, so an interrupted write
+	// never leaves a cache that looks valid
+	string tempPath = cachePath + ".tmp";
+	{
+		ofstream file(tempPath, ios::binary | ios::trunc);
+		if (!file) {
+			ofLogWarning("loadPreparedMesh") << "could not write " << tempPath;
+			return false;
+		}
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		writeSection(file, header.vertexOffset, mesh.getVertices());
+		writeSection(file, header.normalOffset, mesh.getNormals());
+		if (hasColors) {
+			writeSection(file, header.colorOffset, mesh.getColors());
+		}
+		if (hasTexCoords) {
+			writeSection(file, header.texCoordOffset, mesh.getTexCoords());
+		}
+		writeSection(file, header.indexOffset, mesh.getIndices());
+		writeSection(file, header.edgeOffset, edgeIndices);
+
+		// Pad the last section out to its page
+		file.seekp(header.fileSize - 1);
+		file.put(0);
+		if (!file) {
+			ofLogWarning("loadPreparedMesh") << "could not write " << tempPath;
+			return false;
+		}
+	}
+	if (rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+		remove(tempPath.c_str());
+		ofLogWarning("loadPreparedMesh") << "could not replace " << cachePath;
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------
+void calcEdgeIndices(const ofMesh &mesh, vector<ofIndexType> &edgeIndices) {
+	// Each edge as one 64 bit key with the lower index first, sorted so
+	// the edges shared by two triangles end up next to each other
+	const vector<ofIndexType> &indices = mesh.getIndices();
+	vector<uint64_t> edges;
+	edges.reserve(indices.size());
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		for (int j = 0; j < 3; j++) {
+			uint64_t a = indices[i + j];
+			uint64_t b = indices[i + (j + 1) % 3];
+			edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+		}
+	}
+	sort(edges.begin(), edges.end());
+	edges.erase(unique(edges.begin(), edges.end()), edges.end());
+
+	edgeIndices.resize(2 * edges.size());
+	for (size_t i = 0; i < edges.size(); i++) {
+		edgeIndices[2 * i] = ofIndexType(edges[i] >> 32);
+		edgeIndices[2 * i + 1] = ofIndexType(edges[i] & 0xFFFFFFFF);
+	}
+}
+
+//--------------------------------------------------------------
+bool loadPreparedMesh(const string &path, float weldThreshold, bool reorder, ofMesh &mesh, vector<ofIndexType> &edgeIndices, bool useCache) {
+	uint64_t startTime = ofGetElapsedTimeMicros();
+	string sourcePath = ofToDataPath(path);
+	string cachePath = sourcePath + ".bsmcache";
+
+	MeshCacheHeader key;
+	memset(&key, 0, sizeof(key));
+	memcpy(key.magic, meshCacheMagic, sizeof(meshCacheMagic));
+	key.version = meshCacheVersion;
+	key.flags = reorder ? meshCacheReordered : 0;
+	key.weldThreshold = weldThreshold;
+	strncpy(key.sourcePath, sourcePath.c_str(), sizeof(key.sourcePath) - 1);
+	bool hasKey = getSourceKey(sourcePath, key.sourceModified, key.sourceSize) &&
+		sourcePath.size() < sizeof(key.sourcePath);
+
+	if (useCache && hasKey && readMeshCache(cachePath, key, mesh, edgeIndices)) {
+		ofLogNotice("loadPreparedMesh") << "loaded " << path << " from its cache in "
+			<< (ofGetElapsedTimeMicros() - startTime) / 1000.0 << "ms";
+		return true;
+	}
+
+	mesh.clear();
+	mesh.load(path);
+	if (mesh.getNumVertices() == 0) {
+		ofLogError("loadPreparedMesh") << "could not load mesh " << path;
+		return false;
+	}
+
+	removeDuplicateVertices(mesh, weldThreshold);
+	if (reorder) {
+		// Reorder for cache locality in calcNormals and the update loop
+		optimizeVertexCache(mesh);
+	}
+	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+	if (mesh.getNumNormals() != mesh.getNumVertices()) {
+		calcNormals(mesh);
+	}
+	calcEdgeIndices(mesh, edgeIndices);
+
+	if (useCache && hasKey) {
+		writeMeshCache(cachePath, key, mesh, edgeIndices);
+	}
+	ofLogNotice("loadPreparedMesh") << "prepared " << path << " in "
+		<< (ofGetElapsedTimeMicros() - startTime) / 1000.0 << "ms";
+	return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "ofMain.h"
+
+using namespace glm;
+
+// Cache of meshes prepared for the particle system.
+//
+// Preparing a mesh welds its duplicate vertices, optionally reorders it
+// for the vertex cache, calculates normals if it has none and lists its
+// unique edges for line mode. The welding alone takes seconds on large
+// meshes, so the result is written to <mesh path>.bsmcache and later
+// launches map that file and copy the arrays straight into the mesh.
+//
+// File layout (native byte order, every section starts on a 4096 byte
+// page so it can be used in place from the mapping):
+//   header   magic "BSMCACHE", version, flags, key (source modification
+//            time, source size, weld threshold, source path), counts
+//            and the offset of each section
+//   sections vertices, normals, colors, texture coordinates, triangle
+//            indices, edge indices
+//
+// The cache is only used if the whole key matches, otherwise the mesh
+// is prepared again and the cache rewritten.
+
+// Loads and prepares the mesh at path, through the cache unless
+// useCache is false. edgeIndices gets two indices per unique edge.
+bool loadPreparedMesh(const string &path, float weldThreshold, bool reorder, ofMesh &mesh, vector<ofIndexType> &edgeIndices, bool useCache = true);
+
+// Unique edges of a triangle mesh, two indices per edge
+void calcEdgeIndices(const ofMesh &mesh, vector<ofIndexType> &edgeIndices);
@@ -0,0 +1,249 @@
+#include "meshOptimizer.h"
+
+// Scoring constants from Forsyth's "Linear-Speed Vertex Cache
+// Optimisation"
+const float cacheDecayPower = 1.5;
+const float lastTriangleScore = 0.75;
+const float valenceBoostScale = 2.0;
+const float valenceBoostPower = 0.5;
+
+//--------------------------------------------------------------
+static float calcVertexScore(int cachePosition, int remainingTriangles, int cacheSize) {
+	if (remainingTriangles == 0) {
+		// No triangles left to use this vertex
+		return -1.0;
+	}
+
+	float score = 0.0;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) {
+			// Vertices of the last triangle get a fixed score so the
+			// next triangle doesn't just reuse the same edge
+			score = lastTriangleScore;
+		}
+		else {
+			float scaler = 1.0 / (cacheSize - 3);
+			score = powf(1.0 - (cachePosition - 3) * scaler, cacheDecayPower);
+		}
+	}
+
+	// Boost vertices with few triangles left, so they get finished off
+	// instead of being left as lone triangles at the end
+	score += valenceBoostScale * powf(remainingTriangles, -valenceBoostPower);
+	return score;
+}
+
+//--------------------------------------------------------------
+static void reorderTriangles(vector<ofIndexType> &indices, int numVertices, int cacheSize) {
+	int numTriangles = indices.size() / 3;
+
+	// Triangle lists per vertex, stored contiguously. The first
+	// remaining[v] entries of each list are the triangles not yet emitted.
+	vector<int> remaining(numVertices, 0);
+	for (int i = 0; i < numTriangles * 3; i++) {
+		remaining[indices[i]]++;
+	}
+	vector<int> listStart(numVertices + 1, 0);
+	for (int v = 0; v < numVertices; v++) {
+		listStart[v + 1] = listStart[v] + remaining[v];
+	}
+	vector<int> triangleLists(listStart[numVertices]);
+	vector<int> fill(listStart.begin(), listStart.end() - 1);
+	for (int t = 0; t < numTriangles; t++) {
+		for (int k = 0; k < 3; k++) {
+			triangleLists[fill[indices[3 * t + k]]++] = t;
+		}
+	}
+
+	vector<int> cachePosition(numVertices, -1);
+	vector<float> vertexScore(numVertices);
+	for (int v = 0; v < numVertices; v++) {
+		vertexScore[v] = calcVertexScore(-1, remaining[v], cacheSize);
+	}
+
+	vector<float> triangleScore(numTriangles);
+	vector<bool> emitted(numTriangles, false);
+	for (int t = 0; t < numTriangles; t++) {
+		triangleScore[t] = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] + vertexScore[indices[3 * t + 2]];
+	}
+
+	// The cache holds up to cacheSize vertices, plus room for the three
+	// being pushed in front
+	vector<int> cache;
+	vector<int> newCache;
+	cache.reserve(cacheSize + 3);
+	newCache.reserve(cacheSize + 3);
+
+	vector<ofIndexType> output;
+	output.reserve(indices.size());
+
+	int bestTriangle = -1;
+	float bestScore = -1.0;
+	int scanCursor = 0;
+
+	for (int numEmitted = 0; numEmitted < numTriangles; numEmitted++) {
+		if (bestTriangle < 0) {
+			// Nothing useful in the cache, take the next free triangle
+			while (emitted[scanCursor]) {
+				scanCursor++;
+			}
+			bestTriangle = scanCursor;
+		}
+
+		// Emit the triangle and take it off its vertices' lists
+		int t = bestTriangle;
+		emitted[t] = true;
+		newCache.clear();
+		for (int k = 0; k < 3; k++) {
+			int v = indices[3 * t + k];
+			output.push_back(v);
+			newCache.push_back(v);
+
+			int *list = &triangleLists[listStart[v]];
+			for (int j = 0; j < remaining[v]; j++) {
+				if (list[j] == t) {
+					swap(list[j], list[remaining[v] - 1]);
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		// Move the triangle's vertices to the front of the cache
+		for (size_t i = 0; i < cache.size(); i++) {
+			int v = cache[i];
+			if (v != newCache[0] && v != newCache[1] && v != newCache[2]) {
+				newCache.push_back(v);
+			}
+		}
+		cache.swap(newCache);
+
+		// Rescore the vertices whose cache position changed, including
+		// the ones that just fell out, and spread the change to their
+		// triangles
+		for (int i = 0; i < int(cache.size()); i++) {
+			int v = cache[i];
+			int position = i < cacheSize ? i : -1;
+			cachePosition[v] = position;
+			float score = calcVertexScore(position, remaining[v], cacheSize);
+			float delta = score - vertexScore[v];
+			vertexScore[v] = score;
+			for (int j = 0; j < remaining[v]; j++) {
+				triangleScore[triangleLists[listStart[v] + j]] += delta;
+			}
+		}
+		if (int(cache.size()) > cacheSize) {
+			cache.resize(cacheSize);
+		}
+
+		// The next triangle is the best one touching the cache
+		bestTriangle = -1;
+		bestScore = -1.0;
+		for (size_t i = 0; i < cache.size(); i++) {
+			int v = cache[i];
+			for (int j = 0; j < remaining[v]; j++) {
+				int candidate = triangleLists[listStart[v] + j];
+				if (triangleScore[candidate] > bestScore) {
+					bestScore = triangleScore[candidate];
+					bestTriangle = candidate;
+				}
+			}
+		}
+	}
+
+	// Keep any trailing indices that don't form a whole triangle
+	for (size_t i = size_t(numTriangles) * 3; i < indices.size(); i++) {
+		output.push_back(indices[i]);
+	}
+	indices.swap(output);
+}
+
+//--------------------------------------------------------------
+template<typename T>
+static void permuteAttribute(vector<T> &values, const vector<ofIndexType> &oldFromNew) {
+	if (values.size() != oldFromNew.size()) {
+		return;
+	}
+	vector<T> reordered(values.size());
+	for (size_t i = 0; i < oldFromNew.size(); i++) {
+		reordered[i] = values[oldFromNew[i]];
+	}
+	values.swap(reordered);
+}
+
+//--------------------------------------------------------------
+void optimizeVertexCache(ofMesh &curMesh, int cacheSize) {
+	// Only indexed triangle meshes can be reordered
+	if (curMesh.getMode() != OF_PRIMITIVE_TRIANGLES || curMesh.getNumIndices() < 3) {
+		return;
+	}
+
+	int numVertices = curMesh.getNumVertices();
+	vector<ofIndexType> &indices = curMesh.getIndices();
+	for (size_t i = 0; i < indices.size(); i++) {
+		if (indices[i] >= ofIndexType(numVertices)) {
+			ofLogError("optimizeVertexCache") << "index out of range, mesh left unchanged";
+			return;
+		}
+	}
+
+	cacheSize = max(cacheSize, 4);
+	float missRatioBefore = calcCacheMissRatio(indices, numVertices, cacheSize);
+	uint64_t startMicros = ofGetElapsedTimeMicros();
+
+	reorderTriangles(indices, numVertices, cacheSize);
+
+	// Renumber vertices in the order the triangles first use them,
+	// unused vertices keep their relative order at the end
+	const ofIndexType unassigned = numeric_limits<ofIndexType>::max();
+	vector<ofIndexType> newFromOld(numVertices, unassigned);
+	vector<ofIndexType> oldFromNew;
+	oldFromNew.reserve(numVertices);
+	for (size_t i = 0; i < indices.size(); i++) {
+		ofIndexType v = indices[i];
+		if (newFromOld[v] == unassigned) {
+			newFromOld[v] = oldFromNew.size();
+			oldFromNew.push_back(v);
+		}
+		indices[i] = newFromOld[v];
+	}
+	for (int v = 0; v < numVertices; v++) {
+		if (newFromOld[v] == unassigned) {
+			newFromOld[v] = oldFromNew.size();
+			oldFromNew.push_back(v);
+		}
+	}
+
+	permuteAttribute(curMesh.getVertices(), oldFromNew);
+	permuteAttribute(curMesh.getNormals(), oldFromNew);
+	permuteAttribute(curMesh.getColors(), oldFromNew);
+	permuteAttribute(curMesh.getTexCoords(), oldFromNew);
+
+	ofLogNotice("optimizeVertexCache") << indices.size() / 3 << " triangles, cache miss ratio "
+		<< missRatioBefore << " -> " << calcCacheMissRatio(indices, numVertices, cacheSize)
+		<< " in " << (ofGetElapsedTimeMicros() - startMicros) / 1000.0 << "ms";
+}
+
+//--------------------------------------------------------------
+float calcCacheMissRatio(const vector<ofIndexType> &indices, int numVertices, int cacheSize) {
+	int numTriangles = indices.size() / 3;
+	if (numTriangles == 0) {
+		return 0;
+	}
+
+	// FIFO cache: a vertex is cached if it was loaded within the last
+	// cacheSize misses
+	vector<int64_t> loadedAt(numVertices, numeric_limits<int64_t>::min() / 2);
+	int64_t misses = 0;
+	for (int i = 0; i < numTriangles * 3; i++) {
+		ofIndexType v = indices[i];
+		if (v >= ofIndexType(numVertices)) {
+			continue;
+		}
+		if (misses - loadedAt[v] >= cacheSize) {
+			misses++;
+			loadedAt[v] = misses;
+		}
+	}
+	return float(misses) / numTriangles;
+}
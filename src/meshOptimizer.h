@@ -0,0 +1,22 @@
+#pragma once
+
+#include "ofMain.h"
+
+using namespace glm;
+
+// Load-time reordering of triangle meshes for memory locality.
+//
+// Triangles are reordered with Tom Forsyth's linear-speed vertex cache
+// optimisation, so consecutive triangles share vertices. Vertices are
+// then renumbered in the order the triangles first use them and the
+// indices are remapped. Per-triangle and per-vertex loops then walk
+// memory mostly forwards.
+
+// Reorders triangles and vertices of a triangle mesh in place. Colors,
+// normals and texture coordinates are moved along with the vertices.
+void optimizeVertexCache(ofMesh &curMesh, int cacheSize = 32);
+
+// Average cache miss ratio: vertex cache misses per triangle for a FIFO
+// cache of the given size. 0.5 is the ideal for large regular meshes,
+// 3.0 is the worst case.
+float calcCacheMissRatio(const vector<ofIndexType> &indices, int numVertices, int cacheSize = 32);
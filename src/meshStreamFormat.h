@@ -0,0 +1,75 @@
+#pragma once
+
+// Layout of the shared memory mesh stream, shared by MeshStreamPublisher
+// and MeshStreamReader. Only standard headers here, readers are built
+// without openFrameworks.
+//
+// The region starts with a MeshStreamHeader, followed by numSlots slots
+// of slotSize bytes, each starting on a 4096 byte page:
+//   MeshStreamSlotHeader
+//   vertices   maxVertices x 3 floats
+//   normals    maxVertices x 3 floats
+//   indices    maxIndices x uint32
+//
+// Frame n goes into slot n % numSlots. Each slot is a sequence lock:
+// its sequence is 2n + 1 while frame n is being written and 2n + 2 once
+// it is complete, after which the header's latestFrame is set to n + 1.
+// A reader takes the latest frame, checks the slot's sequence before and
+// after using the data, and drops the frame if it changed. The producer
+// never waits for readers; a reader has numSlots - 1 frame intervals to
+// use a frame before it can be overwritten.
+//
+// Indices are only copied into a slot when its topology version is out
+// of date, so a mesh whose topology doesn't change costs one copy of
+// the vertex and normal data per frame.
+
+#include <atomic>
+#include <cstdint>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the mesh stream needs lock free 64 bit atomics to share them between processes");
+
+#define MESH_STREAM_DEFAULT_NAME "/bodyScanner-mesh"
+
+const char meshStreamMagic[8] = { 'B', 'S', 'S', 'T', 'R', 'E', 'A', 'M' };
+const uint32_t meshStreamVersion = 2;
+const uint64_t meshStreamPageSize = 4096;
+
+const uint32_t meshStreamHasNormals = 1;
+
+struct MeshStreamHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t numSlots;
+	uint64_t slotOffset;
+	uint64_t slotSize;
+	uint32_t maxVertices;
+	uint32_t maxIndices;
+
+	// Process id of the publisher, a stream whose owner is gone can be
+	// replaced by a new one
+	int32_t ownerPid;
+	uint32_t reserved;
+
+	// Newest complete frame plus one, 0 before the first frame
+	std::atomic<uint64_t> latestFrame;
+};
+
+struct MeshStreamSlotHeader {
+	std::atomic<uint64_t> sequence;
+	uint64_t frameNumber;
+	uint64_t timestamp;
+	uint32_t topologyVersion;
+	uint32_t numVertices;
+	uint32_t numIndices;
+	uint32_t primitiveMode;
+	uint32_t flags;
+	uint32_t reserved;
+	uint64_t verticesOffset;
+	uint64_t normalsOffset;
+	uint64_t indicesOffset;
+};
+
+//--------------------------------------------------------------
+inline uint64_t alignToMeshStreamPage(uint64_t size) {
+	return (size + meshStreamPageSize - 1) / meshStreamPageSize * meshStreamPageSize;
+}
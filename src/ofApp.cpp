@@ -1,5 +1,9 @@
 #include "ofApp.h"
 #include "helpers.h"
+#include "meshCache.h"
+#include "FrameArena.h"
+#include "allocationCounter.h"
+#include "StartupLoader.h"
 
 //--------------------------------------------------------------
 void ofApp::setup(){
@@ -13,23 +17,16 @@ void ofApp::setup(){
 	// Setup mode:  2=custom mesh, 3=pointcloud
 	mySetupMode = 2;
     
-    //load shader
-    myReflectionShader.load("reflection");
+    // Everything slow is loaded by startup tasks, see the end of setup
     ofDisableArbTex();
     ofEnableNormalizedTexCoords();
-    myEnvironmentMap.load("hdri_hub_environmentMap.jpg");
-
-
-
-	// If we're using a custom mesh, load it from file
-	if (mySetupMode == 2) {
-		myInitialMesh.load("stacks.ply");
-		removeDuplicateVertices(myInitialMesh, 0.0001);
-	}
 
 	// Setup GUI
 	myGui.setup();
 	myGui.add(myFpsLabel.setup("FPS", ofToString(ofGetFrameRate(), 2)));
+	if (isAllocationCountingEnabled()) {
+		myGui.add(myAllocationLabel.setup("Allocations/frame", "0"));
+	}
 	myGui.add(paramAmplitude.set("Amplitude", 5.0, 0.0, 20.0));
 	myGui.add(paramFrequency.set("Frequency", 1.0, 0.0, 10.0));
 	myGui.add(paramScale.set("Scale", 1.0, 0.0, 10.0));
@@ -42,17 +39,85 @@ void ofApp::setup(){
 	myGui.add(paramFileName.set("File name", "outFile"));
 	myGui.add(buttonSaveMesh.setup("Save mesh"));
 
+	// Each feature's controls go in a group of their own, closed to
+	// start with
+	myEffectsGui.setup("Effects");
+	myEffectsGui.add(paramNoise.set("Noise", true));
+	myEffectsGui.add(paramRipple.set("Ripple", false));
+	myEffectsGui.add(paramRippleAmplitude.set("Ripple amplitude", 5.0, 0.0, 20.0));
+	myEffectsGui.add(paramRippleWavelength.set("Ripple wavelength", 50.0, 5.0, 300.0));
+	myEffectsGui.add(paramTwist.set("Twist", false));
+	myEffectsGui.add(paramTwistAngle.set("Twist angle", 30.0, 0.0, 180.0));
+	myEffectsGui.add(paramFlow.set("Flow", false));
+	myEffectsGui.add(paramFlowAmplitude.set("Flow amplitude", 10.0, 0.0, 50.0));
+	myEffectsGui.add(paramFlowScale.set("Flow scale", 100.0, 10.0, 500.0));
+	myEffectsGui.add(paramShape.set("Shape", false));
+	myEffectsGui.add(paramShapeGain.set("Shape gain", 0.5, 0.01, 0.99));
+	myEffectsGui.add(paramBakedNoise.set("Baked noise", false));
+	myEffectsGui.add(paramAnalyticNormals.set("Analytic normals", false));
+
+	myQualityGui.setup("Quality");
+	myQualityGui.add(paramGovernor.set("Quality governor", false));
+	myQualityGui.add(myQualityLabel.setup("Quality", myGovernor.getSettingsDescription()));
+	myQualityGui.add(myStageTimesLabel.setup("ms", myGovernor.getTimingDescription()));
+	myQualityGui.add(paramCompactStorage.set("Compact vertices", false));
+	myQualityGui.add(paramPointBudget.set("Point budget", 0, 0, 2000000));
+	myQualityGui.add(myVisiblePointsLabel.setup("Visible points", "0"));
+
+	mySimulationGui.setup("Simulation");
+	mySimulationGui.add(paramSimulation.set("Spring simulation", false));
+	mySimulationGui.add(paramGravity.set("Gravity", 500.0, 0.0, 2000.0));
+	mySimulationGui.add(paramDamping.set("Damping", 0.02, 0.0, 0.2));
+	mySimulationGui.add(paramStiffness.set("Stiffness", 1.0, 0.0, 1.0));
+	mySimulationGui.add(paramIterations.set("Solver iterations", 8, 1, 20));
+	mySimulationGui.add(paramPinHeight.set("Pinned height", 0.05, 0.0, 0.5));
+
+	myDepthGui.setup("Depth");
+	myDepthGui.add(paramDepthFilter.set("Depth filter", 0, 0, 2));
+	myDepthGui.add(paramBackgroundMargin.set("Background margin", 50, 0, 300));
+	myDepthGui.add(buttonLearnBackground.setup("Learn background"));
+	myDepthGui.add(paramAdaptiveSampling.set("Adaptive sampling", false));
+	myDepthGui.add(paramDepthInterpolation.set("Depth interpolation", false));
+	myDepthGui.add(paramInterpolationDelay.set("Interpolation delay ms", 0, 0, 50));
+	myDepthGui.add(paramOutlierRemoval.set("Remove outliers", false));
+	myDepthGui.add(paramOutlierThreshold.set("Outlier threshold", 2.0, 0.5, 5.0));
+
+	myOutputGui.setup("Recording");
+	myOutputGui.add(paramRecordDepth.set("Record depth", false));
+	myOutputGui.add(myRecorderLabel.setup("Depth frames (dropped)", "0"));
+	myOutputGui.add(paramRecordSequence.set("Record sequence", false));
+	myOutputGui.add(paramSequenceNormals.set("Sequence normals", true));
+	myOutputGui.add(paramPublishMesh.set("Publish mesh", false));
+
+	for (ofxGuiGroup *group : { &myEffectsGui, &myQualityGui, &mySimulationGui, &myDepthGui, &myOutputGui }) {
+		group->minimize();
+		myGui.add(group);
+	}
+
 	// Setup listeners for parameters
 	paramGridSizeX.addListener(this, &ofApp::gridSizeChanged);
 	paramGridSizeY.addListener(this, &ofApp::gridSizeChanged);
 	paramShowLines.addListener(this, &ofApp::displayModeChanged);
 	paramShowTriangles.addListener(this, &ofApp::displayModeChanged);
     paramShader.addListener(this, &ofApp::displayModeChanged);
+	paramCompactStorage.addListener(this, &ofApp::compactStorageChanged);
+	paramDepthFilter.addListener(this, &ofApp::depthFilterChanged);
+	paramBackgroundMargin.addListener(this, &ofApp::backgroundMarginChanged);
+	buttonLearnBackground.addListener(this, &ofApp::learnBackgroundPressed);
+	paramAdaptiveSampling.addListener(this, &ofApp::adaptiveSamplingChanged);
+	paramDepthInterpolation.addListener(this, &ofApp::depthInterpolationChanged);
+	paramOutlierRemoval.addListener(this, &ofApp::outlierRemovalChanged);
+	paramOutlierThreshold.addListener(this, &ofApp::outlierThresholdChanged);
+	paramBakedNoise.addListener(this, &ofApp::bakedNoiseChanged);
+	paramAnalyticNormals.addListener(this, &ofApp::analyticNormalsChanged);
+	paramGovernor.addListener(this, &ofApp::governorChanged);
+	paramPointBudget.addListener(this, &ofApp::pointBudgetChanged);
+	paramSimulation.addListener(this, &ofApp::simulationChanged);
 	buttonRestart.addListener(this, &ofApp::setupParticleSystem);
 	buttonSaveMesh.addListener(this, &ofApp::saveMeshButtonPressed);
-
-	// Setup the particle system
-	setupParticleSystem();
+	paramRecordDepth.addListener(this, &ofApp::recordDepthChanged);
+	paramRecordSequence.addListener(this, &ofApp::recordSequenceChanged);
+	paramPublishMesh.addListener(this, &ofApp::publishMeshChanged);
 
 	// Setup EasyCam
 	myCamera.setAutoDistance(false);
@@ -80,17 +145,132 @@ void ofApp::setup(){
     
     fbo.allocate(1280, 720, GL_RGBA); // with alpha, 8 bits red, 8 bits green, 8 bits blue, 8 bits alpha, from 0 to 255 in 256 steps
 
+	// Decoding, mesh parsing and opening the Kinect run at the same time
+	// on their own threads, GL uploads and the particle setup wait for
+	// the main thread. The GUI only takes input once everything's ready.
+	myGui.unregisterMouseEvents();
+	myStartup.addTask("shader", nullptr, [this] {
+		myReflectionShader.load("reflection");
+	});
+	myStartup.addTask("environment map", [this] {
+		ofLoadImage(myEnvironmentPixels, "hdri_hub_environmentMap.jpg");
+	}, [this] {
+		myEnvironmentMap.setFromPixels(myEnvironmentPixels);
+		myEnvironmentPixels.clear();
+	});
+	int meshTask = myStartup.addTask("mesh", [this] {
+		// Welded, reordered and with normals, from the cache after the
+		// first launch
+		if (mySetupMode == 2) {
+			loadPreparedMesh("stacks.ply", 0.0001, true, myInitialMesh, myInitialEdges);
+		}
+	}, nullptr);
+	myStartup.addTask("particles", nullptr, [this] {
+		setupParticleSystem();
+	}, { meshTask });
+	myStartup.addTask("kinect", [this] {
+		myParticleSystem.openKinect();
+	}, nullptr);
+	myStartup.start();
 }
 
 //--------------------------------------------------------------
 void ofApp::update(){
+	myFrameStartTime = ofGetElapsedTimeMicros();
+
+	// Until everything's loaded only the startup moves on
+	if (!myStartup.isDone()) {
+		myStartup.update();
+		if (!myStartup.isDone()) {
+			return;
+		}
+		myGui.registerMouseEvents();
+	}
+
 	// Update the particles
-	myParticleSystem.update(paramAmplitude, paramFrequency, paramScale);
+	// The ticked effects are applied in a fixed order, noise first
+	EffectSettings effects;
+	effects.effects = (paramNoise ? EFFECT_NOISE : 0) | (paramRipple ? EFFECT_RIPPLE : 0) |
+		(paramTwist ? EFFECT_TWIST : 0) | (paramFlow ? EFFECT_FLOW : 0) | (paramShape ? EFFECT_SHAPE : 0);
+	effects.amplitude = paramAmplitude;
+	effects.frequency = paramFrequency;
+	effects.scale = paramScale;
+	effects.rippleAmplitude = paramRippleAmplitude;
+	effects.rippleWavelength = paramRippleWavelength;
+	effects.twistAngle = paramTwistAngle;
+	effects.flowAmplitude = paramFlowAmplitude;
+	effects.flowScale = paramFlowScale;
+	effects.shapeGain = paramShapeGain;
+	if (paramBakedNoise && myNoiseVolume.isBuilt() && myFlowVolume.isBuilt()) {
+		effects.noiseVolume = &myNoiseVolume;
+		effects.flowVolume = &myFlowVolume;
+	}
+	SpringSystem &springs = myParticleSystem.getSpringSystem();
+	springs.setGravity(vec3(0, -paramGravity, 0));
+	springs.setDamping(paramDamping);
+	springs.setStiffness(paramStiffness);
+	springs.setNumIterations(paramIterations);
+	springs.setPinHeight(paramPinHeight);
+	// The point budget selects the points from the camera's view
+	if (paramPointBudget > 0) {
+		ofRectangle viewport = ofGetCurrentViewport();
+		OctreeView view;
+		view.viewProjection = myCamera.getModelViewProjectionMatrix(viewport);
+		view.position = myCamera.getGlobalPosition();
+		view.pixelScale = viewport.height / (2 * tan(ofDegToRad(myCamera.getFov()) / 2));
+		myParticleSystem.setView(view);
+	}
+	myParticleSystem.setUpdateStride(myGovernor.getUpdateStride());
+	myParticleSystem.setNormalsInterval(myGovernor.getNormalsInterval());
+	myParticleSystem.update(effects, myClock);
+	myGovernor.addStageTime(QualityGovernor::STAGE_EFFECTS, myParticleSystem.getEffectsTime());
+	myGovernor.addStageTime(QualityGovernor::STAGE_NORMALS, myParticleSystem.getNormalsTime());
+
+	// Queue the animated mesh for the sequence exporter
+	if (mySequenceExporter.isRecording()) {
+		if (!mySequenceExporter.addFrame(myParticleSystem.getMesh(), ofGetElapsedTimeMicros()) && !mySequenceExporter.isRecording()) {
+			paramRecordSequence = false;
+		}
+	}
+	else if (paramRecordSequence && mySequenceExporter.hasFailed()) {
+		// A failed write has stopped the export
+		paramRecordSequence = false;
+	}
 
-	// Update the frames per second label in the GUI
-	myFpsLabel = ofToString(ofGetFrameRate(), 2);
+	// Update the frames per second label in the GUI. Formatted into a
+	// fixed buffer, a string this short doesn't touch the heap
+	char fpsText[16];
+	snprintf(fpsText, sizeof(fpsText), "%.2f", ofGetFrameRate());
+	myFpsLabel = fpsText;
+	char visibleText[16];
+	snprintf(visibleText, sizeof(visibleText), "%d", myParticleSystem.getNumVisiblePoints());
+	myVisiblePointsLabel = visibleText;
+
+	// Heap allocations since the last update, GUI drawing included
+	if (isAllocationCountingEnabled()) {
+		uint64_t allocationCount = getAllocationCount();
+		char allocationText[16];
+		snprintf(allocationText, sizeof(allocationText), "%d", int(allocationCount - myLastAllocationCount));
+		myAllocationLabel = allocationText;
+		myLastAllocationCount = allocationCount;
+	}
     
     myParticleSystem.updateKinect();
+
+    // Hand every new depth frame to the recorder's writer thread
+    if (myDepthRecorder.isRecording()) {
+        if (myParticleSystem.isKinectFrameNew()) {
+            myDepthRecorder.addFrame(myParticleSystem.getRawDepthPixels(), ofGetElapsedTimeMicros());
+        }
+        // Kept short like the FPS label, so it stays off the heap
+        char recorderText[16];
+        snprintf(recorderText, sizeof(recorderText), "%d (%d)", myDepthRecorder.getNumFramesWritten(), myDepthRecorder.getNumFramesDropped());
+        myRecorderLabel = recorderText;
+    }
+    else if (paramRecordDepth && myDepthRecorder.hasFailed()) {
+        // A failed write has stopped the recording
+        paramRecordDepth = false;
+    }
     
     
     ofPrimitiveMode curDisplayMode;
@@ -105,12 +285,31 @@ void ofApp::update(){
     }
 
     if (mySetupMode == 3) {
-        myParticleSystem.setupUsingPointCloud(paramGridSizeX, paramGridSizeY, myPlaneRangeX, myPlaneRangeY, curDisplayMode);
+        // The governor may lower the grid resolution
+        uint64_t pointCloudStart = ofGetElapsedTimeMicros();
+        int gridSizeX = max(2, int(paramGridSizeX * myGovernor.getGridScale()));
+        int gridSizeY = max(2, int(paramGridSizeY * myGovernor.getGridScale()));
+        myParticleSystem.getDepthInterpolator().setDelay(paramInterpolationDelay);
+        myParticleSystem.setupUsingPointCloud(gridSizeX, gridSizeY, myPlaneRangeX, myPlaneRangeY, curDisplayMode);
+        myGovernor.addStageTime(QualityGovernor::STAGE_POINT_CLOUD, (ofGetElapsedTimeMicros() - pointCloudStart) / 1000.0);
     }
+
+	// Hand the finished mesh to other processes
+	if (myMeshPublisher.isPublishing()) {
+		myMeshPublisher.publish(myParticleSystem.getMesh(), ofGetElapsedTimeMicros());
+	}
 }
 
 //--------------------------------------------------------------
 void ofApp::draw(){
+	if (!myStartup.isDone()) {
+		drawStartupProgress();
+		getFrameArena().reset();
+		return;
+	}
+
+	uint64_t drawStart = ofGetElapsedTimeMicros();
+
     if (paramShader == false){
 	// Start drawing objects in 3D space
 	ofEnableDepthTest();
@@ -168,11 +367,32 @@ void ofApp::draw(){
     }
     
 
+	myGovernor.addStageTime(QualityGovernor::STAGE_DRAW, (ofGetElapsedTimeMicros() - drawStart) / 1000.0);
+
 	// Draw the GUI elements
 	myGui.draw();
     ofDrawBitmapString("press:KEY 2 for .PLY :Key 3 Kinect render", 230, 20);
     cout<<myParticleSystem.p<<endl;
-   
+
+	// Everything taken from the frame arena this frame is done with
+	getFrameArena().reset();
+
+	// The frame's CPU time, from the start of update, decides the
+	// quality of the next frames. The labels are only rebuilt now and
+	// then, they don't fit in a string without a heap allocation.
+	bool qualityChanged = myGovernor.update((ofGetElapsedTimeMicros() - myFrameStartTime) / 1000.0);
+	if (qualityChanged || ofGetFrameNum() % 30 == 0) {
+		myQualityLabel = myGovernor.getSettingsDescription();
+		myStageTimesLabel = myGovernor.getTimingDescription();
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::exit(){
+    // Make sure the recording gets its index written
+    myDepthRecorder.stop();
+    mySequenceExporter.stop();
+    myMeshPublisher.stop();
 }
 
 //--------------------------------------------------------------
@@ -192,7 +412,7 @@ void ofApp::setupParticleSystem() {
 	// displaying as a plane or a sphere
 
 	 if (mySetupMode == 2) {
-		myParticleSystem.setupUsingMesh(myInitialMesh, curDisplayMode);
+		myParticleSystem.setupUsingMesh(myInitialMesh, myInitialEdges, curDisplayMode);
 	}
     else if (mySetupMode == 3) {
         myParticleSystem.setupUsingPointCloud(paramGridSizeX, paramGridSizeY, myPlaneRangeX, myPlaneRangeY, curDisplayMode);
@@ -200,6 +420,21 @@ void ofApp::setupParticleSystem() {
 
 }
 
+//--------------------------------------------------------------
+void ofApp::drawStartupProgress() {
+	// A bar of the finished tasks, with the ones still going above it
+	float width = 300;
+	float x = (ofGetWidth() - width) / 2;
+	float y = ofGetHeight() / 2;
+	float progress = float(myStartup.getNumFinished()) / max(1, myStartup.getNumTasks());
+	ofSetColor(255);
+	ofDrawBitmapString("Loading " + myStartup.getStatus(), x, y - 10);
+	ofNoFill();
+	ofDrawRectangle(x, y, width, 10);
+	ofFill();
+	ofDrawRectangle(x, y, width * progress, 10);
+}
+
 //--------------------------------------------------------------
 void ofApp::gridSizeChanged(int &v) {
 	// Simply call setupParticleSystem
@@ -212,6 +447,107 @@ void ofApp::displayModeChanged(bool &v) {
 	setupParticleSystem();
 }
 
+//--------------------------------------------------------------
+void ofApp::compactStorageChanged(bool &v) {
+	// The particles are set up again from the full precision mesh, so
+	// going back to the full layout loses nothing
+	myParticleSystem.setCompactStorage(v);
+	setupParticleSystem();
+	if (v) {
+		ofLogNotice("ofApp::compactStorageChanged") << "max position error " << myParticleSystem.getCompactPositionError()
+			<< ", max direction error " << myParticleSystem.getCompactDirectionError() << " degrees";
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::depthFilterChanged(int &v) {
+	// 0 = none, 1 = median, 2 = bilateral
+	myParticleSystem.getDepthPreprocessor().setFilter(DepthFilter(v));
+}
+
+//--------------------------------------------------------------
+void ofApp::backgroundMarginChanged(float &v) {
+	myParticleSystem.getDepthPreprocessor().setBackgroundMargin(v);
+}
+
+//--------------------------------------------------------------
+void ofApp::learnBackgroundPressed() {
+	// The scene should be empty for the next second or so
+	myParticleSystem.getDepthPreprocessor().learnBackground(30);
+}
+
+//--------------------------------------------------------------
+void ofApp::adaptiveSamplingChanged(bool &v) {
+	// Takes effect when the point cloud is rebuilt next frame
+	myParticleSystem.setAdaptiveSampling(v);
+}
+
+//--------------------------------------------------------------
+void ofApp::depthInterpolationChanged(bool &v) {
+	// 0 ms delay extrapolates from the last two depth frames, about 33 ms
+	// interpolates between them a frame later
+	myParticleSystem.setTemporalInterpolation(v);
+}
+
+//--------------------------------------------------------------
+void ofApp::outlierRemovalChanged(bool &v) {
+	// Depth frames are filtered from the next one on, a loaded mesh is
+	// set up again from the original
+	myParticleSystem.setOutlierRemoval(v);
+	if (mySetupMode == 2) {
+		setupParticleSystem();
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::outlierThresholdChanged(float &v) {
+	myParticleSystem.getOutlierFilter().setThreshold(v);
+	if (mySetupMode == 2 && paramOutlierRemoval) {
+		setupParticleSystem();
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::pointBudgetChanged(int &v) {
+	// The octree is only built for point meshes, and building it or
+	// going back to the plain mesh sets the mesh up again
+	myParticleSystem.setPointBudget(v);
+	bool showPoints = !paramShowTriangles && !paramShowLines;
+	if (showPoints && (v > 0) != myParticleSystem.getOctree().isBuilt()) {
+		setupParticleSystem();
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::governorChanged(bool &v) {
+	// Turning it off goes back to full quality
+	myGovernor.setEnabled(v);
+}
+
+//--------------------------------------------------------------
+void ofApp::simulationChanged(bool &v) {
+	// Starts from the rest shape, the effects take over again when off.
+	// The springs are only built while it's on.
+	myParticleSystem.setSimulation(v);
+	if (v && !myParticleSystem.getSpringSystem().isSetup()) {
+		setupParticleSystem();
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::bakedNoiseChanged(bool &v) {
+	// Loaded from the data folder, or baked once and saved there
+	if (v && !myNoiseVolume.isBuilt()) {
+		setupEffectNoiseVolumes(myNoiseVolume, myFlowVolume);
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::analyticNormalsChanged(bool &v) {
+	// Falls back to the triangle normals unless the noise is baked
+	myParticleSystem.setAnalyticNormals(v);
+}
+
 //--------------------------------------------------------------
 void ofApp::saveMeshButtonPressed() {
 	// Get the file fileName to save the file
@@ -226,6 +562,54 @@ void ofApp::saveMeshButtonPressed() {
 	myParticleSystem.getMesh().save(fileName);
 }
 
+//--------------------------------------------------------------
+void ofApp::recordDepthChanged(bool &v) {
+	if (v) {
+		// Recordings use the same base name as saved meshes
+		string fileName = paramFileName.toString() + ".bsdepth";
+		ofShortPixels &depth = myParticleSystem.getRawDepthPixels();
+		int width = depth.isAllocated() ? depth.getWidth() : 640;
+		int height = depth.isAllocated() ? depth.getHeight() : 480;
+		if (!myDepthRecorder.start(fileName, width, height)) {
+			paramRecordDepth = false;
+		}
+	}
+	else {
+		myDepthRecorder.stop();
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::recordSequenceChanged(bool &v) {
+	if (v) {
+		// The current mesh sets the topology for the whole sequence
+		string fileName = paramFileName.toString() + ".bsmesh";
+		if (!mySequenceExporter.start(fileName, myParticleSystem.getMesh(), paramSequenceNormals)) {
+			paramRecordSequence = false;
+		}
+	}
+	else {
+		mySequenceExporter.stop();
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::publishMeshChanged(bool &v) {
+	if (v) {
+		// Room for the current mesh or the largest point cloud grid,
+		// whichever is bigger
+		const ofMesh &mesh = myParticleSystem.getMesh();
+		int maxVertices = max(int(mesh.getNumVertices()), 500 * 500);
+		int maxIndices = max(int(mesh.getNumIndices()), 6 * 500 * 500);
+		if (!myMeshPublisher.start(MESH_STREAM_DEFAULT_NAME, maxVertices, maxIndices)) {
+			paramPublishMesh = false;
+		}
+	}
+	else {
+		myMeshPublisher.stop();
+	}
+}
+
 
 
 
@@ -254,6 +638,10 @@ ofLog(OF_LOG_VERBOSE, "[DiskOut]  saved frame " + ofToString(ofGetFrameNum()) );
 
 //--------------------------------------------------------------
 void ofApp::keyPressed(int key){
+    // The mesh and the Kinect may still be loading
+    if (!myStartup.isDone()) {
+        return;
+    }
     switch (key) {
       
         case'0':
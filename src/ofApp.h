@@ -3,6 +3,12 @@
 #include "ofMain.h"
 #include "ofxGui.h"
 #include "ParticleSystem.h"
+#include "DepthRecorder.h"
+#include "MeshSequence.h"
+#include "Clock.h"
+#include "QualityGovernor.h"
+#include "MeshStreamPublisher.h"
+#include "StartupLoader.h"
 
 using namespace glm;
 
@@ -12,6 +18,7 @@ class ofApp : public ofBaseApp{
 		void setup();
 		void update();
 		void draw();
+		void exit();
 
 		void keyPressed(int key);
 		void keyReleased(int key);
@@ -26,25 +33,92 @@ class ofApp : public ofBaseApp{
 		void gotMessage(ofMessage msg);
 
 		void setupParticleSystem();
+		void drawStartupProgress();
 		void gridSizeChanged(int &v);
 		void displayModeChanged(bool &v);
 		void saveMeshButtonPressed();
+		void recordDepthChanged(bool &v);
+		void recordSequenceChanged(bool &v);
+		void compactStorageChanged(bool &v);
+		void depthFilterChanged(int &v);
+		void backgroundMarginChanged(float &v);
+		void learnBackgroundPressed();
+		void adaptiveSamplingChanged(bool &v);
+		void depthInterpolationChanged(bool &v);
+		void outlierRemovalChanged(bool &v);
+		void outlierThresholdChanged(float &v);
+		void pointBudgetChanged(int &v);
+		void bakedNoiseChanged(bool &v);
+		void analyticNormalsChanged(bool &v);
+		void governorChanged(bool &v);
+		void publishMeshChanged(bool &v);
+		void simulationChanged(bool &v);
     void saveImage();
 
 		ParticleSystem myParticleSystem;
+		WallClock myClock;
+		NoiseVolume myNoiseVolume;
+		NoiseVolume myFlowVolume;
 
 		ofxLabel myFpsLabel;
+		ofxLabel myAllocationLabel;
+		ofxLabel myQualityLabel;
+		ofxLabel myStageTimesLabel;
+		ofxLabel myVisiblePointsLabel;
+		QualityGovernor myGovernor;
+		uint64_t myFrameStartTime = 0;
+		uint64_t myLastAllocationCount = 0;
 		ofParameter<float> paramAmplitude;
 		ofParameter<float> paramFrequency;
 		ofParameter<float> paramScale;
+		ofParameter<bool> paramNoise;
+		ofParameter<bool> paramRipple;
+		ofParameter<float> paramRippleAmplitude;
+		ofParameter<float> paramRippleWavelength;
+		ofParameter<bool> paramTwist;
+		ofParameter<float> paramTwistAngle;
+		ofParameter<bool> paramFlow;
+		ofParameter<float> paramFlowAmplitude;
+		ofParameter<float> paramFlowScale;
+		ofParameter<bool> paramShape;
+		ofParameter<float> paramShapeGain;
+		ofParameter<bool> paramBakedNoise;
+		ofParameter<bool> paramAnalyticNormals;
+		ofParameter<bool> paramGovernor;
+		ofParameter<int> paramPointBudget;
+		ofParameter<bool> paramSimulation;
+		ofParameter<float> paramGravity;
+		ofParameter<float> paramDamping;
+		ofParameter<float> paramStiffness;
+		ofParameter<int> paramIterations;
+		ofParameter<float> paramPinHeight;
 		ofParameter<int> paramGridSizeX;
 		ofParameter<int> paramGridSizeY;
 		ofParameter<bool> paramShowLines;
 		ofParameter<bool> paramShowTriangles;
         ofParameter<bool> paramShader;
+		ofParameter<bool> paramCompactStorage;
+		ofParameter<int> paramDepthFilter;
+		ofParameter<float> paramBackgroundMargin;
+		ofxButton buttonLearnBackground;
+		ofParameter<bool> paramAdaptiveSampling;
+		ofParameter<bool> paramDepthInterpolation;
+		ofParameter<float> paramInterpolationDelay;
+		ofParameter<bool> paramOutlierRemoval;
+		ofParameter<float> paramOutlierThreshold;
         ofxButton buttonRestart;
 		ofParameter<string> paramFileName;
 		ofxButton buttonSaveMesh;
+		ofParameter<bool> paramRecordDepth;
+		ofxLabel myRecorderLabel;
+		ofParameter<bool> paramRecordSequence;
+		ofParameter<bool> paramSequenceNormals;
+		ofParameter<bool> paramPublishMesh;
+		ofxGuiGroup myEffectsGui;
+		ofxGuiGroup myQualityGui;
+		ofxGuiGroup mySimulationGui;
+		ofxGuiGroup myDepthGui;
+		ofxGuiGroup myOutputGui;
 		ofxPanel myGui;
 
 		ofEasyCam myCamera;
@@ -57,10 +131,26 @@ class ofApp : public ofBaseApp{
 		float mySphereRadius;
 		int mySetupMode; // 0 = plane, 1 = sphere, 2 = custom mesh
 		ofMesh myInitialMesh;
+		vector<ofIndexType> myInitialEdges;
     
     //Shader setup
     ofShader myReflectionShader;
     ofImage myEnvironmentMap;
+    ofPixels myEnvironmentPixels;
     
     ofFbo fbo;
+
+    // Records raw Kinect depth frames for later reprocessing
+    DepthRecorder myDepthRecorder;
+
+    // Exports the animated mesh for use in other tools
+    MeshSequenceExporter mySequenceExporter;
+
+    // Shares the animated mesh with other processes on this machine
+    MeshStreamPublisher myMeshPublisher;
+
+    // Loads the shader, environment map, mesh and Kinect in parallel.
+    // Declared last so it's destroyed first, waiting for any work still
+    // writing to the members above.
+    StartupLoader myStartup;
 };
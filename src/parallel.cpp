@@ -0,0 +1,205 @@
+#include "parallel.h"
+
+//--------------------------------------------------------------
+// Persistent pool behind parallelFor. Workers sleep until a new job is
+// published, then take chunks from a shared atomic counter.
+class ParallelPool {
+public:
+	ParallelPool();
+	~ParallelPool();
+
+	void run(int begin, int end, int chunkSize, ParallelRangeFunction function, void *context);
+	int getNumThreads() const;
+	void setNumThreads(int numThreads);
+
+private:
+	void startWorkers(int numWorkers);
+	void stopWorkers();
+	void workerLoop();
+	void runChunks();
+
+	vector<thread> myWorkers;
+	std::mutex myJobMutex;
+	std::mutex myMutex;
+	condition_variable myWakeCondition;
+	condition_variable myDoneCondition;
+	bool myQuitting;
+
+	// Current job, only changed while no worker is active
+	uint64_t myGeneration;
+	ParallelRangeFunction myFunction;
+	void *myContext;
+	int myBegin;
+	int myEnd;
+	int myChunkSize;
+	int myNumChunks;
+	atomic<int> myNextChunk;
+	atomic<int> myChunksDone;
+	int myActiveWorkers;
+};
+
+static thread_local bool insideParallelFor = false;
+
+//--------------------------------------------------------------
+static ParallelPool &getParallelPool() {
+	static ParallelPool pool;
+	return pool;
+}
+
+//--------------------------------------------------------------
+ParallelPool::ParallelPool() :
+	myQuitting(false), myGeneration(0), myFunction(nullptr), myContext(nullptr),
+	myBegin(0), myEnd(0), myChunkSize(1), myNumChunks(0), myNextChunk(0), myChunksDone(0), myActiveWorkers(0) {
+	startWorkers(max(1, int(thread::hardware_concurrency())) - 1);
+}
+
+//--------------------------------------------------------------
+ParallelPool::~ParallelPool() {
+	stopWorkers();
+}
+
+//--------------------------------------------------------------
+void ParallelPool::startWorkers(int numWorkers) {
+	myQuitting = false;
+	for (int i = 0; i < numWorkers; i++) {
+		myWorkers.push_back(thread(&ParallelPool::workerLoop, this));
+	}
+}
+
+//--------------------------------------------------------------
+void ParallelPool::stopWorkers() {
+	{
+		lock_guard<std::mutex> lock(myMutex);
+		myQuitting = true;
+	}
+	myWakeCondition.notify_all();
+	for (size_t i = 0; i < myWorkers.size(); i++) {
+		myWorkers[i].join();
+	}
+	myWorkers.clear();
+}
+
+//--------------------------------------------------------------
+int ParallelPool::getNumThreads() const {
+	return myWorkers.size() + 1;
+}
+
+//--------------------------------------------------------------
+void ParallelPool::setNumThreads(int numThreads) {
+	lock_guard<std::mutex> jobLock(myJobMutex);
+	if (numThreads <= 0) {
+		numThreads = max(1, int(thread::hardware_concurrency()));
+	}
+	stopWorkers();
+	startWorkers(numThreads - 1);
+}
+
+//--------------------------------------------------------------
+void ParallelPool::run(int begin, int end, int chunkSize, ParallelRangeFunction function, void *context) {
+	// Only one job at a time. If the pool is busy with another thread's
+	// job, or there are no workers, do the work here instead of waiting.
+	unique_lock<std::mutex> jobLock(myJobMutex, try_to_lock);
+	if (!jobLock.owns_lock() || myWorkers.empty()) {
+		function(context, begin, end);
+		return;
+	}
+
+	{
+		// A worker that woke up late for the previous job may still be
+		// looking at it, wait for it before replacing the job
+		unique_lock<std::mutex> lock(myMutex);
+		myDoneCondition.wait(lock, [this] { return myActiveWorkers == 0; });
+		myFunction = function;
+		myContext = context;
+		myBegin = begin;
+		myEnd = end;
+		myChunkSize = chunkSize;
+		myNumChunks = (end - begin + chunkSize - 1) / chunkSize;
+		myNextChunk = 0;
+		myChunksDone = 0;
+		myGeneration++;
+	}
+	myWakeCondition.notify_all();
+
+	runChunks();
+
+	// Wait for the remaining chunks, and for every worker to have let
+	// go of this job before the next one can be published
+	unique_lock<std::mutex> lock(myMutex);
+	myDoneCondition.wait(lock, [this] { return myChunksDone == myNumChunks && myActiveWorkers == 0; });
+}
+
+//--------------------------------------------------------------
+void ParallelPool::runChunks() {
+	while (true) {
+		int chunk = myNextChunk++;
+		if (chunk >= myNumChunks) {
+			break;
+		}
+		int chunkBegin = myBegin + chunk * myChunkSize;
+		int chunkEnd = min(chunkBegin + myChunkSize, myEnd);
+		myFunction(myContext, chunkBegin, chunkEnd);
+		if (++myChunksDone == myNumChunks) {
+			lock_guard<std::mutex> lock(myMutex);
+			myDoneCondition.notify_all();
+		}
+	}
+}
+
+//--------------------------------------------------------------
+void ParallelPool::workerLoop() {
+	insideParallelFor = true;
+	uint64_t seenGeneration = 0;
+	while (true) {
+		{
+			unique_lock<std::mutex> lock(myMutex);
+			myWakeCondition.wait(lock, [&] { return myQuitting || myGeneration != seenGeneration; });
+			if (myQuitting) {
+				return;
+			}
+			seenGeneration = myGeneration;
+			myActiveWorkers++;
+		}
+
+		runChunks();
+
+		{
+			lock_guard<std::mutex> lock(myMutex);
+			myActiveWorkers--;
+		}
+		myDoneCondition.notify_all();
+	}
+}
+
+//--------------------------------------------------------------
+void runParallelFor(int begin, int end, int minChunkSize, ParallelRangeFunction function, void *context) {
+	int count = end - begin;
+	if (count <= 0) {
+		return;
+	}
+
+	// Small ranges and nested calls run on this thread
+	if (count <= minChunkSize || insideParallelFor) {
+		function(context, begin, end);
+		return;
+	}
+
+	// A few chunks per thread so uneven chunks balance out
+	ParallelPool &pool = getParallelPool();
+	int numChunks = min(pool.getNumThreads() * 4, (count + minChunkSize - 1) / minChunkSize);
+	int chunkSize = (count + numChunks - 1) / numChunks;
+
+	insideParallelFor = true;
+	pool.run(begin, end, chunkSize, function, context);
+	insideParallelFor = false;
+}
+
+//--------------------------------------------------------------
+int getNumParallelThreads() {
+	return getParallelPool().getNumThreads();
+}
+
+//--------------------------------------------------------------
+void setNumParallelThreads(int numThreads) {
+	getParallelPool().setNumThreads(numThreads);
+}
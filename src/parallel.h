@@ -0,0 +1,35 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Splits the range [begin, end) into chunks and runs body(chunkBegin,
+// chunkEnd) on a persistent pool of worker threads, one per core, with
+// the calling thread helping out. Returns when every chunk is done.
+// Ranges smaller than minChunkSize, and calls made from inside another
+// parallelFor, just run on the calling thread.
+template<typename Body>
+void parallelFor(int begin, int end, Body &&body, int minChunkSize = 1024);
+
+// Number of threads parallelFor spreads work over, including the caller
+int getNumParallelThreads();
+
+// Limits the pool to numThreads threads (0 = one per core). Mostly
+// useful for checking that results don't depend on the thread count.
+void setNumParallelThreads(int numThreads);
+
+//--------------------------------------------------------------
+// Type erased entry point, the body is passed as a context pointer
+// together with a function that knows its real type so no heap
+// allocation is needed per call
+typedef void (*ParallelRangeFunction)(void *context, int begin, int end);
+void runParallelFor(int begin, int end, int minChunkSize, ParallelRangeFunction function, void *context);
+
+template<typename Body>
+void callParallelBody(void *context, int begin, int end) {
+	(*static_cast<typename std::remove_reference<Body>::type *>(context))(begin, end);
+}
+
+template<typename Body>
+void parallelFor(int begin, int end, Body &&body, int minChunkSize) {
+	runParallelFor(begin, end, minChunkSize, &callParallelBody<Body>, (void *)&body);
+}
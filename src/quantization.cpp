@@ -0,0 +1,64 @@
+#include "quantization.h"
+#include "parallel.h"
+
+//--------------------------------------------------------------
+QuantizationBounds calcQuantizationBounds(const vec3 *positions, size_t count) {
+	vec3 minPos(FLT_MAX);
+	vec3 maxPos(-FLT_MAX);
+	for (size_t i = 0; i < count; i++) {
+		minPos = min(minPos, positions[i]);
+		maxPos = max(maxPos, positions[i]);
+	}
+	if (count == 0) {
+		minPos = vec3(0);
+		maxPos = vec3(0);
+	}
+
+	// Keep flat meshes from getting a zero sized step
+	vec3 extent = max(maxPos - minPos, vec3(1e-6));
+
+	QuantizationBounds bounds;
+	bounds.min = minPos;
+	bounds.step = extent / 65535.0f;
+	bounds.invStep = 65535.0f / extent;
+	return bounds;
+}
+
+//--------------------------------------------------------------
+void encodeCompactParticles(const vec3 *positions, const vec3 *directions, size_t count, const QuantizationBounds &bounds, CompactParticle *out) {
+	parallelFor(0, count, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			quantizePosition(positions[i], bounds, out[i].pos);
+			octEncode(directions[i], out[i].dir[0], out[i].dir[1]);
+		}
+	});
+}
+
+//--------------------------------------------------------------
+void decodeCompactParticles(const CompactParticle *particles, size_t count, const QuantizationBounds &bounds, vec3 *positions, vec3 *directions) {
+	parallelFor(0, count, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			positions[i] = dequantizePosition(particles[i].pos, bounds);
+			directions[i] = octDecode(particles[i].dir[0], particles[i].dir[1]);
+		}
+	});
+}
+
+//--------------------------------------------------------------
+void measureCompactError(const vec3 *positions, const vec3 *directions, const CompactParticle *particles, size_t count,
+	const QuantizationBounds &bounds, float &maxPositionError, float &maxDirectionError) {
+	maxPositionError = 0;
+	double maxSinAngle = 0;
+	for (size_t i = 0; i < count; i++) {
+		vec3 p = dequantizePosition(particles[i].pos, bounds);
+		maxPositionError = max(maxPositionError, distance(p, positions[i]));
+
+		// The sine from the cross product stays accurate for tiny angles
+		float l = length(directions[i]);
+		if (l > 0) {
+			vec3 d = octDecode(particles[i].dir[0], particles[i].dir[1]);
+			maxSinAngle = max(maxSinAngle, double(length(cross(d, directions[i] / l))));
+		}
+	}
+	maxDirectionError = float(asin(min(maxSinAngle, 1.0)) * 180.0 / PI);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "ofMain.h"
+
+using namespace glm;
+
+// Compact vertex storage.
+//
+// Positions are quantized to 16 bits per axis relative to a bounding
+// box, the error per axis is at most half a quantization step, so for
+// a box of extent E the position error is below E / 131070 * sqrt(3).
+//
+// Unit vectors are mapped onto the octahedron and unfolded into a
+// square, stored as 2x16 bits. Measured over random directions the
+// worst angular error is about 0.004 degrees.
+
+struct QuantizationBounds {
+	vec3 min;
+	vec3 step;
+	vec3 invStep;
+};
+
+// Positions and directions of one compact particle, 10 bytes
+struct CompactParticle {
+	uint16_t pos[3];
+	uint16_t dir[2];
+};
+
+QuantizationBounds calcQuantizationBounds(const vec3 *positions, size_t count);
+
+//--------------------------------------------------------------
+inline void octEncode(const vec3 &n, uint16_t &u, uint16_t &v) {
+	float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if (l1 == 0) {
+		// Zero vectors have no direction, store them as +z
+		u = 32768;
+		v = 32768;
+		return;
+	}
+	float x = n.x / l1;
+	float y = n.y / l1;
+	if (n.z < 0) {
+		float fx = (1.0f - fabsf(y)) * (x >= 0 ? 1.0f : -1.0f);
+		float fy = (1.0f - fabsf(x)) * (y >= 0 ? 1.0f : -1.0f);
+		x = fx;
+		y = fy;
+	}
+	u = uint16_t(ofClamp(roundf((x * 0.5f + 0.5f) * 65535.0f), 0, 65535));
+	v = uint16_t(ofClamp(roundf((y * 0.5f + 0.5f) * 65535.0f), 0, 65535));
+}
+
+//--------------------------------------------------------------
+inline vec3 octDecode(uint16_t u, uint16_t v) {
+	vec3 n;
+	n.x = u * (2.0f / 65535.0f) - 1.0f;
+	n.y = v * (2.0f / 65535.0f) - 1.0f;
+	n.z = 1.0f - fabsf(n.x) - fabsf(n.y);
+	float t = max(-n.z, 0.0f);
+	n.x += n.x >= 0 ? -t : t;
+	n.y += n.y >= 0 ? -t : t;
+	return normalize(n);
+}
+
+//--------------------------------------------------------------
+inline void quantizePosition(const vec3 &p, const QuantizationBounds &bounds, uint16_t *q) {
+	vec3 f = (p - bounds.min) * bounds.invStep + 0.5f;
+	q[0] = uint16_t(ofClamp(f.x, 0, 65535));
+	q[1] = uint16_t(ofClamp(f.y, 0, 65535));
+	q[2] = uint16_t(ofClamp(f.z, 0, 65535));
+}
+
+//--------------------------------------------------------------
+inline vec3 dequantizePosition(const uint16_t *q, const QuantizationBounds &bounds) {
+	return bounds.min + vec3(q[0], q[1], q[2]) * bounds.step;
+}
+
+// Batch kernels, these split the work across all cores
+void encodeCompactParticles(const vec3 *positions, const vec3 *directions, size_t count, const QuantizationBounds &bounds, CompactParticle *out);
+void decodeCompactParticles(const CompactParticle *particles, size_t count, const QuantizationBounds &bounds, vec3 *positions, vec3 *directions);
+
+// Largest position distance and direction angle (in degrees) between
+// the originals and their compact versions
+void measureCompactError(const vec3 *positions, const vec3 *directions, const CompactParticle *particles, size_t count,
+	const QuantizationBounds &bounds, float &maxPositionError, float &maxDirectionError);